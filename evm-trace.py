@@ -0,0 +1,91 @@
+# Decodes an execution trace saved by the emulator (-v) into the verbose output, one line per instruction
+# Usage: python3 evm-trace.py [-d] [trace file] (Default: evm.trace)
+#   -d  Prefix every line with the cycle it started at and the disassembled instruction
+
+import struct
+import sys
+
+# Mnemonic and addressing mode of every opcode (65C02)
+OPCODES = [
+	"BRK imp", "ORA izx", "NOP imp", "NOP imp", "TSB zp", "ORA zp", "ASL zp", "NOP imp",
+	"PHP imp", "ORA imm", "ASL acc", "NOP imp", "TSB abs", "ORA abs", "ASL abs", "NOP imp",
+	"BPL rel", "ORA izy", "ORA izp", "NOP imp", "TRB zp", "ORA zpx", "ASL zpx", "NOP imp",
+	"CLC imp", "ORA aby", "INA imp", "NOP imp", "TRB abs", "ORA abx", "ASL abx", "NOP imp",
+	"JSR abs", "AND izx", "NOP imp", "NOP imp", "BIT zp", "AND zp", "ROL zp", "NOP imp",
+	"PLP imp", "AND imm", "ROL acc", "NOP imp", "BIT abs", "AND abs", "ROL abs", "NOP imp",
+	"BMI rel", "AND izy", "AND izp", "NOP imp", "BIT zpx", "AND zpx", "ROL zpx", "NOP imp",
+	"SEC imp", "AND aby", "DEA imp", "NOP imp", "BIT abx", "AND abx", "ROL abx", "NOP imp",
+	"RTI imp", "EOR izx", "NOP imp", "NOP imp", "NOP imp", "EOR zp", "LSR zp", "NOP imp",
+	"PHA imp", "EOR imm", "LSR acc", "NOP imp", "JMP abs", "EOR abs", "LSR abs", "NOP imp",
+	"BVC rel", "EOR izy", "EOR izp", "NOP imp", "NOP imp", "EOR zpx", "LSR zpx", "NOP imp",
+	"CLI imp", "EOR aby", "PHY imp", "NOP imp", "NOP imp", "EOR abx", "LSR abx", "NOP imp",
+	"RTS imp", "ADC izx", "NOP imp", "NOP imp", "STZ zp", "ADC zp", "ROR zp", "NOP imp",
+	"PLA imp", "ADC imm", "ROR acc", "NOP imp", "JMP ind", "ADC abs", "ROR abs", "NOP imp",
+	"BVS rel", "ADC izy", "ADC izp", "NOP imp", "STZ zpx", "ADC zpx", "ROR zpx", "NOP imp",
+	"SEI imp", "ADC aby", "PLY imp", "NOP imp", "JMP iax", "ADC abx", "ROR abx", "NOP imp",
+	"BRA rel", "STA izx", "NOP imp", "NOP imp", "STY zp", "STA zp", "STX zp", "NOP imp",
+	"DEY imp", "BIT imm", "TXA imp", "NOP imp", "STY abs", "STA abs", "STX abs", "NOP imp",
+	"BCC rel", "STA izy", "STA izp", "NOP imp", "STY zpx", "STA zpx", "STX zpy", "NOP imp",
+	"TYA imp", "STA aby", "TXS imp", "NOP imp", "STZ abs", "STA abx", "STZ abx", "NOP imp",
+	"LDY imm", "LDA izx", "LDX imm", "NOP imp", "LDY zp", "LDA zp", "LDX zp", "NOP imp",
+	"TAY imp", "LDA imm", "TAX imp", "NOP imp", "LDY abs", "LDA abs", "LDX abs", "NOP imp",
+	"BCS rel", "LDA izy", "LDA izp", "NOP imp", "LDY zpx", "LDA zpx", "LDX zpy", "NOP imp",
+	"CLV imp", "LDA aby", "TSX imp", "NOP imp", "LDY abx", "LDA abx", "LDX aby", "NOP imp",
+	"CPY imm", "CMP izx", "NOP imp", "NOP imp", "CPY zp", "CMP zp", "DEC zp", "NOP imp",
+	"INY imp", "CMP imm", "DEX imp", "WAI imp", "CPY abs", "CMP abs", "DEC abs", "NOP imp",
+	"BNE rel", "CMP izy", "CMP izp", "NOP imp", "NOP imp", "CMP zpx", "DEC zpx", "NOP imp",
+	"CLD imp", "CMP aby", "PHX imp", "STP imp", "NOP imp", "CMP abx", "DEC abx", "NOP imp",
+	"CPX imm", "SBC izx", "NOP imp", "NOP imp", "CPX zp", "SBC zp", "INC zp", "NOP imp",
+	"INX imp", "SBC imm", "NOP imp", "NOP imp", "CPX abs", "SBC abs", "INC abs", "NOP imp",
+	"BEQ rel", "SBC izy", "SBC izp", "NOP imp", "NOP imp", "SBC zpx", "INC zpx", "NOP imp",
+	"SED imp", "SBC aby", "PLX imp", "NOP imp", "NOP imp", "SBC abx", "INC abx", "NOP imp",
+]
+
+# Operand format of every addressing mode (rel: branch offset)
+MODES = {
+	"imp": "", "acc": "A", "imm": "#$%02X", "zp": "$%02X", "zpx": "$%02X,X", "zpy": "$%02X,Y",
+	"abs": "$%04X", "abx": "$%04X,X", "aby": "$%04X,Y", "izx": "($%02X,X)", "izy": "($%02X),Y",
+	"izp": "($%02X)", "ind": "($%04X)", "iax": "($%04X,X)", "rel": "$%04X",
+}
+
+RECORD = struct.Struct("<QHH12B") # cycle, pc, address, opcode, operand (2), ac, x, y, sr, sp, sp value, value, kind, reserved
+KINDS = {1: "### IRQ Interrupt", 2: "### NMI Interrupt"} # <- Taken after the instruction
+
+def disassemble(pc, opcode, low, high):
+	mnemonic, mode = OPCODES[opcode].split()
+	if mode == "rel":
+		operand = MODES[mode] % ((pc + 2 + (low - 256 if low > 127 else low)) & 0xFFFF)
+	elif mode in ("abs", "abx", "aby", "ind", "iax"):
+		operand = MODES[mode] % (low | (high << 8))
+	elif "%" in MODES[mode]:
+		operand = MODES[mode] % low
+	else:
+		operand = MODES[mode]
+	return (mnemonic + " " + operand).strip()
+
+args = sys.argv[1:]
+disasm = "-d" in args
+paths = [a for a in args if a != "-d"]
+path = paths[0] if paths else "evm.trace"
+
+with open(path, "rb") as in_file:
+	data = in_file.read()
+if data[:8] != b"EVMTRACE":
+	sys.exit("Error: " + path + " isn't an EVM trace")
+version, size, count, lost = struct.unpack_from("<IIQQ", data, 8)
+if version != 1 or size != RECORD.size:
+	sys.exit("Error: Unsupported trace version " + str(version))
+if lost > 0:
+	print("(%d older records were overwritten)" % lost)
+
+out = sys.stdout
+for i in range(count):
+	cycle, pc, address, opcode, low, high, ac, x, y, sr, sp, sp_value, value, kind, _ = RECORD.unpack_from(data, 32 + i * RECORD.size)
+	if kind == 3:
+		out.write(" ---- RESET ----\n")
+		continue
+	if disasm:
+		out.write("%12d  %-14s  " % (cycle, disassemble(pc, opcode, low, high)))
+	out.write("PC: %04x    Ins: %02x    X: %02x    Y: %02x    AC: %02x    SR: %02x    SP: %02x    SP Val.: %02x    Ref. Addr.: %04x    Val. in Addr.: %02x\n" % (pc, opcode, x, y, ac, sr, sp, sp_value, address, value))
+	if kind in KINDS:
+		out.write(KINDS[kind] + "\n")
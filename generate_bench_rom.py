@@ -0,0 +1,54 @@
+# You can use this script to generate a 16kb ROM that benchmarks the CPU
+# Run it with the Clock Test enabled (EVM -rom bench.rom -storage ssd.img -clk) to get the emulated and host MIPS
+# Build the emulator with -DEVM_DISPATCH=0 (switch), 1 (table) or 2 (threaded) to compare the dispatch methods
+
+rom = bytearray([0xEA] * 0x4000) # $C000-$FFFF
+
+def put(address, code):
+	rom[address - 0xC000:address - 0xC000 + len(code)] = bytes(code)
+
+# Reset: mixed loop of loads, stores, ALU, read-modify-write, branches and subroutine calls
+put(0xC000, [
+	0xA2, 0xFF,       # LDX #$FF
+	0x9A,             # TXS
+	0x78,             # SEI
+	0xD8,             # CLD
+	0xA0, 0x00,       # outer: LDY #$00
+	0xB9, 0x00, 0xC1, # inner: LDA $C100,Y
+	0x18,             # CLC
+	0x65, 0x10,       # ADC $10
+	0x85, 0x10,       # STA $10
+	0x99, 0x00, 0x02, # STA $0200,Y
+	0xE6, 0x11,       # INC $11
+	0x46, 0x12,       # LSR $12
+	0x29, 0x7F,       # AND #$7F
+	0xC9, 0x40,       # CMP #$40
+	0x90, 0x02,       # BCC +2
+	0x49, 0xFF,       # EOR #$FF
+	0x20, 0x30, 0xC0, # JSR $C030
+	0xC8,             # INY
+	0xD0, 0xE3,       # BNE inner
+	0x4C, 0x05, 0xC0, # JMP outer
+])
+
+# Subroutine
+put(0xC030, [
+	0x48, # PHA
+	0xAA, # TAX
+	0xE8, # INX
+	0x8A, # TXA
+	0x68, # PLA
+	0x60, # RTS
+])
+
+# Data read by the loop
+put(0xC100, [(i * 37 + 11) & 0xFF for i in range(256)])
+
+# Interrupt handler
+put(0xC0F0, [0x40]) # RTI
+
+# Vectors (NMI, Reset, IRQ/BRK)
+put(0xFFFA, [0xF0, 0xC0, 0x00, 0xC0, 0xF0, 0xC0])
+
+with open("bench.rom", "wb") as out_file:
+	out_file.write(rom)
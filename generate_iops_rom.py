@@ -0,0 +1,253 @@
+# You can use this script to generate a 16kb ROM that benchmarks the SSD's queued interface at different queue depths
+# Run it until it's done (EVM -rom iops.rom -storage ssd.img -headless -turbo -until-pc c0f0), then read the results
+# the ROM saved at the end of the storage: python3 generate_iops_rom.py report ssd.img
+# Every depth reads COMMANDS blocks of 512 bytes, the time comes from the cycle stamps of the completion entries.
+
+import sys
+
+DEPTHS = [1, 2, 4, 8, 16, 32]
+COMMANDS = 240 # Per depth
+CLOCK_SPEED = 4000000
+RESULTS = 0x3FF000 # Where the ROM saves the results (8 bytes per depth: first and last completion cycle)
+
+if len(sys.argv) == 3 and sys.argv[1] == "report":
+	with open(sys.argv[2], "rb") as in_file:
+		in_file.seek(RESULTS)
+		results = in_file.read(8 * len(DEPTHS))
+	print("%-6s %12s %10s %10s" % ("Depth", "Cycles", "IOPS", "MB/s"))
+	for i, depth in enumerate(DEPTHS):
+		first = int.from_bytes(results[i * 8:i * 8 + 4], "little")
+		last = int.from_bytes(results[i * 8 + 4:i * 8 + 8], "little")
+		cycles = (last - first) & 0xFFFFFFFF
+		iops = (COMMANDS - 1) * CLOCK_SPEED / cycles if cycles else 0
+		print("%-6d %12d %10.0f %10.2f" % (depth, cycles, iops, iops * 512 / 1000000))
+	sys.exit(0)
+
+rom = bytearray([0xEA] * 0x4000) # $C000-$FFFF
+
+def put(address, code):
+	rom[address - 0xC000:address - 0xC000 + len(code)] = bytes(code)
+
+# Tiny assembler -- labels for branches and jumps
+class Code:
+	def __init__(self, origin):
+		self.origin = origin
+		self.bytes = []
+		self.labels = {}
+		self.fixups = []
+	def label(self, name):
+		self.labels[name] = self.origin + len(self.bytes)
+	def op(self, *code):
+		self.bytes += code
+	def branch(self, opcode, name):
+		self.bytes += [opcode, 0]
+		self.fixups.append((len(self.bytes) - 1, name, True))
+	def jump(self, opcode, name):
+		self.bytes += [opcode, 0, 0]
+		self.fixups.append((len(self.bytes) - 2, name, False))
+	def assemble(self):
+		for at, name, relative in self.fixups:
+			target = self.labels[name]
+			if relative:
+				offset = target - (self.origin + at + 1)
+				assert -128 <= offset <= 127, name
+				self.bytes[at] = offset & 0xFF
+			else:
+				self.bytes[at:at + 2] = [target & 0xFF, target >> 8]
+		return self.bytes
+
+# Fixed addresses
+DONE, IRQ, MAIN, CHAIN = 0xC0F0, 0xC0E0, 0xC100, 0xC800
+
+# Zero page
+DEPTH_INDEX, DEPTH, SUBMITTED, COMPLETED, SQ_TAIL, CQ_HEAD, PHASE, RESULT = 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07
+IN_FLIGHT = 0x08
+SQ_POINTER, CQ_POINTER = 0x10, 0x12
+# RAM
+BLOCK, SQ, CQ, TABLE, BUFFER = 0x0200, 0x0400, 0x0600, 0x0300, 0x1000
+# Devices
+VIA2_PB, VIA2_PA, VIA2_DDRB, VIA2_DDRA, VIA2_PCR, VIA2_IER = 0x3FE0, 0x3FE1, 0x3FE2, 0x3FE3, 0x3FEC, 0x3FEE
+VIA3_PB, VIA3_DDRB = 0x3FD0, 0x3FD2
+CMD_CHAIN, CMD_QUEUES, DOORBELL_SQ, DOORBELL_CQ = 0x01, 0x02, 0x80, 0xC0
+
+def lo(value):
+	return value & 0xFF
+
+def hi(value):
+	return value >> 8
+
+c = Code(MAIN)
+# Reset: stack, queue block, VIA 2 (CA1 interrupt) and VIA 3 (port B) set up
+c.op(0xA2, 0xFF)                                       # LDX #$FF
+c.op(0x9A)                                             # TXS
+c.op(0xD8)                                             # CLD
+c.op(0xA2, 0x07)                                       # LDX #$07
+c.label("block")
+c.jump(0xBD, "queues")                                 # LDA queues,X
+c.op(0x9D, lo(BLOCK), hi(BLOCK))                       # STA block,X
+c.op(0xCA)                                             # DEX
+c.branch(0x10, "block")                                # BPL block
+c.op(0xA9, 0xFF)                                       # LDA #$FF
+c.op(0x8D, lo(VIA2_DDRA), hi(VIA2_DDRA))               # STA VIA2 DDRA
+c.op(0x8D, lo(VIA2_DDRB), hi(VIA2_DDRB))               # STA VIA2 DDRB
+c.op(0x8D, lo(VIA3_DDRB), hi(VIA3_DDRB))               # STA VIA3 DDRB
+c.op(0xA9, 0x01)                                       # LDA #$01
+c.op(0x8D, lo(VIA2_PCR), hi(VIA2_PCR))                 # STA VIA2 PCR
+c.op(0xA9, 0x82)                                       # LDA #$82
+c.op(0x8D, lo(VIA2_IER), hi(VIA2_IER))                 # STA VIA2 IER
+c.op(0x64, DEPTH_INDEX)                                # STZ depth index
+
+# Every depth: queue block, empty completion ring, counters
+c.label("depth")
+c.op(0xA6, DEPTH_INDEX)                                # LDX depth index
+c.jump(0xBD, "depths")                                 # LDA depths,X
+c.op(0x85, DEPTH)                                      # STA depth
+c.jump(0xBD, "coalesce")                               # LDA coalesce,X
+c.op(0x8D, lo(BLOCK + 5), hi(BLOCK + 5))               # STA block+5 (interrupt every n completions)
+c.op(0x8A)                                             # TXA
+c.op(0x0A, 0x0A, 0x0A)                                 # ASL ASL ASL
+c.op(0x85, RESULT)                                     # STA result (depth index * 8)
+c.op(0xA9, 0x00)                                       # LDA #$00
+c.op(0xAA)                                             # TAX
+c.label("clear")
+c.op(0x9D, lo(CQ), hi(CQ))                             # STA CQ,X
+c.op(0x9D, lo(CQ + 0x100), hi(CQ + 0x100))             # STA CQ+$100,X
+c.op(0xE8)                                             # INX
+c.branch(0xD0, "clear")                                # BNE clear
+c.op(0x85, SUBMITTED, 0x85, COMPLETED)                 # STA submitted, completed
+c.op(0x85, SQ_TAIL, 0x85, CQ_HEAD)                     # STA SQ tail, CQ head
+c.op(0x85, IN_FLIGHT)                                  # STA in flight
+c.op(0xA9, 0x01)                                       # LDA #$01
+c.op(0x85, PHASE)                                      # STA phase
+c.op(0xA9, hi(BLOCK))                                  # LDA #>block (low byte is 0, nothing to latch)
+c.op(0x8D, lo(VIA2_PB), hi(VIA2_PB))                   # STA VIA2 PB (address bus byte 1)
+c.op(0xA9, CMD_QUEUES)                                 # LDA #CMD_QUEUES
+c.op(0x8D, lo(VIA3_PB), hi(VIA3_PB))                   # STA VIA3 PB
+
+# Queue reads while fewer than depth are in flight
+c.label("fill")
+c.op(0xA5, SUBMITTED)                                  # LDA submitted
+c.op(0xC9, COMMANDS)                                   # CMP #COMMANDS
+c.branch(0xF0, "ring")                                 # BEQ ring
+c.op(0xA5, IN_FLIGHT)                                  # LDA in flight
+c.op(0xC5, DEPTH)                                      # CMP depth
+c.branch(0xB0, "ring")                                 # BCS ring
+c.op(0xA5, SQ_TAIL)                                    # LDA SQ tail
+c.op(0x0A, 0x0A, 0x0A)                                 # ASL ASL ASL (entry * 8)
+c.op(0x85, SQ_POINTER)                                 # STA SQ pointer
+c.op(0xA9, hi(SQ))                                     # LDA #>SQ
+c.op(0x69, 0x00)                                       # ADC #$00 (carry: entries 32-63)
+c.op(0x85, SQ_POINTER + 1)                             # STA SQ pointer+1
+c.op(0xA0, 0x00)                                       # LDY #$00
+c.op(0xA9, lo(BUFFER), 0x91, SQ_POINTER, 0xC8)         # LDA #<buffer STA (SQ),Y INY
+c.op(0xA9, hi(BUFFER), 0x91, SQ_POINTER, 0xC8)         # LDA #>buffer STA (SQ),Y INY
+c.op(0xA9, 0x00, 0x91, SQ_POINTER, 0xC8)               # LDA #$00 STA (SQ),Y INY (SSD address: submitted * 512)
+c.op(0xA5, SUBMITTED, 0x0A, 0x91, SQ_POINTER, 0xC8)    # LDA submitted ASL STA (SQ),Y INY
+c.op(0xA9, 0x20, 0x2A, 0x91, SQ_POINTER, 0xC8)         # LDA #$20 ROL STA (SQ),Y INY ($40: RW, SSD -> RAM)
+c.op(0xA9, 0x00, 0x91, SQ_POINTER, 0xC8)               # LDA #$00 STA (SQ),Y INY (length: 512)
+c.op(0xA9, 0x02, 0x91, SQ_POINTER, 0xC8)               # LDA #$02 STA (SQ),Y INY
+c.op(0xA5, SUBMITTED, 0x91, SQ_POINTER)                # LDA submitted STA (SQ),Y (command id)
+c.op(0xE6, SUBMITTED)                                  # INC submitted
+c.op(0xE6, IN_FLIGHT)                                  # INC in flight
+c.op(0xA5, SQ_TAIL, 0x1A, 0x29, 0x3F, 0x85, SQ_TAIL)   # SQ tail = (SQ tail + 1) & 63
+c.jump(0x4C, "fill")                                   # JMP fill
+c.label("ring")
+c.op(0xA5, SQ_TAIL, 0x09, DOORBELL_SQ)                 # LDA SQ tail ORA #DOORBELL_SQ
+c.op(0x8D, lo(VIA3_PB), hi(VIA3_PB))                   # STA VIA3 PB
+
+# Take the completions (an entry is new when its phase matches), the cycle stamps of the first and last one are kept
+c.op(0x78)                                             # SEI
+c.label("poll")
+c.op(0xA5, CQ_HEAD)                                    # LDA CQ head
+c.op(0x0A, 0x0A, 0x0A)                                 # ASL ASL ASL
+c.op(0x85, CQ_POINTER)                                 # STA CQ pointer
+c.op(0xA9, hi(CQ))                                     # LDA #>CQ
+c.op(0x69, 0x00)                                       # ADC #$00
+c.op(0x85, CQ_POINTER + 1)                             # STA CQ pointer+1
+c.op(0xA0, 0x03)                                       # LDY #$03
+c.op(0xB1, CQ_POINTER)                                 # LDA (CQ),Y (phase)
+c.op(0xC5, PHASE)                                      # CMP phase
+c.branch(0xD0, "drained")                              # BNE drained
+c.op(0xA6, RESULT)                                     # LDX result
+c.op(0xA5, COMPLETED)                                  # LDA completed
+c.branch(0xD0, "last")                                 # BNE last
+for i in range(4):
+	c.op(0xC8, 0xB1, CQ_POINTER)                       # INY LDA (CQ),Y
+	c.op(0x9D, lo(TABLE + i), hi(TABLE + i))           # STA table+i,X (first)
+c.op(0xA0, 0x03)                                       # LDY #$03
+c.label("last")
+for i in range(4):
+	c.op(0xC8, 0xB1, CQ_POINTER)                       # INY LDA (CQ),Y
+	c.op(0x9D, lo(TABLE + 4 + i), hi(TABLE + 4 + i))   # STA table+4+i,X (last)
+c.op(0xE6, COMPLETED)                                  # INC completed
+c.op(0xC6, IN_FLIGHT)                                  # DEC in flight
+c.op(0xA5, CQ_HEAD, 0x1A, 0x29, 0x3F, 0x85, CQ_HEAD)   # CQ head = (CQ head + 1) & 63
+c.branch(0xD0, "poll")                                 # BNE poll
+c.op(0xA5, PHASE, 0x49, 0x01, 0x85, PHASE)             # phase ^= 1 (the ring wrapped)
+c.jump(0x4C, "poll")                                   # JMP poll
+c.label("drained")
+c.op(0xA5, CQ_HEAD, 0x09, DOORBELL_CQ)                 # LDA CQ head ORA #DOORBELL_CQ
+c.op(0x8D, lo(VIA3_PB), hi(VIA3_PB))                   # STA VIA3 PB
+c.op(0xA5, COMPLETED)                                  # LDA completed
+c.op(0xC9, COMMANDS)                                   # CMP #COMMANDS
+c.branch(0xF0, "next")                                 # BEQ next
+c.op(0xA5, SUBMITTED)                                  # LDA submitted
+c.op(0xC9, COMMANDS)                                   # CMP #COMMANDS
+c.branch(0xF0, "wait")                                 # BEQ wait
+c.op(0xA5, IN_FLIGHT)                                  # LDA in flight
+c.op(0xC5, DEPTH)                                      # CMP depth
+c.branch(0x90, "more")                                 # BCC more
+c.label("wait")
+c.op(0xCB)                                             # WAI (I set: wakes up without running the handler)
+c.label("more")
+c.op(0x58)                                             # CLI (the handler acknowledges the interrupt)
+c.jump(0x4C, "fill")                                   # JMP fill
+
+# Next depth, then save the results to the SSD (descriptor chain) and stop
+c.label("next")
+c.op(0x58)                                             # CLI
+c.op(0xE6, DEPTH_INDEX)                                # INC depth index
+c.op(0xA5, DEPTH_INDEX)                                # LDA depth index
+c.op(0xC9, len(DEPTHS))                                # CMP #depths
+c.branch(0xF0, "save")                                 # BEQ save
+c.jump(0x4C, "depth")                                  # JMP depth
+c.label("save")
+c.op(0x78)                                             # SEI
+c.op(0xA9, lo(CHAIN))                                  # LDA #<chain
+c.op(0x8D, lo(VIA2_PA), hi(VIA2_PA))                   # STA VIA2 PA (address bus byte 0)
+c.op(0xA9, hi(CHAIN))                                  # LDA #>chain
+c.op(0x8D, lo(VIA2_PB), hi(VIA2_PB))                   # STA VIA2 PB (address bus byte 1)
+c.op(0xA9, CMD_CHAIN)                                  # LDA #CMD_CHAIN
+c.op(0x8D, lo(VIA3_PB), hi(VIA3_PB))                   # STA VIA3 PB
+c.op(0xCB)                                             # WAI
+c.op(0x58)                                             # CLI
+c.op(0x4C, lo(DONE), hi(DONE))                         # JMP done
+
+# Queue block: SQ, CQ, 64 entries, interrupt every n completions (set per depth) or 2000 cycles after the first one
+c.label("queues")
+c.op(lo(SQ), hi(SQ), lo(CQ), hi(CQ), 64, 1, lo(2000), hi(2000))
+c.label("depths")
+c.op(*DEPTHS)
+c.label("coalesce")
+c.op(*[max(1, d // 2) for d in DEPTHS])                # Interrupt every depth/2 completions
+put(MAIN, c.assemble())
+
+# Descriptor chain saving the results: table -> end of the storage
+put(CHAIN, [lo(TABLE), hi(TABLE), lo(RESULTS), hi(RESULTS) & 0xFF, (RESULTS >> 16) | 0x80, 8 * len(DEPTHS), 0x00, 0x00])
+
+# Done
+put(DONE, [0x4C, lo(DONE), hi(DONE)]) # JMP done
+
+# Interrupt handler: acknowledge VIA 2's CA1 (A is kept, the handler can run in the middle of queuing an entry)
+put(IRQ, [
+	0x48,                           # PHA
+	0xAD, lo(VIA2_PA), hi(VIA2_PA), # LDA VIA2 PA
+	0x68,                           # PLA
+	0x40,                           # RTI
+])
+
+# Vectors (NMI, Reset, IRQ/BRK)
+put(0xFFFA, [lo(IRQ), hi(IRQ), lo(MAIN), hi(MAIN), lo(IRQ), hi(IRQ)])
+
+with open("iops.rom", "wb") as out_file:
+	out_file.write(rom)
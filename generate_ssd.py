@@ -1,6 +1,27 @@
 # You can use this script to generate an .img file of 4MB to use as a storage device with the emulator
+# Larger images (a power of two up to 256MB) are addressed in banks of 4MB: python3 generate_ssd.py 16
+# A sparse image only stores the clusters written, an empty one is a header and a table: python3 generate_ssd.py 16 sparse
+# (lz4 instead of sparse: the clusters are compressed when they are written)
 
-img = bytearray([0x00] * 0x400000)
+import sys
 
-with open("ssd.img", "wb") as out_file:
+size = int(sys.argv[1]) if len(sys.argv) > 1 else 4 # MB
+sparse = len(sys.argv) > 2 and sys.argv[2] in ["sparse", "lz4"]
+flags = 1 if len(sys.argv) > 2 and sys.argv[2] == "lz4" else 0
+assert size in [4, 8, 16, 32, 64, 128, 256], "The size must be a power of two from 4 to 256 (MB)"
+
+CLUSTER_SIZE = 0x10000
+capacity = size * 0x100000
+
+if sparse:
+	# Header: "EVMDISK\0", version, cluster size, capacity, clusters, flags (see include/diskimage.h), then the table
+	header = bytearray(b"EVMDISK\0")
+	header += (1).to_bytes(4, "little") + CLUSTER_SIZE.to_bytes(4, "little") + capacity.to_bytes(8, "little")
+	header += (capacity // CLUSTER_SIZE).to_bytes(4, "little") + flags.to_bytes(4, "little")
+	header += bytes(64 - len(header))
+	img = header + bytes(capacity // CLUSTER_SIZE * 16)
+else:
+	img = bytearray([0x00] * capacity)
+
+with open("ssd.evd" if sparse else "ssd.img", "wb") as out_file:
 	out_file.write(img)
@@ -0,0 +1,76 @@
+// CPU Lines -- a bit per source pulling one of the CPU's active-low pins (RES, NMI, IRQ) low. IRQ is the wired-OR of its
+// sources, so a device releasing its line leaves the others asserted.
+enum {
+	LINE_IRQ_VIA_ONE = 0x001, // Keyboard (VIA 1)
+	LINE_IRQ_VIA_TWO = 0x002, // SSD (VIA 2)
+	LINE_IRQ_VIA_THREE = 0x004, // SSD control (VIA 3)
+	LINE_IRQ = 0x0FF, // Any IRQ source
+	LINE_NMI = 0x100, // Non-Maskable Interrupt
+	LINE_RES = 0x200 // Reset
+};
+
+// Board -- what the components of a machine share: memory, the memory bus, the VIAs, the VRS dirty spans, the decoded instructions and the CPU pins
+// Components keep a reference to their board instead of using globals, so a process can host many machines.
+class Board {
+public:
+	byte Memory[0x10000];
+	/* Layout:
+		* $0000-$3FCF (RAM 1)
+		* $3FD0-$3FDF (VIA 3)
+		* $3FE0-$3FEF (VIA 2)
+		* $3FF0-$3FFF (VIA 1)
+		* $4000-$7FFF (RAM 2 -- VIDEO RESERVED SPACE)
+		* $8000-$BFFF (RAM 3)
+		* $C000-$FFFF (ROM)
+	*/
+	MemoryBus bus;
+
+	// VIAs
+	VIA6522 viaOne; // VIA 6522 | 1 ($3FF0-$3FFF)
+	VIA6522 viaTwo; // VIA 6522 | 2 ($3FE0-$3FEF)
+	VIA6522 viaThree; // VIA 6522 | 3 ($3FD0-$3FDF)
+
+	VRSDirtyMap vrsDirty; // Spans of the VRS changed since the last frame
+	DecodeCache icache; // Instructions decoded by the CPU
+
+	// CPU pins
+	std::atomic<unsigned int> Lines{ LINE_RES }; // Asserted lines (LINE_*) -- RES is held at power-on
+	bool RDY = true; // Ready Pin (Active-high, CPU thread only)
+
+	// Pull lines low / let them go (any thread, release: what the device wrote before is visible to the CPU)
+	void assertLine(unsigned int line) {
+		Lines.fetch_or(line, std::memory_order_release);
+	}
+
+	void releaseLine(unsigned int line) {
+		Lines.fetch_and(~line, std::memory_order_release);
+	}
+
+	void setLine(unsigned int line, bool asserted) {
+		if (asserted) {
+			assertLine(line);
+		}
+		else {
+			releaseLine(line);
+		}
+	}
+
+	bool lineAsserted(unsigned int lines) const {
+		return (Lines.load(std::memory_order_acquire) & lines) != 0;
+	}
+
+	// CPU wake-up -- a CPU in WAI or STP parks its thread on pinChanged, other threads call wakeCPU() after posting an event or changing a pin
+	std::mutex pinLock;
+	std::condition_variable pinChanged;
+
+	void wakeCPU() {
+		std::lock_guard<std::mutex> lock(pinLock);
+		pinChanged.notify_all();
+	}
+
+	Board() : bus(&Memory[0]) {
+		for (unsigned int i = 0; i < 0x10000; i++) {
+			Memory[i] = 0x00;
+		}
+	}
+};
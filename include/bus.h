@@ -0,0 +1,133 @@
+// Memory Bus -- 256 pages of 256 bytes
+// Pages with direct pointers (RAM, ROM) are accessed straight from memory. Pages without one go through handlers:
+//  * Page Handler: takes every access to the page (e.g. the VRS, which tracks its dirty spans)
+//  * Devices: take 16-byte slots of a page (e.g. the VIAs in $3FD0-$3FFF), the rest of the page stays plain memory
+class MemoryBus {
+public:
+	typedef byte (*ReadHandler)(void* context, word address);
+	typedef void (*WriteHandler)(void* context, word address, byte value);
+
+private:
+	// 16-byte range claimed by a device
+	struct Slot {
+		void* context = NULL;
+		ReadHandler read = NULL;
+		WriteHandler write = NULL;
+	};
+
+	struct Page {
+		byte* read = NULL; // Direct pointer for reads (NULL: use the handlers)
+		byte* write = NULL; // Direct pointer for writes (NULL: use the handlers)
+		void* context = NULL;
+		ReadHandler readHandler = NULL;
+		WriteHandler writeHandler = NULL;
+		std::vector<Slot> slots; // Device slots (empty when no device is attached to the page)
+	};
+
+	byte* memory; // Backing memory (64kb)
+	Page pages[256];
+
+	byte readSlow(word address) {
+		Page& page = pages[address >> 8];
+		if (!page.slots.empty()) {
+			Slot& slot = page.slots[(address >> 4) & 0x0F];
+			if (slot.read != NULL) {
+				return slot.read(slot.context, address);
+			}
+		}
+		if (page.readHandler != NULL) {
+			return page.readHandler(page.context, address);
+		}
+		return memory[address];
+	}
+
+	void writeSlow(word address, byte value) {
+		Page& page = pages[address >> 8];
+		if (!page.slots.empty()) {
+			Slot& slot = page.slots[(address >> 4) & 0x0F];
+			if (slot.write != NULL) {
+				slot.write(slot.context, address, value);
+				return;
+			}
+		}
+		if (page.writeHandler != NULL) {
+			page.writeHandler(page.context, address, value);
+			return;
+		}
+		memory[address] = value;
+	}
+
+public:
+	unsigned int generation = 0; // Bumped whenever the mapping changes
+
+	MemoryBus(byte* memory) : memory(memory) {
+		mapMemory(0x00, 0xFF);
+	}
+
+	// Map pages straight to memory
+	void mapMemory(uchar firstPage, uchar lastPage) {
+		generation++;
+		for (unsigned int i = firstPage; i <= lastPage; i++) {
+			pages[i].read = pages[i].write = memory + (i << 8);
+			pages[i].context = NULL;
+			pages[i].readHandler = NULL;
+			pages[i].writeHandler = NULL;
+			pages[i].slots.clear();
+		}
+	}
+
+	// Route the accesses to pages through handlers (NULL handler: that direction stays direct)
+	void mapHandler(uchar firstPage, uchar lastPage, void* context, ReadHandler read, WriteHandler write) {
+		generation++;
+		for (unsigned int i = firstPage; i <= lastPage; i++) {
+			pages[i].context = context;
+			pages[i].readHandler = read;
+			pages[i].writeHandler = write;
+			pages[i].read = (read == NULL && pages[i].slots.empty()) ? memory + (i << 8) : NULL;
+			pages[i].write = (write == NULL && pages[i].slots.empty()) ? memory + (i << 8) : NULL;
+		}
+	}
+
+	// Attach a device to a range of addresses (16-byte granularity, within a single page)
+	void attachDevice(word first, word last, void* context, ReadHandler read, WriteHandler write) {
+		generation++;
+		Page& page = pages[first >> 8];
+		if (page.slots.empty()) {
+			page.slots.resize(16);
+		}
+		for (unsigned int i = (first >> 4) & 0x0F; i <= ((last >> 4) & 0x0F); i++) {
+			page.slots[i].context = context;
+			page.slots[i].read = read;
+			page.slots[i].write = write;
+		}
+		page.read = page.write = NULL;
+	}
+
+	// Check whether reads/writes of a whole page go straight to memory
+	bool isDirectRead(uchar page) const {
+		return pages[page].read != NULL;
+	}
+
+	bool isDirectWrite(uchar page) const {
+		return pages[page].write != NULL;
+	}
+
+	// Read a byte from the bus
+	byte read(word address) {
+		const byte* direct = pages[address >> 8].read;
+		if (direct != NULL) {
+			return direct[address & 0xFF];
+		}
+		return readSlow(address);
+	}
+
+	// Write a byte to the bus
+	void write(word address, byte value) {
+		byte* direct = pages[address >> 8].write;
+		if (direct != NULL) {
+			direct[address & 0xFF] = value;
+			return;
+		}
+		writeSlow(address, value);
+	}
+};
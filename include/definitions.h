@@ -1,9 +1,7 @@
 // For Registers, Memory and other stuff
 #define byte unsigned char
 #define word unsigned short
+#define dword unsigned int
 // For Internal Variables
 #define uchar unsigned char 
 #define ushort unsigned short
-
-// Memory
-byte Memory[0x10000];
\ No newline at end of file
@@ -0,0 +1,506 @@
+// Disk Image Formats -- raw (the storage byte for byte, mapped by the SSD) and sparse (a header, a cluster table and
+// only the clusters written so far, optionally compressed). EVM -convert-image turns one into the other.
+
+// LZ4 block format (no frame) -- a sequence is a token (literals and match length), the literals, a 2 byte offset
+// back into the output and the rest of the match length. The last sequence is only literals.
+class LZ4 {
+	static const unsigned int MIN_MATCH = 4;
+	static const unsigned int LAST_LITERALS = 5; // <- The last bytes are always literals,
+	static const unsigned int MATCH_LIMIT = 12; // <- and a match can't start in the last 12 (what other decoders expect)
+	static const unsigned int HASH_BITS = 12;
+
+	static unsigned int read32(const byte* data) {
+		unsigned int value;
+		memcpy(&value, data, 4);
+		return value;
+	}
+
+	// Length past the 4 bits of the token: 255 per byte, the last byte is below 255
+	static bool putLength(byte* dst, unsigned int capacity, unsigned int& out, unsigned int length) {
+		for (; length >= 255; length -= 255) {
+			if (out >= capacity) {
+				return false;
+			}
+			dst[out++] = 255;
+		}
+		if (out >= capacity) {
+			return false;
+		}
+		dst[out++] = length;
+		return true;
+	}
+
+	static bool getLength(const byte* src, unsigned int size, unsigned int& in, unsigned int& length) {
+		byte next;
+		do {
+			if (in >= size) {
+				return false;
+			}
+			next = src[in++];
+			length += next;
+		} while (next == 255);
+		return true;
+	}
+
+	// A sequence: literals from src (literals bytes), then a match (length 0: none, the last sequence)
+	static bool putSequence(byte* dst, unsigned int capacity, unsigned int& out, const byte* literal, unsigned int literals, unsigned int offset, unsigned int length) {
+		if (out >= capacity) {
+			return false;
+		}
+		unsigned int token = out++;
+		dst[token] = (literals < 15 ? literals : 15) << 4;
+		if (literals >= 15 && !putLength(dst, capacity, out, literals - 15)) {
+			return false;
+		}
+		if (literals > capacity - out) {
+			return false;
+		}
+		memcpy(dst + out, literal, literals);
+		out += literals;
+		if (length == 0) {
+			return true;
+		}
+		if (capacity - out < 2) {
+			return false;
+		}
+		dst[out++] = offset & 0xFF;
+		dst[out++] = offset >> 8;
+		length -= MIN_MATCH;
+		dst[token] |= length < 15 ? length : 15;
+		return length < 15 || putLength(dst, capacity, out, length - 15);
+	}
+
+public:
+	// Compress size bytes into dst (0: it doesn't fit in capacity, keep the data as it is)
+	static unsigned int compress(const byte* src, unsigned int size, byte* dst, unsigned int capacity) {
+		std::vector<unsigned int> table(1 << HASH_BITS, 0); // <- Last position of every hashed 4 bytes
+		unsigned int out = 0;
+		unsigned int anchor = 0; // First literal not emitted yet
+		unsigned int i = 1;
+		while (size > MATCH_LIMIT && i < size - MATCH_LIMIT) {
+			unsigned int sequence = read32(src + i);
+			unsigned int hash = (sequence * 2654435761u) >> (32 - HASH_BITS);
+			unsigned int candidate = table[hash];
+			table[hash] = i;
+			if (i - candidate > 0xFFFF || read32(src + candidate) != sequence) {
+				i++;
+				continue;
+			}
+			unsigned int length = MIN_MATCH;
+			while (i + length < size - LAST_LITERALS && src[candidate + length] == src[i + length]) {
+				length++;
+			}
+			if (!putSequence(dst, capacity, out, src + anchor, i - anchor, i - candidate, length)) {
+				return 0;
+			}
+			i += length;
+			anchor = i;
+		}
+		if (!putSequence(dst, capacity, out, src + anchor, size - anchor, 0, 0)) {
+			return 0;
+		}
+		return out;
+	}
+
+	// Decompress a block that must fill dst exactly (false: the block is corrupt)
+	static bool decompress(const byte* src, unsigned int size, byte* dst, unsigned int dstSize) {
+		unsigned int in = 0;
+		unsigned int out = 0;
+		while (in < size) {
+			byte token = src[in++];
+			unsigned int literals = token >> 4;
+			if (literals == 15 && !getLength(src, size, in, literals)) {
+				return false;
+			}
+			if (literals > size - in || literals > dstSize - out) {
+				return false;
+			}
+			memcpy(dst + out, src + in, literals);
+			in += literals;
+			out += literals;
+			if (in == size) {
+				break; // <- The last sequence
+			}
+			if (size - in < 2) {
+				return false;
+			}
+			unsigned int offset = src[in] | (src[in + 1] << 8);
+			in += 2;
+			unsigned int length = (token & 15);
+			if (length == 15 && !getLength(src, size, in, length)) {
+				return false;
+			}
+			length += MIN_MATCH;
+			if (offset == 0 || offset > out || length > dstSize - out) {
+				return false;
+			}
+			if (offset >= length) {
+				memcpy(dst + out, dst + out - offset, length);
+				out += length;
+				continue;
+			}
+			for (unsigned int i = 0; i < length; i++, out++) { // <- Byte by byte: the match overlaps what it writes
+				dst[out] = dst[out - offset];
+			}
+		}
+		return out == dstSize;
+	}
+};
+
+// Sparse Image -- clusters that were never written take no space in the file (they read as zeros)
+// Header (64 bytes, little-endian): "EVMDISK\0", version (4), cluster size (4), capacity (8), clusters (4), flags (4)
+// Cluster table (right after the header): per cluster, its offset in the file (8 bytes, 0: not written), its size in
+// the file (4, below the cluster size: LZ4 compressed) and the room it has there (4)
+// A cluster is never rewritten where the table in the file points: it goes to a free region and sync() writes the
+// entries once the data is on the disk, so a crash leaves every entry on its old or its new, whole, cluster.
+class SparseImage {
+	FILE* file = NULL;
+	struct Cluster {
+		unsigned long long offset;
+		unsigned int size;
+		unsigned int room;
+		unsigned long long saved; // <- Where the entry in the file points (its region can't be written)
+		unsigned int savedRoom;
+		bool dirty; // <- The entry in the file is older than this one (sync() writes it)
+	};
+	struct Region {
+		unsigned long long offset;
+		unsigned int size;
+	};
+	std::vector<Cluster> table;
+	std::vector<Region> freeRegions; // Regions no entry points to (older versions of clusters, gaps found by open())
+	unsigned long long end = 0; // Where the next cluster that doesn't fit in a free region goes
+	std::vector<byte> packed; // Compression output
+
+	static void put32(byte* data, unsigned int value) {
+		for (int i = 0; i < 4; i++) {
+			data[i] = (value >> (i * 8)) & 0xFF;
+		}
+	}
+
+	static void put64(byte* data, unsigned long long value) {
+		put32(data, value & 0xFFFFFFFF);
+		put32(data + 4, value >> 32);
+	}
+
+	static unsigned int get32(const byte* data) {
+		return data[0] | (data[1] << 8) | (data[2] << 16) | ((unsigned int)data[3] << 24);
+	}
+
+	static unsigned long long get64(const byte* data) {
+		return get32(data) | ((unsigned long long)get32(data + 4) << 32);
+	}
+
+	static void header(byte* data, unsigned long long capacity, unsigned int clusterSize, unsigned int flags) {
+		memset(data, 0, HEADER_SIZE);
+		memcpy(data, MAGIC, 8);
+		put32(data + 8, VERSION);
+		put32(data + 12, clusterSize);
+		put64(data + 16, capacity);
+		put32(data + 24, (unsigned int)(capacity / clusterSize));
+		put32(data + 28, flags);
+	}
+
+	// Entries written since the last sync
+	bool dirty() const {
+		for (const Cluster& entry : table) {
+			if (entry.dirty) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// Take room for size bytes from the free regions (first fit, the rest stays free), 0 if none is large enough
+	unsigned long long takeRegion(unsigned int size) {
+		for (unsigned int i = 0; i < freeRegions.size(); i++) {
+			Region& region = freeRegions[i];
+			if (region.size < size) {
+				continue;
+			}
+			unsigned long long offset = region.offset;
+			region.offset += size;
+			region.size -= size;
+			if (region.size == 0) {
+				freeRegions[i] = freeRegions.back();
+				freeRegions.pop_back();
+			}
+			return offset;
+		}
+		return 0;
+	}
+
+	void freeRegion(unsigned long long offset, unsigned int size) {
+		if (offset != 0 && size != 0) {
+			freeRegions.push_back({ offset, size });
+		}
+	}
+
+	bool writeEntry(unsigned int cluster) {
+		byte entry[ENTRY_SIZE];
+		put64(entry, table[cluster].offset);
+		put32(entry + 8, table[cluster].size);
+		put32(entry + 12, table[cluster].room);
+		return seek(file, HEADER_SIZE + (unsigned long long)cluster * ENTRY_SIZE) && fwrite(entry, ENTRY_SIZE, 1, file) == 1;
+	}
+
+public:
+	static constexpr const char* MAGIC = "EVMDISK";
+	static const unsigned int VERSION = 1;
+	static const unsigned int HEADER_SIZE = 64;
+	static const unsigned int ENTRY_SIZE = 16;
+	static const unsigned int CLUSTER_SIZE = 0x10000; // Default cluster (64kb)
+	enum {
+		FLAG_COMPRESS = 1, // Compress the clusters written (LZ4), the ones that don't shrink are kept as they are
+		FLAG_OVERLAY = 2 // The writes over a base image (-storage-overlay): its clusters not written come from the base
+	};
+
+	unsigned long long capacity = 0;
+	unsigned int clusterSize = 0;
+	unsigned int flags = 0;
+
+	~SparseImage() {
+		close();
+	}
+
+	static bool seek(FILE* stream, unsigned long long offset) {
+#ifdef _WIN32
+		return _fseeki64(stream, offset, SEEK_SET) == 0;
+#else
+		return fseeko(stream, offset, SEEK_SET) == 0;
+#endif
+	}
+
+	// Push the writes to a file to the disk
+	static bool syncFile(FILE* stream) {
+		if (fflush(stream) != 0) {
+			return false;
+		}
+#ifdef _WIN32
+		return _commit(_fileno(stream)) == 0;
+#else
+		return fsync(fileno(stream)) == 0;
+#endif
+	}
+
+	// Does the file start with the sparse image magic?
+	static bool detect(const char* path) {
+		char magic[8] = {};
+		FILE* stream = fopen(path, "rb");
+		if (stream == NULL) {
+			return false;
+		}
+		bool sparse = fread(magic, 1, 8, stream) == 8 && memcmp(magic, MAGIC, 8) == 0;
+		fclose(stream);
+		return sparse;
+	}
+
+	// Write an empty image (a header and a table of clusters not written yet)
+	static bool create(const char* path, unsigned long long capacity, unsigned int flags, unsigned int clusterSize = CLUSTER_SIZE) {
+		FILE* stream = fopen(path, "wb");
+		if (stream == NULL) {
+			return false;
+		}
+		byte data[HEADER_SIZE];
+		header(data, capacity, clusterSize, flags);
+		std::vector<byte> entries((size_t)(capacity / clusterSize) * ENTRY_SIZE, 0);
+		bool ok = fwrite(data, HEADER_SIZE, 1, stream) == 1 && fwrite(entries.data(), 1, entries.size(), stream) == entries.size();
+		return fclose(stream) == 0 && ok;
+	}
+
+	// Read the header and the cluster table (nothing else is read until a cluster is asked for)
+	bool open(const char* path, bool writable = true) {
+		close();
+		file = fopen(path, writable ? "r+b" : "rb");
+		byte data[HEADER_SIZE];
+		if (file == NULL || fread(data, HEADER_SIZE, 1, file) != 1 || memcmp(data, MAGIC, 8) != 0 || get32(data + 8) != VERSION) {
+			close();
+			return false;
+		}
+		clusterSize = get32(data + 12);
+		capacity = get64(data + 16);
+		flags = get32(data + 28);
+		unsigned int clusters = get32(data + 24);
+		if (clusterSize < 0x1000 || (clusterSize & (clusterSize - 1)) != 0 || capacity != (unsigned long long)clusters * clusterSize) {
+			close();
+			return false;
+		}
+		std::vector<byte> entries((size_t)clusters * ENTRY_SIZE);
+		if (fread(entries.data(), 1, entries.size(), file) != entries.size()) {
+			close();
+			return false;
+		}
+		table.resize(clusters);
+		end = HEADER_SIZE + entries.size();
+		for (unsigned int i = 0; i < clusters; i++) {
+			table[i].offset = get64(&entries[i * ENTRY_SIZE]);
+			table[i].size = get32(&entries[i * ENTRY_SIZE + 8]);
+			table[i].room = get32(&entries[i * ENTRY_SIZE + 12]);
+			if (table[i].offset != 0 && (table[i].size == 0 || table[i].size > clusterSize || table[i].room < table[i].size)) {
+				close();
+				return false;
+			}
+			table[i].saved = table[i].offset;
+			table[i].savedRoom = table[i].room;
+			end = std::max(end, table[i].offset + table[i].room);
+		}
+		std::vector<Region> used; // <- The gaps between the clusters are free (left by rewrites before the last close)
+		for (const Cluster& cluster : table) {
+			if (cluster.offset != 0) {
+				used.push_back({ cluster.offset, cluster.room });
+			}
+		}
+		std::sort(used.begin(), used.end(), [](const Region& a, const Region& b) { return a.offset < b.offset; });
+		unsigned long long gap = HEADER_SIZE + entries.size();
+		freeRegions.clear();
+		for (const Region& region : used) {
+			if (region.offset < gap) {
+				close(); // <- Clusters overlapping each other or the table
+				return false;
+			}
+			freeRegion(gap, (unsigned int)std::min<unsigned long long>(region.offset - gap, 0xFFFFFFFFu));
+			gap = region.offset + region.size;
+		}
+		packed.resize(clusterSize);
+		return true;
+	}
+
+	// Close the file (the entries not synced yet are written first)
+	void close() {
+		if (file != NULL) {
+			if (dirty()) {
+				sync();
+			}
+			fclose(file);
+		}
+		file = NULL;
+		table.clear();
+		freeRegions.clear();
+	}
+
+	unsigned int clusters() const {
+		return (unsigned int)table.size();
+	}
+
+	bool present(unsigned int cluster) const {
+		return table[cluster].offset != 0;
+	}
+
+	unsigned int presentClusters() const {
+		unsigned int count = 0;
+		for (const Cluster& cluster : table) {
+			count += cluster.offset != 0;
+		}
+		return count;
+	}
+
+	// Bytes the clusters take in the file
+	unsigned long long storedBytes() const {
+		unsigned long long bytes = 0;
+		for (const Cluster& cluster : table) {
+			bytes += cluster.size;
+		}
+		return bytes;
+	}
+
+	// Read a cluster into data (clusterSize bytes, zeros when it was never written)
+	bool readCluster(unsigned int cluster, byte* data) {
+		const Cluster& entry = table[cluster];
+		if (entry.offset == 0) {
+			memset(data, 0, clusterSize);
+			return true;
+		}
+		if (entry.size == clusterSize) {
+			return seek(file, entry.offset) && fread(data, 1, clusterSize, file) == clusterSize;
+		}
+		return seek(file, entry.offset) && fread(packed.data(), 1, entry.size, file) == entry.size &&
+			LZ4::decompress(packed.data(), entry.size, data, clusterSize);
+	}
+
+	// Write a cluster (clusterSize bytes from data) -- a cluster of zeros is dropped from the file (an overlay keeps it,
+	// it hides the base's cluster). Only the data is written here, the entry waits for sync().
+	// The regions older versions leave are reused, -convert-image compacts the file.
+	bool writeCluster(unsigned int cluster, const byte* data) {
+		Cluster& entry = table[cluster];
+		bool zero = data[0] == 0 && memcmp(data, data + 1, clusterSize - 1) == 0;
+		unsigned long long target = 0;
+		unsigned int size = 0, room = 0;
+		if (!zero || (flags & FLAG_OVERLAY) != 0) {
+			const byte* stored = data;
+			size = clusterSize;
+			if ((flags & FLAG_COMPRESS) != 0) {
+				unsigned int compressed = LZ4::compress(data, clusterSize, packed.data(), clusterSize - 1);
+				if (compressed != 0) {
+					stored = packed.data();
+					size = compressed;
+				}
+			}
+			if (entry.offset != 0 && entry.offset != entry.saved && size <= entry.room) {
+				target = entry.offset; // <- Not in the file's table yet, it can be written over
+				room = entry.room;
+			}
+			else {
+				target = takeRegion(size);
+				room = size;
+			}
+			if (target == 0) {
+				target = end;
+			}
+			if (!seek(file, target) || fwrite(stored, 1, size, file) != size) {
+				if (target != end && target != entry.offset) {
+					freeRegion(target, room);
+				}
+				return false; // <- The table still points to what the file holds
+			}
+		}
+		else if (entry.offset == 0) {
+			return true;
+		}
+		if (target == end) {
+			end += size;
+		}
+		if (entry.offset != entry.saved && entry.offset != target) {
+			freeRegion(entry.offset, entry.room); // <- A version that never reached the table
+		}
+		entry.offset = target;
+		entry.size = size;
+		entry.room = room;
+		entry.dirty = true;
+		return true;
+	}
+
+	// Push the writes to the disk -- the clusters first, then the entries pointing to them
+	bool sync() {
+		if (!syncFile(file)) {
+			return false;
+		}
+		if (!dirty()) {
+			return true;
+		}
+		bool ok = true;
+		for (unsigned int i = 0; ok && i < table.size(); i++) {
+			ok = !table[i].dirty || writeEntry(i);
+		}
+		if (!ok || !syncFile(file)) {
+			for (Cluster& entry : table) {
+				if (entry.dirty) { // <- Still dirty, the next sync writes it again
+					entry.saved = entry.offset; // <- The file may point to either region now, neither is reused
+					entry.savedRoom = entry.room;
+				}
+			}
+			return false;
+		}
+		for (Cluster& entry : table) {
+			if (!entry.dirty) {
+				continue;
+			}
+			if (entry.saved != entry.offset) {
+				freeRegion(entry.saved, entry.savedRoom); // <- No entry points there anymore
+			}
+			entry.saved = entry.offset;
+			entry.savedRoom = entry.room;
+			entry.dirty = false;
+		}
+		return true;
+	}
+};
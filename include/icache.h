@@ -0,0 +1,134 @@
+// Decoded Instruction Cache -- one entry per address, filled the first time the CPU fetches an instruction there
+// An entry holds the opcode's handler and the two bytes after the opcode, so a hit doesn't touch the instruction stream.
+// Entries that start a fused idiom (see MOS65C02_IDIOMS) hold a handler that runs both instructions, plus the second one's operand.
+// Writes drop the entries of the page they hit (and the last three of the page before, whose bytes may run into it):
+//  * CPU stores: invalidate() on the CPU thread
+//  * DMA (SSD thread): invalidateRange() flags the pages, and the CPU drops them (sync()) before it can run code a transfer
+//    has loaded: at the start of a slice, on single-step fetches, when taking an interrupt and when reading VIA 2
+class MOS65C02;
+
+struct DecodedInstruction {
+	void (*handler)(MOS65C02& cpu) = NULL; // Instruction handler (NULL: not decoded)
+	word operand = 0; // Bytes after the opcode (little-endian)
+	byte opcode = 0;
+	byte next = 0; // Operand of the second instruction of a fused idiom
+	bool fused = false; // The handler runs a fused idiom
+};
+
+class DecodeCache {
+private:
+	DecodedInstruction entries[0x10000];
+	bool decodedPages[256]; // Pages holding bytes of a decoded instruction (CPU thread)
+	std::atomic<unsigned long long> stalePages[4]; // Pages written by other threads since the last sync -- 1 bit per page
+	std::atomic<bool> stale{ false };
+
+	void dropPage(uchar page) {
+		for (unsigned int i = page << 8; i < ((page + 1u) << 8); i++) {
+			entries[i].handler = NULL;
+		}
+		entries[(word)((page << 8) - 1)].handler = NULL;
+		entries[(word)((page << 8) - 2)].handler = NULL;
+		entries[(word)((page << 8) - 3)].handler = NULL; // <- Fused idioms span 4 bytes
+		decodedPages[page] = false;
+		versions[page]++;
+		invalidations++;
+	}
+
+public:
+	bool enabled = true; // Cleared by -no-icache
+	unsigned long long misses = 0; // Fetches that had to decode
+	unsigned long long invalidations = 0; // Pages dropped because of a write
+	unsigned int versions[256] = {}; // Bumped every time a page is dropped (the JIT checks them before running a block)
+
+	DecodeCache() {
+		clear();
+	}
+
+	// Drop every entry (reset, ROM load)
+	void clear() {
+		for (unsigned int i = 0; i < 0x10000; i++) {
+			entries[i].handler = NULL;
+		}
+		for (unsigned int i = 0; i < 256; i++) {
+			decodedPages[i] = false;
+			versions[i]++;
+		}
+		for (uchar i = 0; i < 4; i++) {
+			stalePages[i] = 0;
+		}
+		stale = false;
+	}
+
+	// Entry of an address
+	DecodedInstruction& lookup(word address) {
+		return entries[address];
+	}
+
+	// Decode an instruction into its entry
+	void fill(word address, byte opcode, word operand, void (*handler)(MOS65C02& cpu)) {
+		DecodedInstruction& entry = entries[address];
+		entry.opcode = opcode;
+		entry.operand = operand;
+		entry.handler = handler;
+		entry.fused = false;
+		decodedPages[address >> 8] = true;
+		decodedPages[(word)(address + 2) >> 8] = true;
+		misses++;
+	}
+
+	// Turn a filled entry into the start of a fused idiom (up to 4 bytes: opcode, operand, opcode, operand)
+	void fuse(word address, byte next, void (*handler)(MOS65C02& cpu)) {
+		DecodedInstruction& entry = entries[address];
+		entry.handler = handler;
+		entry.next = next;
+		entry.fused = true;
+		decodedPages[(word)(address + 3) >> 8] = true;
+	}
+
+	// Have writes to a page dropped even if no entry of it is filled (code translated by the JIT)
+	void watch(uchar page) {
+		decodedPages[page] = true;
+	}
+
+	// Pages whose writes are watched
+	const bool* watchedPages() const {
+		return decodedPages;
+	}
+
+	// CPU thread: a byte is about to be written
+	void invalidate(word address) {
+		if (decodedPages[address >> 8]) {
+			dropPage(address >> 8);
+		}
+	}
+
+	// Any thread: a block of memory was written (addresses wrap around at $FFFF)
+	void invalidateRange(unsigned int address, unsigned int length) {
+		if (length == 0) {
+			return;
+		}
+		for (unsigned int i = address >> 8; i <= ((address + length - 1) >> 8); i++) {
+			uchar page = i & 0xFF;
+			stalePages[page >> 6].fetch_or(1ULL << (page & 63), std::memory_order_relaxed);
+		}
+		stale.store(true, std::memory_order_release);
+	}
+
+	// CPU thread: check for pages written by other threads
+	bool pending() const {
+		return stale.load(std::memory_order_acquire);
+	}
+
+	// CPU thread: drop the pages written by other threads
+	void sync() {
+		stale = false; // <- Sequentially consistent: a page flagged after this is seen by the next pending()
+		for (uchar i = 0; i < 4; i++) {
+			unsigned long long pages = stalePages[i].exchange(0);
+			for (uchar bit = 0; bit < 64; bit++) {
+				if ((pages & (1ULL << bit)) != 0) {
+					invalidate((i * 64 + bit) << 8);
+				}
+			}
+		}
+	}
+};
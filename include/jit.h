@@ -0,0 +1,937 @@
+// Dynamic Recompiler (JIT) -- translates hot basic blocks of 65C02 code to x86-64, enabled with -jit
+// Only built for x86-64 hosts, other hosts always interpret.
+//  * Blocks: straight runs of instructions starting at an address the interpreter has run JIT_HOT_COUNT times, ending at
+//    a branch, JMP, JSR or RTS, before the first instruction the JIT doesn't translate, or before BreakPC
+//  * AC, X, Y, SR, SP and the cycle budget stay in host registers while native code runs
+//  * Blocks jump straight into the blocks they lead to (RTS looks its target up in the entry table)
+//  * Falls back to the interpreter for: accesses to pages the bus doesn't map straight to memory (VIAs, VRS), decimal mode,
+//    interrupts (checked on entry to every block) and the instructions that aren't translated (BIT, TSB/TRB, shifts of
+//    memory, SEI/CLI/SED, PLP, RTI, BRK, JMP (ind))
+//  * Self-modifying code: a block checks the versions of its pages (DecodeCache) on entry, and a store into a page holding
+//    decoded code leaves native code so the page gets dropped
+#if defined(__x86_64__) || defined(_M_X64)
+#define EVM_JIT 1
+#else
+#define EVM_JIT 0
+#endif
+
+#if EVM_JIT
+// x86-64 Emitter -- the few instructions the JIT needs (memory operands always use a 32-bit displacement)
+class X64Emitter {
+public:
+	enum { RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8, R9, R10, R11, R12, R13, R14, R15, NONE = -1 };
+	enum { CC_B = 0x2, CC_AE = 0x3, CC_E = 0x4, CC_NE = 0x5, CC_A = 0x7, CC_S = 0x8 }; // Condition codes
+	enum { ALU_ADD = 0, ALU_OR = 1, ALU_AND = 4, ALU_SUB = 5, ALU_XOR = 6, ALU_CMP = 7 }; // Group 1 (/digit)
+
+	byte* code = NULL;
+	size_t size = 0;
+
+private:
+	void rex(bool wide, int reg, int index, int base) {
+		byte prefix = 0x40 | (wide ? 8 : 0) | ((reg & 8) ? 4 : 0) | ((index != NONE && (index & 8)) ? 2 : 0) | ((base & 8) ? 1 : 0);
+		if (prefix != 0x40) {
+			emit(prefix);
+		}
+	}
+
+	// Register operand
+	void modrm(int reg, int rm) {
+		emit(0xC0 | ((reg & 7) << 3) | (rm & 7));
+	}
+
+	// Memory operand [base + index * 2^scale + disp32]
+	void modrm(int reg, int base, int index, int disp, uchar scale = 0) {
+		if (index == NONE && (base & 7) != RSP) {
+			emit(0x80 | ((reg & 7) << 3) | (base & 7));
+		}
+		else {
+			emit(0x84 | ((reg & 7) << 3));
+			emit((scale << 6) | (((index == NONE ? RSP : index) & 7) << 3) | (base & 7));
+		}
+		emit32(disp);
+	}
+
+public:
+	void emit(byte value) {
+		code[size++] = value;
+	}
+
+	void emit32(unsigned int value) {
+		for (uchar i = 0; i < 4; i++) {
+			emit((value >> (i * 8)) & 0xFF);
+		}
+	}
+
+	// Point the rel32 at an offset to another offset
+	void patch(size_t at, size_t target) {
+		unsigned int rel = (unsigned int)(target - (at + 4));
+		for (uchar i = 0; i < 4; i++) {
+			code[at + i] = (rel >> (i * 8)) & 0xFF;
+		}
+	}
+
+	// --- Registers (32-bit, setcc/movzx8 take AL, CL, DL or BL) ---
+	void mov(int dst, int src) { rex(false, src, NONE, dst); emit(0x89); modrm(src, dst); }
+	void mov64(int dst, int src) { rex(true, src, NONE, dst); emit(0x89); modrm(src, dst); }
+	void movImm(int dst, unsigned int imm) { rex(false, 0, NONE, dst); emit(0xB8 | (dst & 7)); emit32(imm); }
+	void alu(int group, int dst, int src) { rex(false, src, NONE, dst); emit((group << 3) | 1); modrm(src, dst); }
+	void aluImm(int group, int dst, unsigned int imm) { rex(false, 0, NONE, dst); emit(0x81); modrm(group, dst); emit32(imm); }
+	void test(int dst, int src) { rex(false, src, NONE, dst); emit(0x85); modrm(src, dst); }
+	void test64(int dst, int src) { rex(true, src, NONE, dst); emit(0x85); modrm(src, dst); }
+	void testImm(int dst, unsigned int imm) { rex(false, 0, NONE, dst); emit(0xF7); modrm(0, dst); emit32(imm); }
+	void shl(int dst, uchar count) { rex(false, 0, NONE, dst); emit(0xC1); modrm(4, dst); emit(count); }
+	void shr(int dst, uchar count) { rex(false, 0, NONE, dst); emit(0xC1); modrm(5, dst); emit(count); }
+	void setcc(uchar cc, int dst) { emit(0x0F); emit(0x90 | cc); modrm(0, dst); }
+	void movzx8(int dst, int src) { rex(false, dst, NONE, src); emit(0x0F); emit(0xB6); modrm(dst, src); }
+
+	// --- Memory ---
+	void load8(int dst, int base, int index, int disp) { rex(false, dst, index, base); emit(0x0F); emit(0xB6); modrm(dst, base, index, disp); }
+	void store8(int base, int index, int disp, int src) { rex(false, src, index, base); emit(0x88); modrm(src, base, index, disp); }
+	void store8Imm(int base, int index, int disp, byte imm) { rex(false, 0, index, base); emit(0xC6); modrm(0, base, index, disp); emit(imm); }
+	void cmp8Imm(int base, int index, int disp, byte imm) { rex(false, 0, index, base); emit(0x80); modrm(7, base, index, disp); emit(imm); }
+	void store16(int base, int disp, int src) { emit(0x66); rex(false, src, NONE, base); emit(0x89); modrm(src, base, NONE, disp); }
+	void store16Imm(int base, int disp, word imm) { emit(0x66); rex(false, 0, NONE, base); emit(0xC7); modrm(0, base, NONE, disp); emit(imm & 0xFF); emit(imm >> 8); }
+	void load32(int dst, int base, int disp) { rex(false, dst, NONE, base); emit(0x8B); modrm(dst, base, NONE, disp); }
+	void store32(int base, int disp, int src) { rex(false, src, NONE, base); emit(0x89); modrm(src, base, NONE, disp); }
+	void store32Imm(int base, int disp, unsigned int imm) { rex(false, 0, NONE, base); emit(0xC7); modrm(0, base, NONE, disp); emit32(imm); }
+	void cmp32Imm(int base, int disp, unsigned int imm) { rex(false, 0, NONE, base); emit(0x81); modrm(7, base, NONE, disp); emit32(imm); }
+	void load64(int dst, int base, int index, int disp, uchar scale = 0) { rex(true, dst, index, base); emit(0x8B); modrm(dst, base, index, disp, scale); }
+	void add64Imm(int base, int disp, unsigned int imm) { rex(true, 0, NONE, base); emit(0x81); modrm(0, base, NONE, disp); emit32(imm); }
+
+	// --- Control (jumps return the offset of their rel32) ---
+	size_t jcc(uchar cc) { emit(0x0F); emit(0x80 | cc); size_t at = size; emit32(0); return at; }
+	size_t jmp() { emit(0xE9); size_t at = size; emit32(0); return at; }
+	void jmpReg(int target) { rex(false, 0, NONE, target); emit(0xFF); modrm(4, target); }
+	void jmpMem(int base, int disp) { rex(false, 0, NONE, base); emit(0xFF); modrm(4, base, NONE, disp); }
+	void push(int reg) { rex(false, 0, NONE, reg); emit(0x50 | (reg & 7)); }
+	void pop(int reg) { rex(false, 0, NONE, reg); emit(0x58 | (reg & 7)); }
+	void ret() { emit(0xC3); }
+};
+
+// State shared by the dispatcher and native code (which addresses it through R12)
+struct JITState {
+	byte* memory;
+	void* const* entries; // Native code of the block at each address (NULL: none)
+	const bool* watched; // Pages holding decoded code (DecodeCache)
+	const unsigned int* versions; // Page versions (DecodeCache)
+	const std::atomic<unsigned int>* lines; // CPU lines (Board)
+	void* target; // Block to enter
+	unsigned long long instructions; // Instructions retired by native code
+	int cycles;
+	int invalidate; // Address of a store into a page holding decoded code (-1: none)
+	word pc;
+	byte ac, x, y, sr, sp;
+	byte readable[256]; // Pages read straight from memory
+	byte writable[256]; // Pages written straight to memory
+};
+
+#define JIT_FIELD(field) ((int)offsetof(JITState, field))
+
+class JIT {
+private:
+	typedef X64Emitter E;
+	typedef void (*EntryFunction)(JITState* state);
+
+	static const size_t CODE_SIZE = 16 * 1024 * 1024; // Code buffer (flushed when full)
+	static const size_t BLOCK_RESERVE = 64 * 1024; // Free space needed to translate a block
+	static const int JIT_HOT_COUNT = 32; // Runs of an address by the interpreter before it gets translated
+	static const int MAX_BLOCK = 64; // Instructions per block
+
+	// Guest registers in host registers (RAX, RCX, RDX, R8 and R9 are scratch)
+	static const int MEM = E::RBX, STATE = E::R12, AC = E::R13, XR = E::R14, YR = E::R15, SR = E::RSI, SP = E::RDI, CYC = E::RBP;
+
+	struct OpcodeInfo {
+		uchar op, mode, len, cycles;
+	};
+	static const OpcodeInfo Opcodes[256];
+
+	// Pages (and their versions) a block was translated from
+	struct BlockInfo {
+		uchar firstPage = 0, lastPage = 0;
+		unsigned int firstVersion = 0, lastVersion = 0;
+	};
+
+	// Way out of a block: leave native code with PC at an address, adding the instructions retired so far
+	struct Exit {
+		size_t site; // rel32 to point at the exit
+		int pc; // -1: already stored
+		uchar count;
+		int invalidate; // -1: none, -2: the address in R8, otherwise the address
+	};
+
+	// Effective address of an access: fixed (known while translating) or computed into R8D
+	struct Access {
+		bool fixed;
+		word address;
+		int penaltyPage; // Page crossing costs a cycle when the address isn't in this page (-1: never)
+	};
+
+	MOS65C02& cpu;
+	byte* const Memory;
+	MemoryBus& bus;
+	DecodeCache& icache;
+
+	JITState state;
+	E out;
+	EntryFunction entry = NULL;
+	size_t exitCode = 0; // Common exit (stores the registers and returns)
+	size_t codeStart = 0; // First byte available to blocks
+	void* entries[0x10000];
+	BlockInfo info[0x10000];
+	unsigned short counts[0x10000];
+	std::unordered_map<word, std::vector<size_t> > chains; // Jumps to the block at an address
+	std::vector<Exit> exits; // Exits of the block being translated
+	int breakPC = -1; // BreakPC the blocks were translated for
+	unsigned int busGeneration = ~0u; // Bus mapping readable/writable were built from
+
+	// --- Translation ---
+	// Set N and Z from a register
+	void setNZ(int reg) {
+		out.aluImm(E::ALU_AND, SR, 0x7D);
+		out.mov(E::RAX, reg);
+		out.aluImm(E::ALU_AND, E::RAX, 0x80);
+		out.alu(E::ALU_OR, SR, E::RAX);
+		out.alu(E::ALU_XOR, E::RCX, E::RCX);
+		out.test(reg, reg);
+		out.setcc(E::CC_E, E::RCX);
+		out.alu(E::ALU_ADD, E::RCX, E::RCX);
+		out.alu(E::ALU_OR, SR, E::RCX);
+	}
+
+	// Compare a register with EDX: C = reg >= value, Z = reg == value, N = reg < value
+	void compare(int reg) {
+		out.aluImm(E::ALU_AND, SR, 0x7C);
+		out.alu(E::ALU_CMP, reg, E::RDX);
+		out.setcc(E::CC_AE, E::RAX);
+		out.setcc(E::CC_E, E::RCX);
+		out.setcc(E::CC_B, E::RDX);
+		out.movzx8(E::RAX, E::RAX);
+		out.alu(E::ALU_OR, SR, E::RAX);
+		out.movzx8(E::RCX, E::RCX);
+		out.alu(E::ALU_ADD, E::RCX, E::RCX);
+		out.alu(E::ALU_OR, SR, E::RCX);
+		out.movzx8(E::RDX, E::RDX);
+		out.shl(E::RDX, 7);
+		out.alu(E::ALU_OR, SR, E::RDX);
+	}
+
+	void exitTo(size_t site, int pc, uchar count, int invalidate = -1) {
+		Exit e = { site, pc, count, invalidate };
+		exits.push_back(e);
+	}
+
+	// Jump to the block at an address (straight into it once it's translated)
+	void chain(word target) {
+		size_t site = out.jmp();
+		chains[target].push_back(site);
+		if (entries[target] != NULL) {
+			out.patch(site, (byte*)entries[target] - out.code);
+		}
+		else {
+			exitTo(site, target, 0); // <- Instructions already added
+		}
+	}
+
+	Access address(uchar mode, word pc, word operand) {
+		Access a = { true, 0, -1 };
+		switch (mode) {
+			case AM_ZPG:
+				a.address = operand & 0xFF;
+				break;
+			case AM_ABS:
+				a.address = operand;
+				break;
+			case AM_ZPG_X: case AM_ZPG_Y:
+				a.fixed = false;
+				out.mov(E::R8, mode == AM_ZPG_X ? XR : YR);
+				out.aluImm(E::ALU_ADD, E::R8, operand & 0xFF);
+				out.aluImm(E::ALU_AND, E::R8, 0xFF);
+				break;
+			case AM_ABS_X: case AM_ABS_X_NP: case AM_ABS_Y: case AM_ABS_Y_NP:
+				a.fixed = false;
+				out.mov(E::R8, (mode == AM_ABS_X || mode == AM_ABS_X_NP) ? XR : YR);
+				out.aluImm(E::ALU_ADD, E::R8, operand);
+				out.aluImm(E::ALU_AND, E::R8, 0xFFFF);
+				if (mode == AM_ABS_X || mode == AM_ABS_Y) {
+					a.penaltyPage = ((pc + 2) >> 8) & 0xFF; // <- Page of the operand's last byte
+				}
+				break;
+			case AM_IND_Y: case AM_IND_Y_NP: case AM_ZPG_IND:
+				a.fixed = false;
+				out.load8(E::R8, MEM, E::NONE, operand & 0xFF);
+				out.load8(E::RAX, MEM, E::NONE, (operand & 0xFF) + 1);
+				out.shl(E::RAX, 8);
+				out.alu(E::ALU_OR, E::R8, E::RAX);
+				if (mode != AM_ZPG_IND) {
+					out.alu(E::ALU_ADD, E::R8, YR);
+					out.aluImm(E::ALU_AND, E::R8, 0xFFFF);
+				}
+				if (mode == AM_IND_Y) {
+					a.penaltyPage = ((pc + 1) >> 8) & 0xFF; // <- Page of the operand
+				}
+				break;
+			case AM_X_IND:
+				a.fixed = false;
+				out.mov(E::RAX, XR);
+				out.aluImm(E::ALU_ADD, E::RAX, operand & 0xFF);
+				out.aluImm(E::ALU_AND, E::RAX, 0xFF);
+				out.load8(E::R8, MEM, E::RAX, 0);
+				out.aluImm(E::ALU_ADD, E::RAX, 1);
+				out.aluImm(E::ALU_AND, E::RAX, 0xFF);
+				out.load8(E::RAX, MEM, E::RAX, 0);
+				out.shl(E::RAX, 8);
+				out.alu(E::ALU_OR, E::R8, E::RAX);
+				break;
+		}
+		return a;
+	}
+
+	// Leave before the instruction if a computed address isn't plain memory (fixed ones are checked while translating)
+	void checkPage(const Access& a, word pc, uchar count, bool write) {
+		if (a.fixed) {
+			return;
+		}
+		out.mov(E::RAX, E::R8);
+		out.shr(E::RAX, 8);
+		out.cmp8Imm(STATE, E::RAX, write ? JIT_FIELD(writable) : JIT_FIELD(readable), 0);
+		exitTo(out.jcc(E::CC_E), pc, count);
+	}
+
+	void load(const Access& a) {
+		if (a.fixed) {
+			out.load8(E::RDX, MEM, E::NONE, a.address);
+		}
+		else {
+			out.load8(E::RDX, MEM, E::R8, 0);
+		}
+	}
+
+	void store(const Access& a) {
+		if (a.fixed) {
+			out.store8(MEM, E::NONE, a.address, E::RDX);
+		}
+		else {
+			out.store8(MEM, E::R8, 0, E::RDX);
+		}
+	}
+
+	// Spend the cycles of an instruction (plus one if an indexed address left the expected page)
+	void charge(uchar cycles, const Access& a) {
+		out.aluImm(E::ALU_SUB, CYC, cycles);
+		if (a.penaltyPage >= 0) {
+			out.mov(E::RAX, E::R8);
+			out.shr(E::RAX, 8);
+			out.alu(E::ALU_XOR, E::RCX, E::RCX);
+			out.aluImm(E::ALU_CMP, E::RAX, a.penaltyPage);
+			out.setcc(E::CC_NE, E::RCX);
+			out.alu(E::ALU_SUB, CYC, E::RCX);
+		}
+	}
+
+	// Leave after the instruction if it wrote into a page holding decoded code
+	void checkWatched(const Access& a, int next, uchar count) {
+		out.load64(E::RAX, STATE, E::NONE, JIT_FIELD(watched));
+		if (a.fixed) {
+			out.cmp8Imm(E::RAX, E::NONE, a.address >> 8, 0);
+			exitTo(out.jcc(E::CC_NE), next, count, a.address);
+		}
+		else {
+			out.mov(E::RCX, E::R8);
+			out.shr(E::RCX, 8);
+			out.cmp8Imm(E::RAX, E::RCX, 0, 0);
+			exitTo(out.jcc(E::CC_NE), next, count, -2);
+		}
+	}
+
+	// Leave after the instruction if the cycle budget is spent
+	void checkBudget(word next, uchar count) {
+		out.test(CYC, CYC);
+		exitTo(out.jcc(E::CC_S), next, count);
+	}
+
+	// Push EDX / pull into a register (the slot left behind is cleared, like the interpreter does)
+	void pushEDX() {
+		out.aluImm(E::ALU_SUB, SP, 1);
+		out.aluImm(E::ALU_AND, SP, 0xFF);
+		out.store8(MEM, SP, 0x100, E::RDX);
+	}
+
+	void pull(int reg) {
+		out.load8(reg, MEM, SP, 0x100);
+		out.store8Imm(MEM, SP, 0x100, 0);
+		out.aluImm(E::ALU_ADD, SP, 1);
+		out.aluImm(E::ALU_AND, SP, 0xFF);
+	}
+
+	static int registerOf(uchar op) {
+		switch (op) {
+			case OP_LDX: case OP_CPX: case OP_STX: case OP_PHX: case OP_PLX: return XR;
+			case OP_LDY: case OP_CPY: case OP_STY: case OP_PHY: case OP_PLY: return YR;
+		}
+		return AC;
+	}
+
+	word operandAt(word pc) {
+		return (Memory[(word)(pc + 2)] << 8) | Memory[(word)(pc + 1)];
+	}
+
+	// Check whether an instruction can be translated (fixed addresses must be plain memory)
+	bool translatable(word pc) {
+		const OpcodeInfo& ins = Opcodes[Memory[pc]];
+		word operand = operandAt(pc);
+		bool reads = false, writes = false;
+		switch (ins.op) {
+			case OP_ORA: case OP_AND: case OP_EOR: case OP_ADC: case OP_SBC: case OP_LDA: case OP_LDX: case OP_LDY:
+			case OP_CMP: case OP_CPX: case OP_CPY:
+				reads = true;
+				break;
+			case OP_STA: case OP_STX: case OP_STY: case OP_STZ:
+				writes = true;
+				break;
+			case OP_INC: case OP_DEC:
+				reads = writes = true;
+				break;
+			case OP_JMP:
+				return ins.mode == AM_ABS;
+			case OP_ASL_A: case OP_LSR_A: case OP_ROL_A: case OP_ROR_A:
+			case OP_INX: case OP_INY: case OP_INA: case OP_DEX: case OP_DEY: case OP_DEA:
+			case OP_TAX: case OP_TAY: case OP_TXA: case OP_TYA: case OP_TSX: case OP_TXS:
+			case OP_PHA: case OP_PHP: case OP_PHX: case OP_PHY: case OP_PLA: case OP_PLX: case OP_PLY:
+			case OP_CLC: case OP_SEC: case OP_CLV: case OP_CLD: case OP_NOP:
+			case OP_BPL: case OP_BMI: case OP_BVC: case OP_BVS: case OP_BCC: case OP_BCS: case OP_BNE: case OP_BEQ: case OP_BRA:
+			case OP_JSR: case OP_RTS:
+				return true;
+			default:
+				return false;
+		}
+		word fixed;
+		switch (ins.mode) {
+			case AM_IMM:
+				if (ins.op == OP_CMP || ins.op == OP_CPX || ins.op == OP_CPY) {
+					return state.readable[(word)(pc + 1) >> 8] != 0; // <- Compares read their immediate through the bus
+				}
+				return true;
+			case AM_ZPG: fixed = operand & 0xFF; break;
+			case AM_ZPG_X: case AM_ZPG_Y: fixed = 0; break; // <- Always in page 0
+			case AM_ABS: fixed = operand; break;
+			default:
+				return true; // <- Computed addresses are checked when the instruction runs
+		}
+		return (!reads || state.readable[fixed >> 8]) && (!writes || state.writable[fixed >> 8]);
+	}
+
+	// Translate one instruction, returns false if it ends the block
+	bool translate(word pc, uchar count) {
+		const OpcodeInfo& ins = Opcodes[Memory[pc]];
+		word operand = operandAt(pc);
+		word next = pc + 1 + ins.len;
+		uchar done = count + 1;
+		int reg = registerOf(ins.op);
+		Access a = { true, 0, -1 };
+		Access stack = { true, 0x100, -1 };
+		bool stores = false;
+
+		switch (ins.op) {
+			// Read
+			case OP_ORA: case OP_AND: case OP_EOR: case OP_ADC: case OP_SBC: case OP_LDA: case OP_LDX: case OP_LDY:
+			case OP_CMP: case OP_CPX: case OP_CPY:
+				if (ins.mode == AM_IMM) {
+					out.movImm(E::RDX, operand & 0xFF);
+				}
+				else {
+					a = address(ins.mode, pc, operand);
+					checkPage(a, pc, count, false);
+					load(a);
+				}
+				switch (ins.op) {
+					case OP_ORA: out.alu(E::ALU_OR, AC, E::RDX); setNZ(AC); break;
+					case OP_AND: out.alu(E::ALU_AND, AC, E::RDX); setNZ(AC); break;
+					case OP_EOR: out.alu(E::ALU_XOR, AC, E::RDX); setNZ(AC); break;
+					case OP_LDA: case OP_LDX: case OP_LDY: out.mov(reg, E::RDX); setNZ(reg); break;
+					case OP_CMP: case OP_CPX: case OP_CPY: compare(reg); break;
+					case OP_ADC:
+						// V: sign of the result differs from AC's, C: carry out of bit 7
+						out.mov(E::RCX, SR);
+						out.aluImm(E::ALU_AND, E::RCX, 1);
+						out.alu(E::ALU_ADD, E::RCX, E::RDX);
+						out.alu(E::ALU_ADD, E::RCX, AC);
+						out.mov(E::RAX, AC);
+						out.alu(E::ALU_XOR, E::RAX, E::RCX);
+						out.aluImm(E::ALU_AND, E::RAX, 0x80);
+						out.shr(E::RAX, 1);
+						out.aluImm(E::ALU_AND, SR, 0xBE);
+						out.alu(E::ALU_OR, SR, E::RAX);
+						out.alu(E::ALU_XOR, E::RAX, E::RAX);
+						out.aluImm(E::ALU_CMP, E::RCX, 0xFF);
+						out.setcc(E::CC_A, E::RAX);
+						out.alu(E::ALU_OR, SR, E::RAX);
+						out.aluImm(E::ALU_AND, E::RCX, 0xFF);
+						out.mov(AC, E::RCX);
+						setNZ(AC);
+						break;
+					case OP_SBC:
+						// V: sign of the result differs from AC's, C: value + carry is greater than AC
+						out.mov(E::RCX, SR);
+						out.aluImm(E::ALU_AND, E::RCX, 1);
+						out.alu(E::ALU_ADD, E::RCX, E::RDX);
+						out.mov(E::RAX, AC);
+						out.alu(E::ALU_SUB, E::RAX, E::RCX);
+						out.aluImm(E::ALU_AND, E::RAX, 0xFF);
+						out.alu(E::ALU_XOR, E::RDX, E::RDX);
+						out.alu(E::ALU_CMP, E::RCX, AC);
+						out.setcc(E::CC_A, E::RDX);
+						out.mov(E::RCX, AC);
+						out.alu(E::ALU_XOR, E::RCX, E::RAX);
+						out.aluImm(E::ALU_AND, E::RCX, 0x80);
+						out.shr(E::RCX, 1);
+						out.aluImm(E::ALU_AND, SR, 0xBE);
+						out.alu(E::ALU_OR, SR, E::RCX);
+						out.alu(E::ALU_OR, SR, E::RDX);
+						out.mov(AC, E::RAX);
+						setNZ(AC);
+						break;
+				}
+				break;
+			// Write
+			case OP_STA: case OP_STX: case OP_STY: case OP_STZ:
+				a = address(ins.mode, pc, operand);
+				checkPage(a, pc, count, true);
+				if (ins.op == OP_STZ) {
+					out.alu(E::ALU_XOR, E::RDX, E::RDX);
+				}
+				else {
+					out.mov(E::RDX, reg);
+				}
+				store(a);
+				stores = true;
+				break;
+			// Read-Modify-Write
+			case OP_INC: case OP_DEC:
+				a = address(ins.mode, pc, operand);
+				checkPage(a, pc, count, false);
+				checkPage(a, pc, count, true);
+				load(a);
+				out.aluImm(ins.op == OP_INC ? E::ALU_ADD : E::ALU_SUB, E::RDX, 1);
+				out.aluImm(E::ALU_AND, E::RDX, 0xFF);
+				store(a);
+				setNZ(E::RDX);
+				stores = true;
+				break;
+			// Accumulator
+			case OP_ASL_A: case OP_ROL_A:
+				out.mov(E::RCX, SR);
+				out.aluImm(E::ALU_AND, E::RCX, 1);
+				out.mov(E::RAX, AC);
+				out.shr(E::RAX, 7);
+				out.aluImm(E::ALU_AND, SR, 0xFE);
+				out.alu(E::ALU_OR, SR, E::RAX);
+				out.shl(AC, 1);
+				if (ins.op == OP_ROL_A) {
+					out.alu(E::ALU_OR, AC, E::RCX);
+				}
+				out.aluImm(E::ALU_AND, AC, 0xFF);
+				setNZ(AC);
+				break;
+			case OP_LSR_A: case OP_ROR_A:
+				out.mov(E::RCX, SR);
+				out.aluImm(E::ALU_AND, E::RCX, 1);
+				out.shl(E::RCX, 7);
+				out.mov(E::RAX, AC);
+				out.aluImm(E::ALU_AND, E::RAX, 1);
+				out.aluImm(E::ALU_AND, SR, 0xFE);
+				out.alu(E::ALU_OR, SR, E::RAX);
+				out.shr(AC, 1);
+				if (ins.op == OP_ROR_A) {
+					out.alu(E::ALU_OR, AC, E::RCX);
+				}
+				setNZ(AC); // <- N is always clear after LSR
+				break;
+			// Registers
+			case OP_INX: case OP_INY: case OP_INA: case OP_DEX: case OP_DEY: case OP_DEA: {
+				int r = (ins.op == OP_INX || ins.op == OP_DEX) ? XR : (ins.op == OP_INY || ins.op == OP_DEY) ? YR : AC;
+				out.aluImm((ins.op == OP_INX || ins.op == OP_INY || ins.op == OP_INA) ? E::ALU_ADD : E::ALU_SUB, r, 1);
+				out.aluImm(E::ALU_AND, r, 0xFF);
+				setNZ(r);
+				break;
+			}
+			case OP_TAX: out.mov(XR, AC); setNZ(XR); break;
+			case OP_TAY: out.mov(YR, AC); setNZ(YR); break;
+			case OP_TXA: out.mov(AC, XR); setNZ(AC); break;
+			case OP_TYA: out.mov(AC, YR); setNZ(AC); break;
+			case OP_TSX: out.mov(XR, SP); setNZ(XR); break;
+			case OP_TXS: out.mov(SP, XR); break;
+			// Stack
+			case OP_PHA: case OP_PHX: case OP_PHY: case OP_PHP:
+				out.mov(E::RDX, ins.op == OP_PHP ? SR : reg);
+				if (ins.op == OP_PHP) {
+					out.aluImm(E::ALU_OR, E::RDX, 0x30);
+				}
+				pushEDX();
+				a = stack;
+				stores = true;
+				break;
+			case OP_PLA: case OP_PLX: case OP_PLY:
+				pull(reg);
+				a = stack;
+				stores = true;
+				break;
+			// Flags
+			case OP_CLC: out.aluImm(E::ALU_AND, SR, 0xFE); break;
+			case OP_SEC: out.aluImm(E::ALU_OR, SR, 0x01); break;
+			case OP_CLV: out.aluImm(E::ALU_AND, SR, 0xBF); break;
+			case OP_CLD: out.aluImm(E::ALU_AND, SR, 0xF7); break;
+			case OP_NOP: break;
+			// Branches -- both ways lead to other blocks
+			case OP_BPL: case OP_BMI: case OP_BVC: case OP_BVS: case OP_BCC: case OP_BCS: case OP_BNE: case OP_BEQ: case OP_BRA: {
+				word taken = pc + 2 + (signed char)(operand & 0xFF);
+				word notTaken = pc + 2;
+				uchar takenCycles = ins.cycles + (((taken >> 8) != (((pc + 1) >> 8) & 0xFF)) ? 2 : 1);
+				uchar notTakenCycles = ins.cycles + (((notTaken >> 8) != 0) ? 2 : 1); // <- The interpreter compares with page 0 here
+				if (ins.op != OP_BRA) {
+					uchar mask = (ins.op == OP_BPL || ins.op == OP_BMI) ? 0x80 : (ins.op == OP_BVC || ins.op == OP_BVS) ? 0x40 : (ins.op == OP_BCC || ins.op == OP_BCS) ? 0x01 : 0x02;
+					bool whenClear = ins.op == OP_BPL || ins.op == OP_BVC || ins.op == OP_BCC || ins.op == OP_BNE;
+					out.testImm(SR, mask);
+					size_t skip = out.jcc(whenClear ? E::CC_NE : E::CC_E);
+					out.aluImm(E::ALU_SUB, CYC, takenCycles);
+					out.add64Imm(STATE, JIT_FIELD(instructions), done);
+					chain(taken);
+					out.patch(skip, out.size);
+					out.aluImm(E::ALU_SUB, CYC, notTakenCycles);
+					out.add64Imm(STATE, JIT_FIELD(instructions), done);
+					chain(notTaken);
+				}
+				else {
+					out.aluImm(E::ALU_SUB, CYC, takenCycles);
+					out.add64Imm(STATE, JIT_FIELD(instructions), done);
+					chain(taken);
+				}
+				return false;
+			}
+			// Control
+			case OP_JMP:
+				out.aluImm(E::ALU_SUB, CYC, ins.cycles);
+				out.add64Imm(STATE, JIT_FIELD(instructions), done);
+				chain(operand);
+				return false;
+			case OP_JSR:
+				out.movImm(E::RDX, ((pc + 3) >> 8) & 0xFF);
+				pushEDX();
+				out.movImm(E::RDX, (pc + 3) & 0xFF);
+				pushEDX();
+				out.aluImm(E::ALU_SUB, CYC, ins.cycles);
+				checkWatched(stack, operand, done);
+				out.add64Imm(STATE, JIT_FIELD(instructions), done);
+				chain(operand);
+				return false;
+			case OP_RTS: {
+				pull(E::R9);
+				pull(E::RCX);
+				out.shl(E::RCX, 8);
+				out.alu(E::ALU_OR, E::R9, E::RCX);
+				out.store16(STATE, JIT_FIELD(pc), E::R9);
+				out.aluImm(E::ALU_SUB, CYC, ins.cycles);
+				checkWatched(stack, -1, done);
+				out.add64Imm(STATE, JIT_FIELD(instructions), done);
+				// Enter the block at the return address if there is one
+				out.load64(E::RAX, STATE, E::NONE, JIT_FIELD(entries));
+				out.load64(E::RAX, E::RAX, E::R9, 0, 3);
+				out.test64(E::RAX, E::RAX);
+				size_t none = out.jcc(E::CC_E);
+				out.jmpReg(E::RAX);
+				out.patch(none, out.size);
+				out.patch(out.jmp(), exitCode);
+				return false;
+			}
+		}
+		charge(ins.cycles, a);
+		if (stores) {
+			checkWatched(a, next, done);
+		}
+		checkBudget(next, done);
+		return true;
+	}
+
+	// Guard at the start of a block: leave if the budget is spent, a reset or an interrupt is pending or the code has changed
+	void guard(word start, const BlockInfo& block) {
+		out.test(CYC, CYC);
+		exitTo(out.jcc(E::CC_S), start, 0);
+		out.load64(E::RAX, STATE, E::NONE, JIT_FIELD(lines));
+		out.load32(E::RAX, E::RAX, 0); // <- A plain load is a relaxed one on x86-64
+		out.test(E::RAX, E::RAX);
+		size_t none = out.jcc(E::CC_E);
+		out.testImm(E::RAX, ~(unsigned int)LINE_IRQ);
+		exitTo(out.jcc(E::CC_NE), start, 0); // <- Reset or NMI
+		out.testImm(SR, 0x04);
+		exitTo(out.jcc(E::CC_E), start, 0); // <- IRQ, not masked
+		out.patch(none, out.size);
+		out.load64(E::RAX, STATE, E::NONE, JIT_FIELD(versions));
+		out.cmp32Imm(E::RAX, block.firstPage * 4, block.firstVersion);
+		exitTo(out.jcc(E::CC_NE), start, 0);
+		if (block.lastPage != block.firstPage) {
+			out.cmp32Imm(E::RAX, block.lastPage * 4, block.lastVersion);
+			exitTo(out.jcc(E::CC_NE), start, 0);
+		}
+	}
+
+	// Emit the exits collected while translating a block
+	void emitExits() {
+		for (unsigned int i = 0; i < exits.size(); i++) {
+			const Exit& e = exits[i];
+			out.patch(e.site, out.size);
+			if (e.invalidate == -2) {
+				out.store32(STATE, JIT_FIELD(invalidate), E::R8);
+			}
+			else if (e.invalidate >= 0) {
+				out.store32Imm(STATE, JIT_FIELD(invalidate), e.invalidate);
+			}
+			if (e.pc >= 0) {
+				out.store16Imm(STATE, JIT_FIELD(pc), e.pc);
+			}
+			if (e.count != 0) {
+				out.add64Imm(STATE, JIT_FIELD(instructions), e.count);
+			}
+			out.patch(out.jmp(), exitCode);
+		}
+		exits.clear();
+	}
+
+	// Entry (loads the guest registers and jumps to the target block) and common exit (stores them back)
+	void emitTrampoline() {
+		static const int saved[] = { E::RBX, E::RBP, E::RSI, E::RDI, E::R12, E::R13, E::R14, E::R15 };
+		static const int registers[] = { AC, XR, YR, SR, SP };
+		static const int fields[] = { JIT_FIELD(ac), JIT_FIELD(x), JIT_FIELD(y), JIT_FIELD(sr), JIT_FIELD(sp) };
+
+		entry = (EntryFunction)(out.code + out.size);
+		for (uchar i = 0; i < 8; i++) {
+			out.push(saved[i]);
+		}
+#ifdef _WIN32
+		out.mov64(STATE, E::RCX); // <- First argument (Microsoft x64)
+#else
+		out.mov64(STATE, E::RDI); // <- First argument (System V)
+#endif
+		out.load64(MEM, STATE, E::NONE, JIT_FIELD(memory));
+		for (uchar i = 0; i < 5; i++) {
+			out.load8(registers[i], STATE, E::NONE, fields[i]);
+		}
+		out.load32(CYC, STATE, JIT_FIELD(cycles));
+		out.jmpMem(STATE, JIT_FIELD(target));
+
+		exitCode = out.size;
+		for (uchar i = 0; i < 5; i++) {
+			out.mov(E::RAX, registers[i]);
+			out.store8(STATE, E::NONE, fields[i], E::RAX);
+		}
+		out.store32(STATE, JIT_FIELD(cycles), CYC);
+		for (int i = 7; i >= 0; i--) {
+			out.pop(saved[i]);
+		}
+		out.ret();
+		codeStart = out.size;
+	}
+
+	// Drop every block
+	void flush() {
+		out.size = codeStart;
+		for (unsigned int i = 0; i < 0x10000; i++) {
+			entries[i] = NULL;
+		}
+		chains.clear();
+		flushes++;
+	}
+
+	// Check whether the pages a block was translated from are unchanged
+	bool valid(word pc) const {
+		const BlockInfo& block = info[pc];
+		return icache.versions[block.firstPage] == block.firstVersion && icache.versions[block.lastPage] == block.lastVersion;
+	}
+
+	// Translate the block starting at an address
+	bool compile(word start) {
+		if (!translatable(start)) {
+			return false;
+		}
+		if (CODE_SIZE - out.size < BLOCK_RESERVE) {
+			flush();
+		}
+
+		// Instructions of the block (all of their bytes within two pages)
+		BlockInfo block;
+		block.firstPage = block.lastPage = start >> 8;
+		uchar nextPage = block.firstPage + 1;
+		word pcs[MAX_BLOCK];
+		int n = 0;
+		word pc = start;
+		bool open = true;
+		while (n < MAX_BLOCK && open) {
+			uchar first = pc >> 8;
+			uchar last = (word)(pc + 2) >> 8;
+			if (n > 0 && (pc == cpu.BreakPC || !translatable(pc))) {
+				break;
+			}
+			if ((first != block.firstPage && first != nextPage) || (last != block.firstPage && last != nextPage)) {
+				break;
+			}
+			if (last != block.firstPage) {
+				block.lastPage = last;
+			}
+			pcs[n++] = pc;
+			uchar op = Opcodes[Memory[pc]].op;
+			open = !((op >= OP_BPL && op <= OP_BRA) || op == OP_JMP || op == OP_JSR || op == OP_RTS);
+			pc += 1 + Opcodes[Memory[pc]].len;
+		}
+		icache.watch(block.firstPage);
+		icache.watch(block.lastPage);
+		block.firstVersion = icache.versions[block.firstPage];
+		block.lastVersion = icache.versions[block.lastPage];
+
+		size_t code = out.size;
+		guard(start, block);
+		for (int i = 0; i < n; i++) {
+			translate(pcs[i], i);
+		}
+		if (open) {
+			out.add64Imm(STATE, JIT_FIELD(instructions), n);
+			chain(pc);
+		}
+		emitExits();
+
+		// Send the jumps waiting for this address here
+		entries[start] = out.code + code;
+		info[start] = block;
+		std::vector<size_t>& waiting = chains[start];
+		for (unsigned int i = 0; i < waiting.size(); i++) {
+			out.patch(waiting[i], code);
+		}
+		compiled++;
+		return true;
+	}
+
+	// Run one instruction on the interpreter
+	void interpret() {
+		cpu.FetchInstruction();
+		cpu.Execute();
+		cpu.CheckInterrupts();
+	}
+
+public:
+	unsigned int compiled = 0; // Blocks translated
+	unsigned int flushes = 0; // Times the code buffer was dropped
+	unsigned long long nativeInstructions = 0; // Instructions retired by native code
+
+	JIT(MOS65C02& cpu, Board& board) : cpu(cpu), Memory(board.Memory), bus(board.bus), icache(board.icache) {
+#ifdef _WIN32
+		out.code = (byte*)VirtualAlloc(NULL, CODE_SIZE, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE);
+#else
+		void* code = mmap(NULL, CODE_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		out.code = (code == MAP_FAILED) ? NULL : (byte*)code;
+#endif
+		state.memory = board.Memory;
+		state.entries = entries;
+		state.watched = icache.watchedPages();
+		state.versions = icache.versions;
+		state.lines = &board.Lines;
+		for (unsigned int i = 0; i < 0x10000; i++) {
+			entries[i] = NULL;
+			counts[i] = 0;
+		}
+		if (out.code != NULL) {
+			emitTrampoline();
+		}
+	}
+
+	~JIT() {
+		if (out.code != NULL) {
+#ifdef _WIN32
+			VirtualFree(out.code, 0, MEM_RELEASE);
+#else
+			munmap(out.code, CODE_SIZE);
+#endif
+		}
+	}
+
+	// False if the host refused executable memory
+	bool ready() const {
+		return out.code != NULL;
+	}
+
+	// Run until the cycle budget is spent, a reset is requested or PC reaches BreakPC (same contract as MOS65C02::Run)
+	void Run() {
+		if (cpu.BreakPC != breakPC) { // <- Blocks stop before BreakPC
+			flush();
+			breakPC = cpu.BreakPC;
+		}
+		cpu.ForgetLoop();
+		if (bus.generation != busGeneration) { // <- Runs are short when device events are close together
+			busGeneration = bus.generation;
+			for (unsigned int i = 0; i < 256; i++) {
+				state.readable[i] = bus.isDirectRead(i);
+				state.writable[i] = bus.isDirectWrite(i);
+			}
+		}
+		while (cpu.Cycles >= 0 && !cpu.Resetting() && cpu.PC != cpu.BreakPC) {
+			if (icache.pending()) {
+				icache.sync();
+			}
+			word pc = cpu.PC;
+			if ((cpu.SR & 0b00001000) != 0) { // <- Decimal mode
+				interpret();
+				continue;
+			}
+			if (entries[pc] != NULL && !valid(pc)) {
+				entries[pc] = NULL;
+				counts[pc] = 0;
+			}
+			if (pc >= cpu.IdleFirst && pc <= cpu.IdleLast) {
+				interpret(); // <- Idle loops stay on the interpreter, which fast-forwards them
+				continue;
+			}
+			if (entries[pc] == NULL && (counts[pc] < JIT_HOT_COUNT || !compile(pc))) {
+				if (counts[pc] >= JIT_HOT_COUNT) {
+					counts[pc] = 0; // <- Not translatable right now, try again later
+				}
+				counts[pc]++;
+				interpret();
+				continue;
+			}
+
+			state.target = entries[pc];
+			state.ac = cpu.AC;
+			state.x = cpu.X;
+			state.y = cpu.Y;
+			state.sr = cpu.GetSR();
+			state.sp = cpu.SP;
+			state.cycles = cpu.Cycles;
+			state.pc = pc;
+			state.instructions = 0;
+			state.invalidate = -1;
+			entry(&state);
+			cpu.AC = state.ac;
+			cpu.X = state.x;
+			cpu.Y = state.y;
+			cpu.SetSR(state.sr);
+			cpu.SP = state.sp;
+			cpu.Cycles = state.cycles;
+			cpu.PC = state.pc;
+			cpu.Instructions += state.instructions;
+			nativeInstructions += state.instructions;
+			if (state.invalidate >= 0) {
+				icache.invalidate(state.invalidate);
+			}
+			if (state.instructions > 0) {
+				cpu.ForgetLoop(); // <- Native code doesn't count its stores
+				cpu.CheckInterrupts();
+			}
+			else if (cpu.Cycles >= 0 && !cpu.Resetting()) {
+				interpret(); // <- Left before its first instruction (I/O access, pending interrupt)
+			}
+		}
+	}
+};
+
+#define JIT_OPCODE(code, op, mode, len, cyc) { op, mode, len, cyc },
+const JIT::OpcodeInfo JIT::Opcodes[256] = { MOS65C02_OPCODES(JIT_OPCODE) };
+#undef JIT_OPCODE
+#else
+class JIT; // <- Not available on this host
+#endif
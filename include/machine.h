@@ -0,0 +1,529 @@
+// Machine -- a whole EVM: the board (memory, bus, VIAs, pins) plus the SSD, the CPU and the VCU
+// Every machine is independent, so a process can run many of them at once (one thread each).
+class Machine : public Board {
+public:
+	static const int ROM_SIZE = 0x4000; // ROM size
+
+	SSD ssd; // Solid State Disk
+	MOS65C02 cpu; // CPU
+	JIT* jit = NULL; // Dynamic Recompiler (NULL: interpret)
+	SASVCU vcu; // Simple and Square Video Control Unit
+	Scheduler scheduler; // Device events
+	Pacer pacer; // Host pacing
+	TraceRing trace; // Execution trace (-v)
+
+	// Run Options
+	bool verbose = false; // Verbosity
+	bool clkTest = false; // Clock Test
+	bool turbo = false; // Run the CPU as fast as the host allows (no sleeping between slices)
+	unsigned long long cycleLimit = 0; // Stop after this many emulated cycles (0: no limit)
+	int untilPC = -1; // Stop when PC reaches this address (-1: never)
+	std::string tracePath = "evm.trace"; // Where the trace is saved
+	int traceAt = -1; // Save the trace the first time PC reaches this address (-1: never)
+
+	std::atomic<bool> PowerON{ true }; // Cleared to stop the machine (window closed, exit condition reached)
+	std::atomic<bool> vcuReset{ false }; // VIA 1 asked for a VCU reset, taken by the window thread
+	std::atomic<bool> traceRequested{ false }; // Save the trace at the next event boundary (F12, SIGUSR1)
+	unsigned long long emulatedCycles = 0; // Cycles executed by the CPU
+	unsigned long long parks = 0; // Slices the CPU thread was parked for (WAI, STP)
+	long long parkedTime = 0; // Host time spent parked (us)
+	unsigned long long runs = 0; // CPU runs between two event boundaries
+	int maxRun = 0; // Longest CPU run, bounds the latency of the events host threads post (0: up to the next event)
+	std::chrono::high_resolution_clock::time_point launchTime; // Process (batch: job) start, for the startup report (-clk)
+
+private:
+	int runBudget = 0; // Cycles given to the CPU for the current run
+	std::atomic<bool> keyboardBusy{ false }; // A keyboard byte is posted, not yet on VIA 1
+	bool traceTriggered = false; // PC reached traceAt, the trace was saved
+
+	// Clock Test
+	unsigned long long reportInstructions = 0; // Instructions retired at the last clock test report
+	long long busyTime = 0; // Host time spent executing instructions since the last clock test report (us)
+	std::chrono::high_resolution_clock::time_point reportStart;
+
+	// VIA 2 -- Port A/B latch bytes 0/1 of the SSD address bus
+	static byte SSDAddressRead(void* machine, word address) {
+		Machine& m = *(Machine*)machine;
+		if (m.icache.pending()) { // <- Polling VIA 2 is how a ROM learns that a transfer has ended
+			m.icache.sync();
+		}
+		return VIA6522::busRead(&m.viaTwo, address);
+	}
+
+	static void SSDAddressWrite(void* machine, word address, byte value) {
+		Machine& m = *(Machine*)machine;
+		m.viaTwo.sendInstruction((address & 0x0F), 0, value);
+		if (m.viaTwo.PA != 0) {
+			m.ssd.latchAndSetUp(m.viaTwo.PA, 0);
+			m.viaTwo.PA = 0;
+		}
+		else if (m.viaTwo.PB != 0) {
+			m.ssd.latchAndSetUp(m.viaTwo.PB, 1);
+			m.viaTwo.PB = 0;
+		}
+	}
+
+	// VIA 1 -- bit 0 of port B resets the VCU, latched here for the window thread
+	static byte VCUControlRead(void* machine, word address) {
+		return VIA6522::busRead(&((Machine*)machine)->viaOne, address);
+	}
+
+	static void VCUControlWrite(void* machine, word address, byte value) {
+		Machine& m = *(Machine*)machine;
+		m.viaOne.sendInstruction((address & 0x0F), 0, value);
+		if (m.viaOne.PB & 0b00000001) {
+			m.viaOne.PB = 0;
+			m.vcuReset.store(true, std::memory_order_release);
+		}
+	}
+
+	// VIA 3 -- Port A latches byte 2 of the SSD address bus and queues the transfer once the instruction is complete, port B
+	// takes controller commands (descriptor chains)
+	static byte SSDControlRead(void* machine, word address) {
+		return VIA6522::busRead(&((Machine*)machine)->viaThree, address);
+	}
+
+	static void SSDControlWrite(void* machine, word address, byte value) {
+		Machine& m = *(Machine*)machine;
+		m.viaThree.sendInstruction((address & 0x0F), 0, value);
+		if (m.viaThree.PA != 0) {
+			if (m.ssd.latchAndSetUp(m.viaThree.PA, 2)) {
+				unsigned long long number = m.ssd.submitInstruction();
+				if (number != 0) {
+					m.schedule(m.now() + m.ssd.commandCycles(), SSDComplete, number);
+				}
+			}
+			m.viaThree.PA = 0;
+		}
+		else if (m.viaThree.PB != 0) {
+			byte command = m.viaThree.PB;
+			if ((command & SSD::DOORBELL_CQ) == SSD::DOORBELL_SQ) {
+				m.ssd.ringSubmission(command & 0x3F);
+				unsigned long long when, completion;
+				while (m.ssd.takeSubmission(m.now(), when, completion)) {
+					m.schedule(when, SSDQueueComplete, completion);
+				}
+			}
+			else if ((command & SSD::DOORBELL_CQ) == SSD::DOORBELL_CQ) {
+				if (m.ssd.ringCompletion(command & 0x3F, m.now())) {
+					m.schedule(m.now() + m.ssd.coalesceDelay(), SSDCoalesce, m.ssd.generation());
+				}
+			}
+			else if ((command & SSD::DOORBELL_CQ) == SSD::CMD_BANK) {
+				m.ssd.selectBank(command & 0x3F);
+			}
+			else if (command == SSD::CMD_CHAIN) {
+				unsigned long long number = m.ssd.submitChain();
+				m.schedule(m.now() + m.ssd.commandCycles(), SSDComplete, number); // <- One completion for the whole chain
+			}
+			else if (command == SSD::CMD_QUEUES) {
+				m.ssd.setUpQueues();
+			}
+			m.viaThree.PB = 0;
+		}
+	}
+
+	// SSD -- a command has taken its time, signal its completion
+	static void SSDComplete(void* machine, unsigned long long number) {
+		((Machine*)machine)->ssd.complete(number);
+	}
+
+	// SSD -- a queued command has taken its time, post its completion entry
+	static void SSDQueueComplete(void* machine, unsigned long long completion) {
+		Machine& m = *(Machine*)machine;
+		if (m.ssd.postCompletion(completion, m.now())) {
+			m.schedule(m.now() + m.ssd.coalesceDelay(), SSDCoalesce, m.ssd.generation());
+		}
+	}
+
+	// SSD -- interrupt coalescing timer
+	static void SSDCoalesce(void* machine, unsigned long long generation) {
+		((Machine*)machine)->ssd.coalesceTimeout(generation);
+	}
+
+	// Video Reserved Space -- stores mark their span for the VCU
+	static void VRSWrite(void* machine, word address, byte value) {
+		Machine& m = *(Machine*)machine;
+		m.Memory[address] = value;
+		m.vrsDirty.mark(address);
+	}
+
+	// Register the devices with the Memory Bus
+	void BusSetUp() {
+		viaOne.activationRange = 0x3FF0; // <- $3FF0-$3FFF
+		viaTwo.activationRange = 0x3FE0; // <- $3FE0-$3FEF
+		viaThree.activationRange = 0x3FD0; // <- $3FD0-$3FDF
+		bus.attachDevice(viaOne.activationRange, viaOne.activationRange + 0x0F, this, VCUControlRead, VCUControlWrite);
+		bus.attachDevice(viaTwo.activationRange, viaTwo.activationRange + 0x0F, this, SSDAddressRead, SSDAddressWrite);
+		bus.attachDevice(viaThree.activationRange, viaThree.activationRange + 0x0F, this, SSDControlRead, SSDControlWrite);
+		bus.mapHandler(0x40, 0x7F, this, NULL, VRSWrite); // <- $4000-$7FFF
+	}
+
+	// Reset RAM
+	void RAMReset() {
+		for (unsigned int i = 0; i < 0x10000; i++) {
+			if (i < (0xFFFF - ROM_SIZE)) {
+				Memory[i] = 0x00;
+			}
+		}
+		vrsDirty.markAll();
+		icache.clear();
+	}
+
+	// Keyboard -- a byte of a report on VIA 1's port A, signaled through CA1
+	static void KeyboardInput(void* machine, unsigned long long value) {
+		Machine& m = *(Machine*)machine;
+		m.viaOne.PA = value & (~(m.viaOne.DDRA));
+		m.viaOne.CA1 = true; // Trigger CA1
+		m.viaOne.setInterrupt(); // Set up the Interrupt for the CPU
+		m.setLine(LINE_IRQ_VIA_ONE, !m.viaOne.checkInterrupt()); // Trigger the Interrupt
+		m.keyboardBusy = false;
+	}
+
+	// Host Pacing -- the emulated time has reached a pacing point, wait for the host's to reach it too
+	static void Pace(void* machine, unsigned long long) {
+		Machine& m = *(Machine*)machine;
+		if (m.cpu.Waiting || m.cpu.Stopped) {
+			m.Park(); // <- Instead of pacing, so an interrupt ends the wait early
+		}
+		else if (!m.turbo) {
+			m.pacer.pace(m.emulatedCycles);
+		}
+	}
+
+	// Clock Test -- should closely match one second
+	static void ClockTest(void* machine, unsigned long long) {
+		Machine& m = *(Machine*)machine;
+		MOS65C02& cpu = m.cpu;
+		auto end = std::chrono::high_resolution_clock::now();
+		auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(end - m.reportStart).count();
+		double retired = double(cpu.Instructions - m.reportInstructions);
+		std::cout << "CPU Speed: " << float(cpu.CLOCK_SPEED / 1000000.0) << "MHz" << " -- Executed in: " << "  " << elapsed / 1000 << "ms";
+		std::cout << " -- Emulated: " << retired / elapsed << " MIPS -- Host: " << (m.busyTime > 0 ? retired / m.busyTime : 0) << " MIPS" << std::endl;
+		if (m.ssd.submitted > 0) {
+			std::cout << "SSD Commands: " << m.ssd.served << "/" << m.ssd.submitted << " (" << m.ssd.chains << " chains, " << m.ssd.queuedCommands << " queued, " << m.ssd.queueInterrupts << " queue interrupts) -- Queue depth: " << m.ssd.queueDepth() << " (max " << m.ssd.maxDepth << ")";
+			std::cout << " -- Service time: " << (m.ssd.served > 0 ? m.ssd.serviceTime / m.ssd.served / 1000.0 : 0) << "us avg, " << m.ssd.maxServiceTime / 1000.0 << "us max" << std::endl;
+		}
+		Pacer::Stats& pacing = m.pacer.interval;
+		if (pacing.points > 0) {
+			std::cout << "Pacing: " << pacing.points << " points -- Error: " << pacing.average() / 1000.0 << "us avg, " << pacing.errorMax / 1000.0 << "us max";
+			std::cout << " -- Jitter: " << pacing.jitter() / 1000.0 << "us -- Late: " << pacing.late << std::endl;
+		}
+		pacing = Pacer::Stats();
+		m.reportInstructions = cpu.Instructions;
+		m.busyTime = 0;
+		m.reportStart = std::chrono::high_resolution_clock::now();
+	}
+
+	// WAI/STP -- park the CPU thread until a pin the CPU waits for is asserted, an event is posted or power is off. The
+	// CPU has slept up to the pacing point already, so the park lasts until its deadline at most (50ms in turbo).
+	void Park() {
+		if (turbo && (cycleLimit != 0 || scheduler.pending())) {
+			return; // <- The sleep ends at an event or at the cycle limit, run to it as fast as the host allows
+		}
+		auto parkStart = std::chrono::high_resolution_clock::now();
+		Pacer::Clock::time_point until = turbo ? Pacer::Clock::now() + std::chrono::milliseconds(50) : pacer.deadline(emulatedCycles);
+		std::unique_lock<std::mutex> lock(pinLock);
+		pinChanged.wait_until(lock, until, [this] {
+			return !PowerON || lineAsserted(LINE_RES) || scheduler.postPending() || (cpu.Waiting && lineAsserted(LINE_IRQ | LINE_NMI));
+		});
+		parks++;
+		parkedTime += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - parkStart).count();
+	}
+
+public:
+	Machine() : ssd(*this), cpu(*this), vcu(*this) {
+		BusSetUp();
+	}
+
+	~Machine() {
+#if EVM_JIT
+		delete jit;
+#endif
+	}
+
+	// Load the ROM into $C000-$FFFF
+	bool loadROM(const char* path) {
+		std::vector<char> ROM(ROM_SIZE); // Contents of the ROM file
+		std::ifstream rom(path, std::ios::binary); // ROM file
+
+		if (!rom.read(ROM.data(), ROM_SIZE)) {
+			std::cerr << "Couldn't read the ROM file.\nPath is invalid, ROM file is smaller than " << ROM_SIZE / 1024 << "kb or permission to file is denied.\n";
+			return false;
+		}
+		rom.close();
+
+		// Initializing Memory and Copying ROM
+		ushort x = 0;
+		for (unsigned int i = 0; i < 0x10000; i++) {
+			if (i > (0xFFFF - ROM_SIZE)) {
+				Memory[i] = ROM[x];
+				x++;
+			}
+			else {
+				Memory[i] = 0x00;
+			}
+		}
+		icache.clear();
+		return true;
+	}
+
+	// Emulated time -- cycles executed by the CPU, the current run included (CPU thread)
+	unsigned long long now() const {
+		return emulatedCycles + (runBudget - cpu.Cycles);
+	}
+
+	// Schedule a device event at an emulated cycle (CPU thread) -- a run that would go past it is cut short
+	void schedule(unsigned long long when, Scheduler::Callback callback, unsigned long long data = 0, unsigned long long period = 0) {
+		unsigned long long current = now();
+		if (when < current) {
+			when = current;
+		}
+		scheduler.schedule(when, callback, this, data, period);
+		if (cpu.Cycles >= 0 && current + cpu.Cycles >= when) {
+			int cut = int(current + cpu.Cycles - when) + 1; // <- The run ends on the first instruction boundary at or after when
+			cpu.Cycles -= cut;
+			runBudget -= cut;
+		}
+	}
+
+	// Post a device event from another thread, and wake a parked CPU up to service it
+	void post(Scheduler::Callback callback, unsigned long long data = 0) {
+		scheduler.post(callback, this, data);
+		wakeCPU();
+	}
+
+	// Keyboard -- send a byte of a report (window thread), false if the last one hasn't been taken yet
+	bool sendKeyboardByte(byte value) {
+		if (lineAsserted(LINE_IRQ) || keyboardBusy) {
+			return false;
+		}
+		keyboardBusy = true;
+		post(KeyboardInput, value);
+		return true;
+	}
+
+	// Copy the CPU state to a trace record (PC and operands as they are now)
+	TraceRecord& TraceState(TraceRecord& record, unsigned long long cycle) {
+		record.cycle = cycle;
+		record.pc = cpu.PC;
+		record.address = cpu.Address;
+		record.opcode = cpu.IR;
+		record.operand[0] = Memory[(word)(cpu.PC + 1)];
+		record.operand[1] = Memory[(word)(cpu.PC + 2)];
+		record.ac = cpu.AC;
+		record.x = cpu.X;
+		record.y = cpu.Y;
+		record.sr = cpu.GetSR();
+		record.sp = cpu.SP;
+		record.spValue = Memory[0x100 | cpu.SP];
+		record.value = Memory[cpu.Address];
+		record.kind = TRACE_INSTRUCTION;
+		record.reserved = 0;
+		return record;
+	}
+
+	// Save the execution trace
+	void SaveTrace() {
+		if (trace.save(tracePath.c_str())) {
+			printf(" --- Trace: %llu records saved to %s (decode with evm-trace.py)\n", trace.size(), tracePath.c_str());
+		}
+		else {
+			std::cerr << "Error: Couldn't save the trace to " << tracePath << std::endl;
+		}
+	}
+
+	// Resident memory of the process (KB, 0: unknown) -- peak: the most it has been
+	static unsigned long long ResidentKB(bool peak) {
+#ifdef _WIN32
+		PROCESS_MEMORY_COUNTERS counters;
+		if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+			return (peak ? counters.PeakWorkingSetSize : counters.WorkingSetSize) / 1024;
+		}
+		return 0;
+#else
+		unsigned long long kb = 0;
+		FILE* status = fopen("/proc/self/status", "r"); // <- Linux
+		if (status != NULL) {
+			char line[128];
+			const char* field = peak ? "VmHWM:" : "VmRSS:";
+			while (fgets(line, sizeof(line), status) != NULL) {
+				if (strncmp(line, field, strlen(field)) == 0) {
+					kb = strtoull(line + strlen(field), NULL, 10);
+					break;
+				}
+			}
+			fclose(status);
+		}
+		else if (peak) {
+			struct rusage usage;
+			if (getrusage(RUSAGE_SELF, &usage) == 0) {
+#ifdef __APPLE__
+				kb = usage.ru_maxrss / 1024; // <- Bytes on macOS
+#else
+				kb = usage.ru_maxrss;
+#endif
+			}
+		}
+		return kb;
+#endif
+	}
+
+	// Central Processing Unit -- runs on the calling thread until the machine is powered off
+	// The CPU runs exactly to the next device event (MAX_RUN cycles at most), then the due events are serviced in cycle
+	// order. Host pacing is one of them.
+	void Run() {
+		if (verbose || clkTest) {
+			printf(" --- CPU Running%s\n", turbo ? " (turbo)" : "");
+		}
+		if (clkTest) {
+			double startup = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - launchTime).count();
+			printf(" --- Startup: %.2fms to the first instruction, %llu KB resident (%s)\n", startup, ResidentKB(false),
+				ssd.isSparse() ? "the sparse image's clusters are read on the first transfer through them" : ssd.isOverlay() ? "the disk image is mapped copy-on-write, not read" : "the disk image is mapped, not read");
+			if (ssd.isOverlay()) {
+				printf(" --- Overlay: %u clusters written over the disk image (read on the first transfer through them)\n", ssd.overlayClusters());
+			}
+		}
+		cpu.BreakPC = untilPC;
+		int pacePeriod = turbo ? cpu.CLOCK_SPEED / 20 : cpu.CLOCK_SPEED / 1000; // <- 1ms steps (turbo: only WAI/STP park, 50ms)
+		schedule(emulatedCycles + pacePeriod, Pace, 0, pacePeriod);
+		pacer.start(emulatedCycles, cpu.CLOCK_SPEED);
+		if (clkTest) {
+			reportStart = std::chrono::high_resolution_clock::now();
+			reportInstructions = cpu.Instructions;
+			schedule(emulatedCycles + cpu.CLOCK_SPEED, ClockTest, 0, cpu.CLOCK_SPEED);
+		}
+		RDY = true;
+		while (PowerON) {
+			while (RDY) {
+				scheduler.service(emulatedCycles);
+				if (traceRequested.load(std::memory_order_relaxed)) {
+					traceRequested = false;
+					SaveTrace();
+				}
+
+				unsigned long long end = scheduler.next();
+				if (maxRun != 0 && end > emulatedCycles + maxRun) {
+					end = emulatedCycles + maxRun;
+				}
+				if (cycleLimit != 0 && end > cycleLimit) {
+					end = cycleLimit; // <- Last run ends at the limit
+				}
+				cpu.Cycles = runBudget = int(end - emulatedCycles) - 1; // <- Runs until the cycles executed reach end
+				runs++;
+
+				std::chrono::high_resolution_clock::time_point runStart;
+				if (clkTest) {
+					runStart = std::chrono::high_resolution_clock::now(); // <- Reading the clock costs more than a short run
+				}
+				while (cpu.Cycles >= 0) {
+					if (cpu.Resetting()) { // Reset Sequence
+						cpu.reset();
+						RAMReset();
+						if (verbose) {
+							printf(" ---- RESET ----\n");
+							TraceState(trace.next(), now()).kind = TRACE_RESET;
+						}
+					}
+					if (!verbose) {
+#if EVM_JIT
+						if (jit != NULL) {
+							jit->Run();
+						}
+						else {
+							cpu.Run(); // <- Runs until the cycles are spent or a reset is requested
+						}
+#else
+						cpu.Run(); // <- Runs until the cycles are spent or a reset is requested
+#endif
+					}
+					else {
+						unsigned long long cycle = now();
+						word insAddr = cpu.PC; // <-- Used for displaying the address of the current instruction's OPCODE
+						byte operand[2] = { Memory[(word)(insAddr + 1)], Memory[(word)(insAddr + 2)] }; // <- Read before a store can change them
+						cpu.FetchInstruction();
+						cpu.Execute();
+						TraceRecord& record = TraceState(trace.next(), cycle);
+						record.pc = insAddr;
+						record.opcode = cpu.IR;
+						record.operand[0] = operand[0];
+						record.operand[1] = operand[1];
+						uchar interrupt = cpu.CheckInterrupts();
+						record.kind = interrupt == 1 ? TRACE_IRQ : interrupt == 2 ? TRACE_NMI : TRACE_INSTRUCTION;
+						if (cpu.PC == traceAt && !traceTriggered) {
+							SaveTrace(); // <- The records leading to the first time only
+							traceTriggered = true;
+						}
+					}
+					if (PowerON == false || cpu.PC == untilPC) {
+						PowerON = false;
+						RDY = false;
+						break;
+					}
+				}
+				emulatedCycles += runBudget - cpu.Cycles;
+				runBudget = cpu.Cycles = 0;
+				if (clkTest) {
+					busyTime += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - runStart).count();
+				}
+				if (cycleLimit != 0 && emulatedCycles >= cycleLimit) {
+					PowerON = false;
+					RDY = false;
+				}
+			}
+		}
+		if (trace.enabled() && !traceTriggered) { // <- A trace trigger that was hit keeps its records
+			SaveTrace(); // <- The last records before the machine stopped
+		}
+	}
+
+	// Emulation Summary
+	void PrintRunStats(std::chrono::high_resolution_clock::time_point start) {
+		double wall = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+		printf(" --- Emulated cycles: %llu\n", emulatedCycles);
+		printf(" --- Instructions retired: %llu\n", cpu.Instructions);
+		printf(" --- Wall time: %.3fs\n", wall);
+		printf(" --- Effective speed: %.2f MHz, %.2f MIPS\n", emulatedCycles / wall / 1000000.0, cpu.Instructions / wall / 1000000.0);
+		printf(" --- Device events: %llu serviced, %llu CPU runs\n", scheduler.serviced, runs);
+		if (pacer.total.points > 0) {
+			printf(" --- Pacing: %llu points, error %.1fus avg, %.1fus max, jitter %.1fus, %llu late, %llu resyncs (%.1fms dropped)\n", pacer.total.points,
+				pacer.total.average() / 1000.0, pacer.total.errorMax / 1000.0, pacer.total.jitter() / 1000.0, pacer.total.late, pacer.resyncs, pacer.dropped / 1000000.0);
+		}
+		if (icache.enabled && cpu.Instructions > 0) {
+			printf(" --- Decode cache: %.2f%% hits (%llu misses, %llu page invalidations)\n", 100.0 * (cpu.Instructions - icache.misses) / cpu.Instructions, icache.misses, icache.invalidations);
+		}
+		if (cpu.SleepCycles > 0) {
+			printf(" --- WAI/STP: %llu cycles asleep (%.2f%% of the emulated time), parked %llu times for %.3fs\n", cpu.SleepCycles, 100.0 * cpu.SleepCycles / emulatedCycles, parks, parkedTime / 1000000.0);
+		}
+		if (cpu.IdleSkips > 0) {
+			printf(" --- Idle loops: %llu fast-forwarded, %llu cycles skipped (%.2f%% of the emulated time)\n", cpu.IdleSkips, cpu.IdleCycles, 100.0 * cpu.IdleCycles / emulatedCycles);
+		}
+		unsigned long long fused = 0;
+		for (uchar i = 0; i < IDIOM_COUNT; i++) {
+			fused += cpu.FusedHits[i];
+		}
+		if (fused > 0) {
+			printf(" --- Fused idioms: %.2f%% of instructions --", 200.0 * fused / cpu.Instructions);
+			const char* separator = " ";
+			for (uchar i = 0; i < IDIOM_COUNT; i++) {
+				if (cpu.FusedHits[i] > 0) {
+					printf("%s%s %llu", separator, MOS65C02::IdiomNames[i], cpu.FusedHits[i]);
+					separator = ", ";
+				}
+			}
+			printf("\n");
+		}
+#if EVM_JIT
+		if (jit != NULL && cpu.Instructions > 0) {
+			printf(" --- JIT: %u blocks translated (%u flushes), %.2f%% of instructions run natively\n", jit->compiled, jit->flushes, 100.0 * jit->nativeInstructions / cpu.Instructions);
+		}
+#endif
+		if (clkTest) {
+			printf(" --- Memory: %llu KB resident (peak %llu KB), disk image: %u of %u pages touched by transfers\n", ResidentKB(false), ResidentKB(true),
+				ssd.pagesTouched(), ssd.storageSize() / SSD::PAGE_SIZE);
+		}
+		if (cpu.PC == untilPC) {
+			printf(" --- Stopped at PC: %04x\n", cpu.PC);
+		}
+	}
+};
@@ -1,11 +1,313 @@
-extern byte Memory[0x10000];
-extern VIA6522 viaOne, viaTwo, viaThree;
-extern bool verbose;
-extern SSD ssd;
-extern void SSD_RW();
-extern bool RES;
-extern bool IRQ;
-extern bool NMI;
+// CPU Dispatch -- build option, set with -DEVM_DISPATCH=<n> (/DEVM_DISPATCH=<n> on MSVC)
+//  0: switch on the opcode
+//  1: 256-entry handler table
+//  2: threaded -- every handler jumps straight to the next one (computed goto, GCC/Clang only)
+#define DISPATCH_SWITCH 0
+#define DISPATCH_TABLE 1
+#define DISPATCH_THREADED 2
+#ifndef EVM_DISPATCH
+#if defined(__GNUC__) || defined(__clang__)
+#define EVM_DISPATCH DISPATCH_THREADED
+#else
+#define EVM_DISPATCH DISPATCH_TABLE
+#endif
+#endif
+#if EVM_DISPATCH == DISPATCH_THREADED && !defined(__GNUC__) && !defined(__clang__)
+#undef EVM_DISPATCH
+#define EVM_DISPATCH DISPATCH_TABLE // <- No computed goto on this compiler
+#endif
+
+// Operations
+enum {
+	OP_ORA, OP_AND, OP_EOR, OP_ADC, OP_SBC, OP_LDA, OP_LDX, OP_LDY, OP_CMP, OP_CPX, OP_CPY, OP_BIT, // Read
+	OP_STA, OP_STX, OP_STY, OP_STZ, // Write
+	OP_ASL, OP_LSR, OP_ROL, OP_ROR, OP_INC, OP_DEC, OP_TSB, OP_TRB, // Read-Modify-Write
+	OP_ASL_A, OP_LSR_A, OP_ROL_A, OP_ROR_A, // Accumulator
+	OP_INX, OP_INY, OP_INA, OP_DEX, OP_DEY, OP_DEA, OP_TAX, OP_TAY, OP_TXA, OP_TYA, OP_TSX, OP_TXS, // Registers
+	OP_PHA, OP_PHP, OP_PHX, OP_PHY, OP_PLA, OP_PLP, OP_PLX, OP_PLY, // Stack
+	OP_CLC, OP_SEC, OP_CLI, OP_SEI, OP_CLV, OP_CLD, OP_SED, // Flags
+	OP_BPL, OP_BMI, OP_BVC, OP_BVS, OP_BCC, OP_BCS, OP_BNE, OP_BEQ, OP_BRA, // Branches
+	OP_JMP, OP_JSR, OP_RTS, OP_RTI, OP_BRK, OP_NOP, // Control
+	OP_WAI, OP_STP // Low Power
+};
+
+// Addressing Modes (_NP: page boundary crossing does not affect the instruction)
+enum {
+	AM_IMP, AM_IMM, AM_ZPG, AM_ZPG_X, AM_ZPG_Y, AM_ABS, AM_ABS_X, AM_ABS_X_NP, AM_ABS_Y, AM_ABS_Y_NP,
+	AM_IND, AM_ABS_IND, AM_X_IND, AM_IND_Y, AM_IND_Y_NP, AM_ZPG_IND
+};
+
+// Opcode Table -- X(opcode, operation, addressing mode, operand bytes skipped after the operation, base cycles)
+#define MOS65C02_OPCODES(X) \
+	X(0x00, OP_BRK, AM_IMP, 0, 7) /* BRK */ \
+	X(0x01, OP_ORA, AM_X_IND, 1, 6) /* ORA X, ind */ \
+	X(0x02, OP_NOP, AM_IMP, 1, 2) /* NOP */ \
+	X(0x03, OP_NOP, AM_IMP, 0, 1) /* NOP */ \
+	X(0x04, OP_TSB, AM_ABS, 1, 5) /* TSB zpg */ \
+	X(0x05, OP_ORA, AM_ZPG, 1, 3) /* ORA zpg */ \
+	X(0x06, OP_ASL, AM_ZPG, 1, 5) /* ASL zpg */ \
+	X(0x07, OP_NOP, AM_IMP, 0, 1) /* NOP */ \
+	X(0x08, OP_PHP, AM_IMP, 0, 3) /* PHP */ \
+	X(0x09, OP_ORA, AM_IMM, 1, 2) /* ORA immediate */ \
+	X(0x0A, OP_ASL_A, AM_IMP, 0, 2) /* ASL A */ \
+	X(0x0B, OP_NOP, AM_IMP, 0, 1) /* NOP */ \
+	X(0x0C, OP_TSB, AM_ABS, 2, 6) /* TSB abs */ \
+	X(0x0D, OP_ORA, AM_ABS, 2, 4) /* ORA abs */ \
+	X(0x0E, OP_ASL, AM_ABS, 2, 6) /* ASL abs */ \
+	X(0x0F, OP_NOP, AM_IMP, 0, 1) /* NOP */ \
+	X(0x10, OP_BPL, AM_IMP, 0, 2) /* BPL */ \
+	X(0x11, OP_ORA, AM_IND_Y, 1, 5) /* ORA ind, Y */ \
+	X(0x12, OP_ORA, AM_ZPG_IND, 1, 5) /* ORA (zpg) */ \
+	X(0x13, OP_NOP, AM_IMP, 0, 1) /* NOP */ \
+	X(0x14, OP_TRB, AM_ZPG, 1, 5) /* TRB zpg */ \
+	X(0x15, OP_ORA, AM_ZPG_X, 1, 4) /* ORA zpg, X */ \
+	X(0x16, OP_ASL, AM_ZPG_X, 1, 6) /* ASL zpg, X */ \
+	X(0x17, OP_NOP, AM_IMP, 0, 1) /* NOP */ \
+	X(0x18, OP_CLC, AM_IMP, 0, 2) /* CLC */ \
+	X(0x19, OP_ORA, AM_ABS_Y, 2, 4) /* ORA abs, Y */ \
+	X(0x1A, OP_INA, AM_IMP, 0, 2) /* INA */ \
+	X(0x1B, OP_NOP, AM_IMP, 0, 1) /* NOP */ \
+	X(0x1C, OP_TRB, AM_ABS, 2, 6) /* TRB abs */ \
+	X(0x1D, OP_ORA, AM_ABS_X, 2, 4) /* ORA abs, X */ \
+	X(0x1E, OP_ASL, AM_ABS_X_NP, 2, 7) /* ASL abs, X */ \
+	X(0x1F, OP_NOP, AM_IMP, 0, 1) /* NOP */ \
+	X(0x20, OP_JSR, AM_ABS, 0, 6) /* JSR */ \
+	X(0x21, OP_AND, AM_X_IND, 1, 6) /* AND X, ind */ \
+	X(0x22, OP_NOP, AM_IMP, 1, 2) /* NOP */ \
+	X(0x23, OP_NOP, AM_IMP, 0, 1) /* NOP */ \
+	X(0x24, OP_BIT, AM_ZPG, 1, 3) /* BIT zpg */ \
+	X(0x25, OP_AND, AM_ZPG, 1, 3) /* AND zpg */ \
+	X(0x26, OP_ROL, AM_ZPG, 1, 5) /* ROL zpg */ \
+	X(0x27, OP_NOP, AM_IMP, 0, 1) /* NOP */ \
+	X(0x28, OP_PLP, AM_IMP, 0, 4) /* PLP */ \
+	X(0x29, OP_AND, AM_IMM, 1, 2) /* AND immediate */ \
+	X(0x2A, OP_ROL_A, AM_IMP, 0, 2) /* ROL A */ \
+	X(0x2B, OP_NOP, AM_IMP, 0, 1) /* NOP */ \
+	X(0x2C, OP_BIT, AM_ABS, 2, 4) /* BIT abs */ \
+	X(0x2D, OP_AND, AM_ABS, 2, 4) /* AND abs */ \
+	X(0x2E, OP_ROL, AM_ABS, 2, 6) /* ROL abs */ \
+	X(0x2F, OP_NOP, AM_IMP, 0, 1) /* NOP */ \
+	X(0x30, OP_BMI, AM_IMP, 0, 2) /* BMI */ \
+	X(0x31, OP_AND, AM_IND_Y, 1, 5) /* AND ind, Y */ \
+	X(0x32, OP_AND, AM_ZPG_IND, 1, 5) /* AND (zpg) */ \
+	X(0x33, OP_NOP, AM_IMP, 0, 1) /* NOP */ \
+	X(0x34, OP_BIT, AM_ZPG_X, 1, 4) /* BIT zpg,X */ \
+	X(0x35, OP_AND, AM_ZPG_X, 1, 4) /* AND zpg, X */ \
+	X(0x36, OP_ROL, AM_ZPG_X, 1, 6) /* ROL zpg, X */ \
+	X(0x37, OP_NOP, AM_IMP, 0, 1) /* NOP */ \
+	X(0x38, OP_SEC, AM_IMP, 0, 2) /* SEC */ \
+	X(0x39, OP_AND, AM_ABS_Y, 2, 4) /* AND abs, Y */ \
+	X(0x3A, OP_DEA, AM_IMP, 0, 2) /* DEA */ \
+	X(0x3B, OP_NOP, AM_IMP, 0, 1) /* NOP */ \
+	X(0x3C, OP_BIT, AM_ABS_X, 2, 4) /* BIT abs,X */ \
+	X(0x3D, OP_AND, AM_ABS_X, 2, 4) /* AND abs, X */ \
+	X(0x3E, OP_ROL, AM_ABS_X_NP, 2, 7) /* ROL abs, X */ \
+	X(0x3F, OP_NOP, AM_IMP, 0, 1) /* NOP */ \
+	X(0x40, OP_RTI, AM_IMP, 0, 6) /* RTI */ \
+	X(0x41, OP_EOR, AM_X_IND, 1, 6) /* EOR X, ind */ \
+	X(0x42, OP_NOP, AM_IMP, 1, 2) /* NOP */ \
+	X(0x43, OP_NOP, AM_IMP, 0, 1) /* NOP */ \
+	X(0x44, OP_NOP, AM_IMP, 1, 3) /* NOP */ \
+	X(0x45, OP_EOR, AM_ZPG, 1, 3) /* EOR zpg */ \
+	X(0x46, OP_LSR, AM_ZPG, 1, 5) /* LSR zpg */ \
+	X(0x47, OP_NOP, AM_IMP, 0, 1) /* NOP */ \
+	X(0x48, OP_PHA, AM_IMP, 0, 3) /* PHA */ \
+	X(0x49, OP_EOR, AM_IMM, 1, 2) /* EOR immediate */ \
+	X(0x4A, OP_LSR_A, AM_IMP, 0, 2) /* LSR A */ \
+	X(0x4B, OP_NOP, AM_IMP, 0, 1) /* NOP */ \
+	X(0x4C, OP_JMP, AM_ABS, 0, 3) /* JMP abs */ \
+	X(0x4D, OP_EOR, AM_ABS, 2, 4) /* EOR abs */ \
+	X(0x4E, OP_LSR, AM_ABS, 2, 6) /* LSR abs */ \
+	X(0x4F, OP_NOP, AM_IMP, 0, 1) /* NOP */ \
+	X(0x50, OP_BVC, AM_IMP, 0, 2) /* BVC */ \
+	X(0x51, OP_EOR, AM_IND_Y, 1, 5) /* EOR ind, Y */ \
+	X(0x52, OP_EOR, AM_ZPG_IND, 1, 5) /* EOR (zpg) */ \
+	X(0x53, OP_NOP, AM_IMP, 0, 1) /* NOP */ \
+	X(0x54, OP_NOP, AM_IMP, 1, 4) /* NOP */ \
+	X(0x55, OP_EOR, AM_ZPG_X, 1, 4) /* EOR zpg, X */ \
+	X(0x56, OP_LSR, AM_ZPG_X, 1, 6) /* LSR zpg, X */ \
+	X(0x57, OP_NOP, AM_IMP, 0, 1) /* NOP */ \
+	X(0x58, OP_CLI, AM_IMP, 0, 2) /* CLI */ \
+	X(0x59, OP_EOR, AM_ABS_Y, 2, 4) /* EOR abs, Y */ \
+	X(0x5A, OP_PHY, AM_IMP, 0, 3) /* PHY */ \
+	X(0x5B, OP_NOP, AM_IMP, 0, 1) /* NOP */ \
+	X(0x5C, OP_NOP, AM_IMP, 2, 8) /* NOP */ \
+	X(0x5D, OP_EOR, AM_ABS_X, 2, 4) /* EOR abs, X */ \
+	X(0x5E, OP_LSR, AM_ABS_X_NP, 2, 7) /* LSR abs, X */ \
+	X(0x5F, OP_NOP, AM_IMP, 0, 1) /* NOP */ \
+	X(0x60, OP_RTS, AM_IMP, 0, 6) /* RTS */ \
+	X(0x61, OP_ADC, AM_X_IND, 1, 6) /* ADC X, ind */ \
+	X(0x62, OP_NOP, AM_IMP, 1, 2) /* NOP */ \
+	X(0x63, OP_NOP, AM_IMP, 0, 1) /* NOP */ \
+	X(0x64, OP_STZ, AM_ZPG, 1, 3) /* STZ zpg */ \
+	X(0x65, OP_ADC, AM_ZPG, 1, 3) /* ADC zpg */ \
+	X(0x66, OP_ROR, AM_ZPG, 1, 5) /* ROR zpg */ \
+	X(0x67, OP_NOP, AM_IMP, 0, 1) /* NOP */ \
+	X(0x68, OP_PLA, AM_IMP, 0, 4) /* PLA */ \
+	X(0x69, OP_ADC, AM_IMM, 1, 2) /* ADC immediate */ \
+	X(0x6A, OP_ROR_A, AM_IMP, 0, 2) /* ROR A */ \
+	X(0x6B, OP_NOP, AM_IMP, 0, 1) /* NOP */ \
+	X(0x6C, OP_JMP, AM_IND, 0, 6) /* JMP (abs) */ \
+	X(0x6D, OP_ADC, AM_ABS, 2, 4) /* ADC abs */ \
+	X(0x6E, OP_ROR, AM_ABS, 2, 6) /* ROR abs */ \
+	X(0x6F, OP_NOP, AM_IMP, 0, 1) /* NOP */ \
+	X(0x70, OP_BVS, AM_IMP, 0, 2) /* BVS */ \
+	X(0x71, OP_ADC, AM_IND_Y, 1, 5) /* ADC ind, Y */ \
+	X(0x72, OP_ADC, AM_ZPG_IND, 1, 5) /* ADC (zpg) */ \
+	X(0x73, OP_NOP, AM_IMP, 0, 1) /* NOP */ \
+	X(0x74, OP_STZ, AM_ZPG_X, 1, 4) /* STZ zpg,X */ \
+	X(0x75, OP_ADC, AM_ZPG_X, 1, 4) /* ADC zpg, X */ \
+	X(0x76, OP_ROR, AM_ZPG_X, 1, 6) /* ROR zpg, X */ \
+	X(0x77, OP_NOP, AM_IMP, 0, 1) /* NOP */ \
+	X(0x78, OP_SEI, AM_IMP, 0, 2) /* SEI */ \
+	X(0x79, OP_ADC, AM_ABS_Y, 2, 4) /* ADC abs, Y */ \
+	X(0x7A, OP_PLY, AM_IMP, 0, 4) /* PLY */ \
+	X(0x7B, OP_NOP, AM_IMP, 0, 1) /* NOP */ \
+	X(0x7C, OP_JMP, AM_ABS_IND, 0, 3) /* JMP abs (ind,x) */ \
+	X(0x7D, OP_ADC, AM_ABS_X, 2, 4) /* ADC abs, X */ \
+	X(0x7E, OP_ROR, AM_ABS_X_NP, 2, 7) /* ROR abs, X */ \
+	X(0x7F, OP_NOP, AM_IMP, 0, 1) /* NOP */ \
+	X(0x80, OP_BRA, AM_IMP, 0, 2) /* BRA */ \
+	X(0x81, OP_STA, AM_X_IND, 1, 6) /* STA X, ind */ \
+	X(0x82, OP_NOP, AM_IMP, 1, 2) /* NOP */ \
+	X(0x83, OP_NOP, AM_IMP, 0, 1) /* NOP */ \
+	X(0x84, OP_STY, AM_ZPG, 1, 3) /* STY zpg */ \
+	X(0x85, OP_STA, AM_ZPG, 1, 3) /* STA zpg */ \
+	X(0x86, OP_STX, AM_ZPG, 1, 3) /* STX zpg */ \
+	X(0x87, OP_NOP, AM_IMP, 0, 1) /* NOP */ \
+	X(0x88, OP_DEY, AM_IMP, 0, 2) /* DEY */ \
+	X(0x89, OP_BIT, AM_IMM, 1, 2) /* BIT immediate */ \
+	X(0x8A, OP_TXA, AM_IMP, 0, 2) /* TXA */ \
+	X(0x8B, OP_NOP, AM_IMP, 0, 1) /* NOP */ \
+	X(0x8C, OP_STY, AM_ABS, 2, 4) /* STY abs */ \
+	X(0x8D, OP_STA, AM_ABS, 2, 4) /* STA abs */ \
+	X(0x8E, OP_STX, AM_ABS, 2, 4) /* STX abs */ \
+	X(0x8F, OP_NOP, AM_IMP, 0, 1) /* NOP */ \
+	X(0x90, OP_BCC, AM_IMP, 0, 2) /* BCC */ \
+	X(0x91, OP_STA, AM_IND_Y_NP, 1, 6) /* STA ind, Y */ \
+	X(0x92, OP_STA, AM_ZPG_IND, 1, 5) /* STA (zpg) */ \
+	X(0x93, OP_NOP, AM_IMP, 0, 1) /* NOP */ \
+	X(0x94, OP_STY, AM_ZPG_X, 1, 4) /* STY zpg, X */ \
+	X(0x95, OP_STA, AM_ZPG_X, 1, 4) /* STA zpg, X */ \
+	X(0x96, OP_STX, AM_ZPG_Y, 1, 4) /* STX zpg, Y */ \
+	X(0x97, OP_NOP, AM_IMP, 0, 1) /* NOP */ \
+	X(0x98, OP_TYA, AM_IMP, 0, 2) /* TYA */ \
+	X(0x99, OP_STA, AM_ABS_Y_NP, 2, 5) /* STA abs, Y */ \
+	X(0x9A, OP_TXS, AM_IMP, 0, 2) /* TXS */ \
+	X(0x9B, OP_NOP, AM_IMP, 0, 1) /* NOP */ \
+	X(0x9C, OP_STZ, AM_ABS, 2, 4) /* STZ abs */ \
+	X(0x9D, OP_STA, AM_ABS_X_NP, 2, 5) /* STA abs, X */ \
+	X(0x9E, OP_STZ, AM_ABS_X_NP, 2, 5) /* STZ abs, X */ \
+	X(0x9F, OP_NOP, AM_IMP, 0, 1) /* NOP */ \
+	X(0xA0, OP_LDY, AM_IMM, 1, 2) /* LDY immediate */ \
+	X(0xA1, OP_LDA, AM_X_IND, 1, 6) /* LDA X, ind */ \
+	X(0xA2, OP_LDX, AM_IMM, 1, 2) /* LDX immediate */ \
+	X(0xA3, OP_NOP, AM_IMP, 0, 1) /* NOP */ \
+	X(0xA4, OP_LDY, AM_ZPG, 1, 3) /* LDY zpg */ \
+	X(0xA5, OP_LDA, AM_ZPG, 1, 3) /* LDA zpg */ \
+	X(0xA6, OP_LDX, AM_ZPG, 1, 3) /* LDX zpg */ \
+	X(0xA7, OP_NOP, AM_IMP, 0, 1) /* NOP */ \
+	X(0xA8, OP_TAY, AM_IMP, 0, 2) /* TAY */ \
+	X(0xA9, OP_LDA, AM_IMM, 1, 2) /* LDA immediate */ \
+	X(0xAA, OP_TAX, AM_IMP, 0, 2) /* TAX */ \
+	X(0xAB, OP_NOP, AM_IMP, 0, 1) /* NOP */ \
+	X(0xAC, OP_LDY, AM_ABS, 2, 4) /* LDY abs */ \
+	X(0xAD, OP_LDA, AM_ABS, 2, 4) /* LDA abs */ \
+	X(0xAE, OP_LDX, AM_ABS, 2, 4) /* LDX abs */ \
+	X(0xAF, OP_NOP, AM_IMP, 0, 1) /* NOP */ \
+	X(0xB0, OP_BCS, AM_IMP, 0, 2) /* BCS */ \
+	X(0xB1, OP_LDA, AM_IND_Y, 1, 5) /* LDA ind, Y */ \
+	X(0xB2, OP_LDA, AM_ZPG_IND, 1, 5) /* LDA (zpg) */ \
+	X(0xB3, OP_NOP, AM_IMP, 0, 1) /* NOP */ \
+	X(0xB4, OP_LDY, AM_ZPG_X, 1, 4) /* LDY zpg, X */ \
+	X(0xB5, OP_LDA, AM_ZPG_X, 1, 4) /* LDA zpg, X */ \
+	X(0xB6, OP_LDX, AM_ZPG_Y, 1, 4) /* LDX zpg, Y */ \
+	X(0xB7, OP_NOP, AM_IMP, 0, 1) /* NOP */ \
+	X(0xB8, OP_CLV, AM_IMP, 0, 2) /* CLV */ \
+	X(0xB9, OP_LDA, AM_ABS_Y, 2, 4) /* LDA abs, Y */ \
+	X(0xBA, OP_TSX, AM_IMP, 0, 2) /* TSX */ \
+	X(0xBB, OP_NOP, AM_IMP, 0, 1) /* NOP */ \
+	X(0xBC, OP_LDY, AM_ABS_X, 2, 4) /* LDY abs, X */ \
+	X(0xBD, OP_LDA, AM_ABS_X, 2, 4) /* LDA abs, X */ \
+	X(0xBE, OP_LDX, AM_ABS_Y, 2, 4) /* LDX abs, Y */ \
+	X(0xBF, OP_NOP, AM_IMP, 0, 1) /* NOP */ \
+	X(0xC0, OP_CPY, AM_IMM, 1, 2) /* CPY immediate */ \
+	X(0xC1, OP_CMP, AM_X_IND, 1, 6) /* CMP X, ind */ \
+	X(0xC2, OP_NOP, AM_IMP, 1, 2) /* NOP */ \
+	X(0xC3, OP_NOP, AM_IMP, 0, 1) /* NOP */ \
+	X(0xC4, OP_CPY, AM_ZPG, 1, 3) /* CPY zpg */ \
+	X(0xC5, OP_CMP, AM_ZPG, 1, 3) /* CMP zpg */ \
+	X(0xC6, OP_DEC, AM_ZPG, 1, 5) /* DEC zpg */ \
+	X(0xC7, OP_NOP, AM_IMP, 0, 1) /* NOP */ \
+	X(0xC8, OP_INY, AM_IMP, 0, 2) /* INY */ \
+	X(0xC9, OP_CMP, AM_IMM, 1, 2) /* CMP immediate */ \
+	X(0xCA, OP_DEX, AM_IMP, 0, 2) /* DEX */ \
+	X(0xCB, OP_WAI, AM_IMP, 0, 3) /* WAI */ \
+	X(0xCC, OP_CPY, AM_ABS, 2, 4) /* CPY abs */ \
+	X(0xCD, OP_CMP, AM_ABS, 2, 4) /* CMP abs */ \
+	X(0xCE, OP_DEC, AM_ABS, 2, 6) /* DEC abs */ \
+	X(0xCF, OP_NOP, AM_IMP, 0, 1) /* NOP */ \
+	X(0xD0, OP_BNE, AM_IMP, 0, 2) /* BNE */ \
+	X(0xD1, OP_CMP, AM_IND_Y, 1, 5) /* CMP ind, Y */ \
+	X(0xD2, OP_CMP, AM_ZPG_IND, 1, 5) /* CMP (zpg) */ \
+	X(0xD3, OP_NOP, AM_IMP, 0, 1) /* NOP */ \
+	X(0xD4, OP_NOP, AM_IMP, 1, 4) /* NOP */ \
+	X(0xD5, OP_CMP, AM_ZPG_X, 1, 4) /* CMP zpg, X */ \
+	X(0xD6, OP_DEC, AM_ZPG_X, 1, 6) /* DEC zpg, X */ \
+	X(0xD7, OP_NOP, AM_IMP, 0, 1) /* NOP */ \
+	X(0xD8, OP_CLD, AM_IMP, 0, 2) /* CLD */ \
+	X(0xD9, OP_CMP, AM_ABS_Y, 2, 4) /* CMP abs, Y */ \
+	X(0xDA, OP_PHX, AM_IMP, 0, 3) /* PHX */ \
+	X(0xDB, OP_STP, AM_IMP, 0, 3) /* STP */ \
+	X(0xDC, OP_NOP, AM_IMP, 2, 4) /* NOP */ \
+	X(0xDD, OP_CMP, AM_ABS_X, 2, 4) /* CMP abs, X */ \
+	X(0xDE, OP_DEC, AM_ABS_X_NP, 2, 7) /* DEC abs, X */ \
+	X(0xDF, OP_NOP, AM_IMP, 0, 1) /* NOP */ \
+	X(0xE0, OP_CPX, AM_IMM, 1, 2) /* CPX immediate */ \
+	X(0xE1, OP_SBC, AM_X_IND, 1, 6) /* SBC X, ind */ \
+	X(0xE2, OP_NOP, AM_IMP, 1, 2) /* NOP */ \
+	X(0xE3, OP_NOP, AM_IMP, 0, 1) /* NOP */ \
+	X(0xE4, OP_CPX, AM_ZPG, 1, 3) /* CPX zpg */ \
+	X(0xE5, OP_SBC, AM_ZPG, 1, 3) /* SBC zpg */ \
+	X(0xE6, OP_INC, AM_ZPG, 1, 5) /* INC zpg */ \
+	X(0xE7, OP_NOP, AM_IMP, 0, 1) /* NOP */ \
+	X(0xE8, OP_INX, AM_IMP, 0, 2) /* INX */ \
+	X(0xE9, OP_SBC, AM_IMM, 1, 2) /* SBC immediate */ \
+	X(0xEA, OP_NOP, AM_IMP, 0, 2) /* NOP */ \
+	X(0xEB, OP_NOP, AM_IMP, 0, 1) /* NOP */ \
+	X(0xEC, OP_CPX, AM_ABS, 2, 4) /* CPX abs */ \
+	X(0xED, OP_SBC, AM_ABS, 2, 4) /* SBC abs */ \
+	X(0xEE, OP_INC, AM_ABS, 2, 6) /* INC abs */ \
+	X(0xEF, OP_NOP, AM_IMP, 0, 1) /* NOP */ \
+	X(0xF0, OP_BEQ, AM_IMP, 0, 2) /* BEQ */ \
+	X(0xF1, OP_SBC, AM_IND_Y, 1, 5) /* SBC ind, Y */ \
+	X(0xF2, OP_SBC, AM_ZPG_IND, 1, 5) /* SBC (zpg) */ \
+	X(0xF3, OP_NOP, AM_IMP, 0, 1) /* NOP */ \
+	X(0xF4, OP_NOP, AM_IMP, 1, 4) /* NOP */ \
+	X(0xF5, OP_SBC, AM_ZPG_X, 1, 4) /* SBC zpg, X */ \
+	X(0xF6, OP_INC, AM_ZPG_X, 1, 6) /* INC zpg, X */ \
+	X(0xF7, OP_NOP, AM_IMP, 0, 1) /* NOP */ \
+	X(0xF8, OP_SED, AM_IMP, 0, 2) /* SED */ \
+	X(0xF9, OP_SBC, AM_ABS_Y, 2, 4) /* SBC abs, Y */ \
+	X(0xFA, OP_PLX, AM_IMP, 0, 4) /* PLX */ \
+	X(0xFB, OP_NOP, AM_IMP, 0, 1) /* NOP */ \
+	X(0xFC, OP_NOP, AM_IMP, 2, 4) /* NOP */ \
+	X(0xFD, OP_SBC, AM_ABS_X, 2, 4) /* SBC abs, X */ \
+	X(0xFE, OP_INC, AM_ABS_X, 2, 7) /* INC abs, X */ \
+	X(0xFF, OP_NOP, AM_IMP, 0, 1) /* NOP */
+
+// Fused Idioms -- F(idiom, first opcode, second opcode, name)
+// Hot pairs of instructions run by a single handler (table and threaded dispatch, through the Decoded Instruction Cache)
+#define MOS65C02_IDIOMS(F) \
+	F(IDIOM_DEX_BNE, 0xCA, 0xD0, "DEX/BNE") \
+	F(IDIOM_DEY_BNE, 0x88, 0xD0, "DEY/BNE") \
+	F(IDIOM_COPY_IND_Y, 0xB1, 0x91, "LDA/STA (zpg),Y") \
+	F(IDIOM_CMP_BEQ, 0xC9, 0xF0, "CMP #imm/BEQ") \
+	F(IDIOM_INC_BNE, 0xE6, 0xD0, "INC zpg/BNE")
+
+#define IDIOM_ENUM(idiom, first, second, name) idiom,
+enum { MOS65C02_IDIOMS(IDIOM_ENUM) IDIOM_COUNT };
+#undef IDIOM_ENUM
 
 // MOS Technology 65C02
 class MOS65C02 {
@@ -14,7 +316,7 @@ public:
 	byte AC = 0; // Accumulator Register
 	byte X = 0; // Register X
 	byte Y = 0; // Register Y
-	byte SR = 0; //Status Register
+	byte SR = 0; //Status Register -- N and Z are kept in NZ while running, read and write it with GetSR/SetSR
 	word PC = 0; // Program Counter -- Address of the next instruction
 	byte SP = 0; // Stack Pointer -- Used as an offset from address 0x100 (Points from $100 to $1FF) -- ie Page 1
 	byte IR = 0; // Instruction Register
@@ -22,61 +324,98 @@ public:
 	int Cycles = 0; // CPU cycles availiable
 	const int CLOCK_SPEED = 4000000; // CPU Clock Speed in Cycles
 	ushort Address = 0; // Full memory address to be used by the instruction
+	unsigned long long Instructions = 0; // Instructions retired
+	int BreakPC = -1; // Run() stops before the instruction at this address (-1: never)
+	bool Fusion = true; // Run hot idioms with fused handlers (cleared by -no-fusion)
+	unsigned long long FusedHits[IDIOM_COUNT] = {}; // Idioms run whole by their fused handler
+	bool IdleSkip = true; // Fast-forward idle loops to the end of the slice (cleared by -no-idle-skip)
+	unsigned long long IdleSkips = 0; // Idle loops fast-forwarded
+	unsigned long long IdleCycles = 0; // Cycles credited by fast-forwarding
+	int IdleFirst = -1, IdleLast = -1; // Addresses of the last loop fast-forwarded, target to branch (-1: none)
+	bool Waiting = false; // WAI -- sleeping until IRQ, NMI or RES is asserted
+	bool Stopped = false; // STP -- halted until RES is asserted
+	unsigned long long SleepCycles = 0; // Cycles spent in WAI or STP
+	static const char* const IdiomNames[IDIOM_COUNT];
+
+	MOS65C02(Board& board) : Memory(board.Memory), bus(board.bus), icache(board.icache), viaOne(board.viaOne), Lines(board.Lines) {}
 
 private:
+	// Board
+	byte* const Memory;
+	MemoryBus& bus;
+	DecodeCache& icache;
+	VIA6522& viaOne;
+	std::atomic<unsigned int>& Lines; // RES, NMI and IRQ lines
+
 	// Internal Variables
 	uchar page = 0; // Page where last byte of the instruction occured -- used for reference in instructions that take an additional cycle when page boundary gets crossed
 	uchar tmpVal = 0; // Temporary Value
+	word Operand = 0; // Bytes after the opcode of the current instruction (little-endian)
+	word NZ = 0; // Last result -- N: bit 7 or 15 set, Z: low byte is zero (SR's own N and Z bits are stale)
+	unsigned long long Stores = 0; // Bytes written by the CPU (memory and stack)
+
+	// Idle Loop -- state of the CPU the last time a backward branch or jump was taken
+	struct LoopPass {
+		int start = -1; // Branch target (-1: none yet)
+		word from = 0; // Address of the branch
+		byte AC = 0, X = 0, Y = 0, SR = 0, SP = 0;
+		word NZ = 0;
+		unsigned long long stores = 0;
+		unsigned long long instructions = 0;
+		int cycles = 0;
+	} loop;
+	static const int LOOP_SAMPLE = 16; // Backward branches between two idle loop checks (below the JIT's hot count, so idle loops are found before they are translated)
+	int loopCountdown = 1; // Backward branches left until the next check
 	const int ROM_RANGE[2] = { 0xC000,0xFFFF }; // Read-Only Memory (ROM) Range
 	
 	// --- ADDRESSING MODES ---
 	// Addressing Mode: (abs) "Indirect" -- $LLHH
 	word addr_ind() {
-		Address = (Memory[PC + 1] << 8) | Memory[PC];
+		Address = Operand;
 		return (Memory[Address + 1] << 8) | Memory[Address];
 	}
 	// Addressing Mode: zpg "Zero Page" -- $LL
 	byte addr_zpg() {
-		return Memory[PC];
+		return Operand & 0xFF;
 	}
 	// Addressing Mode: (zpg) "Zero Page, Indirect" -- ($LL)
 	word addr_zpg_ind() {
-		return (Memory[Memory[PC] + 1] << 8) | Memory[Memory[PC]];
+		return (Memory[(Operand & 0xFF) + 1] << 8) | Memory[Operand & 0xFF];
 	}
 	// Addressing Mode: (X,ind) "X-indexed, Indirect" -- ($LL,X)
 	word addr_x_ind() {
-		return (Memory[(Memory[PC] + X + 1) & 0xFF] << 8) | Memory[(Memory[PC] + X) & 0xFF];
+		return (Memory[(Operand + X + 1) & 0xFF] << 8) | Memory[(Operand + X) & 0xFF];
 	}
 	// Addressing Mode: abs "Absolute" -- $LLHH
 	word addr_abs() {
-		return (Memory[PC + 1] << 8) | Memory[PC];
+		return Operand;
 	}
 	// Addressing Mode: abs(ind,X) "Absolute, X-indexed, Indirect" -- ($LLHH,X)
 	void addr_abs_ind() {
 		page = (PC + 1) >> 8;
-		Address = ((Memory[PC + 1] << 8) | Memory[PC]) + X;
+		Address = Operand + X;
 		Address = (Memory[Address + 1] << 8) | Memory[Address];
 	}
 	// Addressing Mode: (ind),Y "Indirect, Y-indexed" -- ($LL),Y
 	void addr_ind_y() {
 		page = PC >> 8;
-		Address = ((Memory[Memory[PC] + 1] << 8) | Memory[Memory[PC]]) + Y;
+		Address = ((Memory[(Operand & 0xFF) + 1] << 8) | Memory[Operand & 0xFF]) + Y;
 		if (page != (Address >> 8)) {
 			Cycles--;
 		}
 	}
 	// Addressing Mode: zpg,X "Zero Page, X-indexed" -- $LL,X
 	word addr_zpg_x() {
-		return (Memory[PC] + X) & 0xFF;
+		return (Operand + X) & 0xFF;
 	}
 	// Addressing Mode: zpg,Y "Zero Page, Y-indexed" -- $LL,Y
 	word addr_zpg_y() {
-		return (Memory[PC] + Y) & 0xFF;
+		return (Operand + Y) & 0xFF;
 	}
 	// Addressing Mode: abs,Y "Absolute, Y-indexed" -- $LLHH,Y (Note: Page crossing affects cycle!)
 	void addr_abs_y() {
 		page = (PC + 1) >> 8;
-		Address = ((Memory[PC + 1] << 8) | Memory[PC]) + Y;
+		Address = Operand + Y;
 		if (page != (Address >> 8)) {
 			Cycles--;
 		}
@@ -84,7 +423,7 @@ private:
 	// Addressing Mode: abs,X "Absolute, X-indexed" -- $LLHH,X (Note: Page crossing affects cycle!)
 	void addr_abs_x() {
 		page = (PC + 1) >> 8;
-		Address = ((Memory[PC + 1] << 8) | Memory[PC]) + X;
+		Address = Operand + X;
 		if (page != (Address >> 8)) {
 			Cycles--;
 		}
@@ -93,93 +432,39 @@ private:
 	// --- ALU STUFF ---
 	// Read the value from a memory address
 	byte mem_read(ushort address) {
-		uchar ret = 0;
-		if (address >= viaOne.activationRange && address <= viaOne.activationRange + 0x0F) {
-			ret = viaOne.sendInstruction((address & 0x0F), 1, NULL);
-			return ret;
-		}
-		else if (address >= viaTwo.activationRange && address <= viaTwo.activationRange + 0x0F) {
-			ret = viaTwo.sendInstruction((address & 0x0F), 1, NULL);
-			return ret;
-		}
-		else if (address >= viaThree.activationRange && address <= viaThree.activationRange + 0x0F) {
-			ret = viaThree.sendInstruction((address & 0x0F), 1, NULL);
-			return ret;
-		}
-		else {
-			return Memory[address];
-		}
+		return bus.read(address);
 	}
 	// Store the value of a register to Memory
 	void mem_store(ushort address, uchar value) {
-		if (address >= viaOne.activationRange && address <= viaOne.activationRange + 0x0F) {
-			viaOne.sendInstruction((address & 0x0F), 0, value);
-		}
-		else if (address >= viaTwo.activationRange && address <= viaTwo.activationRange + 0x0F) {
-			viaTwo.sendInstruction((address & 0x0F), 0, value);
-			if (viaTwo.PA != 0) {
-				ssd.latchAndSetUp(viaTwo.PA, 0);
-				viaTwo.PA = 0;
-			}
-			else if (viaTwo.PB != 0) {
-				ssd.latchAndSetUp(viaTwo.PB, 1);
-				viaTwo.PB = 0;
-			}
-		}
-		else if (address >= viaThree.activationRange && address <= viaThree.activationRange + 0x0F) {
-			viaThree.sendInstruction((address & 0x0F), 0, value);
-			if (viaThree.PA != 0) {
-				if (ssd.latchAndSetUp(viaThree.PA, 2)) {
-					std::thread executeSSDInstruction(SSD_RW);
-					executeSSDInstruction.detach();
-				}
-				viaThree.PA = 0;
-			}
-		}
-		else {
-			Memory[Address] = value;
-		}
+		Stores++;
+		icache.invalidate(address);
+		bus.write(address, value);
 	}
-	// Checks if last bit is set
-	void check_negative(uchar value) {
+	// Set N and Z from a result (decimal mode clears N and costs a cycle)
+	void set_nz(uchar value) {
 		if ((SR & 0b00001000) != 0) {
-			SR = SR & 0b01111111;
+			NZ = (value != 0);
 			Cycles--;
 		}
 		else {
-			if ((value & 0b10000000) != 0) {
-				SR = SR | 0b10000000;
-			}
-			else {
-				SR = SR & 0b01111111;
-			}
+			NZ = value;
 		}
 	}
-	// Checks if all bits are zeroes
-	void check_zero(uchar value) {
-		if (value == 0) {
-			SR = SR | 0b00000010;
-		}
-		else {
-			SR = SR & 0b11111101;
-		}
+	// Set Z from a result, N is left as it is
+	void set_z(uchar value) {
+		NZ = (negative() ? 0x8000 : 0) | (value != 0);
 	}
-	// Addition with carry
+	bool negative() const {
+		return (NZ & 0x8080) != 0;
+	}
+	bool zero() const {
+		return (NZ & 0xFF) == 0;
+	}
+	// Addition with carry -- V: the sign of the result differs from AC's, C: carry out of bit 7
 	void addwcarry(uchar value) {
-		if ((AC < 0x80 && ((AC + value + (SR & 0b00000001)) & 0xFF) < 0x80) || (AC >= 0x80 && ((AC + value + (SR & 0b00000001)) & 0xFF) >= 0x80)) {
-			SR = SR & 0b10111111;
-		}
-		else {
-			SR = SR | 0b01000000;
-		}
-		if ((AC + value + (SR & 0b00000001)) > 0xFF) {
-			AC += (value + (SR & 0b00000001));
-			SR = SR | 0b00000001;
-		}
-		else {
-			AC += (value + (SR & 0b00000001));
-			SR = SR & 0b11111110;
-		}
+		unsigned int sum = AC + value + (SR & 0b00000001);
+		SR = (SR & 0b10111110) | (((AC ^ sum) & 0b10000000) >> 1) | (sum > 0xFF);
+		AC = sum & 0xFF;
 
 		if ((SR & 0b00001000) != 0) {
 			if ((AC & 0b00001111) > 9) {
@@ -197,22 +482,12 @@ private:
 			}
 		}
 	}
-	// Subtract with carry
+	// Subtract with carry -- V: the sign of the result differs from AC's, C: value + carry is greater than AC
 	void subwcarry(uchar value) {
-		if ((AC < 0x80 && ((AC - value - (SR & 0b00000001)) & 0xFF) < 0x80) || (AC >= 0x80 && ((AC - value - (SR & 0b00000001)) & 0xFF) >= 0x80)) {
-			SR = SR & 0b10111111;
-		}
-		else {
-			SR = SR | 0b01000000;
-		}
-		if (((value + (SR & 0b00000001)) & 0x1FF) > AC) {
-			AC -= (value + (SR & 0b00000001));
-			SR = SR | 0b00000001;
-		}
-		else {
-			AC -= (value + (SR & 0b00000001));
-			SR = SR & 0b11111110;
-		}
+		unsigned int subtrahend = value + (SR & 0b00000001);
+		byte result = AC - subtrahend;
+		SR = (SR & 0b10111110) | (((AC ^ result) & 0b10000000) >> 1) | (subtrahend > AC);
+		AC = result;
 
 		if ((SR & 0b00001000) != 0) {
 			if ((AC & 0b00001111) > 9) {
@@ -232,119 +507,187 @@ private:
 	}
 	// Rotate Right
 	void ror(ushort address) {
-		if ((tmpVal & 0b00000001) == 0) {
-			tmpVal = (tmpVal >> 1) | ((SR & 0b00000001) << 7);
-			SR = SR & 0b11111110;
-		}
-		else {
-			tmpVal = (tmpVal >> 1) | ((SR & 0b00000001) << 7);
-			SR = SR | 0b00000001;
-		}
+		byte carry = tmpVal & 0b00000001;
+		tmpVal = (tmpVal >> 1) | ((SR & 0b00000001) << 7);
+		SR = (SR & 0b11111110) | carry;
 		mem_store(address, tmpVal);
 	}
 	// Rotate Left
 	void rol(ushort address) {
-		if (((tmpVal << 1) & 0xFF) >= tmpVal) {
-			tmpVal = (tmpVal << 1) | (SR & 0b00000001);
-			SR = SR & 0b11111110;
-		}
-		else {
-			tmpVal = (tmpVal << 1) | (SR & 0b00000001);
-			SR = SR | 0b00000001;
-		}
+		byte carry = tmpVal >> 7;
+		tmpVal = (tmpVal << 1) | (SR & 0b00000001);
+		SR = (SR & 0b11111110) | carry;
 		mem_store(address, tmpVal);
 	}
 	// Arithmetic Shift Left
 	void asl(ushort address) {
-		if (((tmpVal << 1) & 0xFF) >= tmpVal) {
-			SR = SR & 0b11111110;
-		}
-		else {
-			SR = SR | 0b00000001;
-		}
+		SR = (SR & 0b11111110) | (tmpVal >> 7);
 		tmpVal = tmpVal << 1;
 		mem_store(address, tmpVal);
 	}
 	// Logical Shift Right
 	void lsr(ushort address) {
-		if ((tmpVal & 0b00000001) == 0) {
-			SR = SR & 0b11111110;
-		}
-		else {
-			SR = SR | 0b00000001;
-		}
+		SR = (SR & 0b11111110) | (tmpVal & 0b00000001);
 		tmpVal = tmpVal >> 1;
 		mem_store(address, tmpVal);
 	}
-	// Compare Register with Memory
+	// Compare Register with Memory -- C: reg >= value, Z: reg == value, N: reg < value
 	void compare(uchar reg, ushort address) {
 		uchar value = mem_read(address);
-		if (reg >= value) {
-			SR = SR | 0b00000001;
-		}
-		else {
-			SR = SR & 0b11111110;
-		}
-		if (reg == value) {
-			SR = SR | 0b00000010;
-		}
-		else {
-			SR = SR & 0b11111101;
-		}
-		if (reg < value) {
-			SR = SR | 0b10000000;
-		}
-		else {
-			SR = SR & 0b01111111;
-		}
+		SR = (SR & 0b11111110) | (reg >= value);
+		NZ = (reg < value) ? 0x80 : (reg != value);
 	}
 	// Push 8-bit value to the stack
 	void push(uchar value) {
+		Stores++;
 		SP--;
+		icache.invalidate(0x100 | SP);
 		Memory[0x100 | SP] = value;
 	}
 
 	// Pull 8-bit value from the stack
 	byte pull() {
 		uchar value = Memory[0b100000000 | SP];
+		icache.invalidate(0b100000000 | SP);
 		Memory[0b100000000 | SP] = 0;
+		Stores++;
 		SP++;
 		return value;
 	}
+	// A backward branch or jump was taken (every LOOP_SAMPLE-th one) -- the CPU state is saved, and the next backward
+	// branch compares against it. If it is the same branch, and the pass in between stored nothing and left every register
+	// as it was, the next passes are the same until an interrupt or another thread changes what the loop reads (a key, an
+	// SSD transfer). They are skipped in one go, leaving a pass or two before the end of the slice to run as usual.
+	void LoopBack(word from, word target) {
+		loopCountdown = LOOP_SAMPLE;
+		if (loop.start == -1) {
+			loop.start = target;
+			loop.from = from;
+			loop.AC = AC;
+			loop.X = X;
+			loop.Y = Y;
+			loop.SR = SR;
+			loop.SP = SP;
+			loop.NZ = NZ;
+			loop.stores = Stores;
+			loop.instructions = Instructions;
+			loop.cycles = Cycles;
+			loopCountdown = 1; // <- Compare on the next one
+			return;
+		}
+		bool same = target == loop.start && from == loop.from;
+		loop.start = -1;
+		if (!same) {
+			return;
+		}
+		if (Stores != loop.stores || AC != loop.AC || X != loop.X || Y != loop.Y || SR != loop.SR || SP != loop.SP || NZ != loop.NZ) {
+			if (target == IdleFirst && from == IdleLast) {
+				IdleFirst = IdleLast = -1; // <- Not idle anymore
+			}
+			return;
+		}
+		int cycles = loop.cycles - Cycles; // <- Cycles of a pass (the branch is charged at the same point every time)
+		bool pending = Pending();
+		if (BreakPC == -1 && !pending && cycles > 0 && Cycles >= 2 * cycles) {
+			int passes = Cycles / cycles - 1;
+			Cycles -= passes * cycles;
+			Instructions += passes * (Instructions - loop.instructions);
+			IdleCycles += (unsigned long long)passes * cycles;
+			IdleSkips++;
+			IdleFirst = target;
+			IdleLast = from;
+		}
+	}
 public:
 	// Initiate Reset Sequence for MOS65C02
 	void reset() {
-		SR = 0b00100100;
+		SetSR(0b00100100);
 		AC = X = Y = 0;
 		SP = 0xFF;
 		PC = (Memory[0xFFFD] << 8) | Memory[0xFFFC]; // <- Setting PC to address of the Reset Vector (RES)
-		RES = true;
+		Lines.fetch_and(~LINE_RES, std::memory_order_relaxed);
+		Waiting = Stopped = false;
 		Cycles -= 7;
 	}
 
+	// Drop the idle loop snapshot -- the cycle budget was refilled or code ran outside the interpreter (JIT)
+	void ForgetLoop() {
+		loop.start = -1;
+	}
+
+	// Status Register with N and Z built from the last result
+	byte GetSR() const {
+		return (SR & 0b01111101) | (negative() ? 0b10000000 : 0) | (zero() ? 0b00000010 : 0);
+	}
+
+	void SetSR(byte value) {
+		SR = value;
+		NZ = ((value & 0b10000000) << 8) | ((value & 0b00000010) == 0);
+	}
+
 	// Fetch instruction to be executed
 	void FetchInstruction() {
-		IR = Memory[PC];
-		PC++;
+		if (icache.enabled) {
+			if (icache.pending()) {
+				icache.sync();
+			}
+			FetchDecoded();
+		}
+		else {
+			IR = Memory[PC];
+			Operand = (Memory[(word)(PC + 2)] << 8) | Memory[(word)(PC + 1)];
+			PC++;
+			Instructions++;
+		}
 	}
 
-	// Checks if there are hardware interrupts occurring
+	// Checks if there are hardware interrupts occurring (1: IRQ taken, 2: NMI taken, 3: reset pending -- the run has to end)
+	// A single relaxed load when no line is asserted, the lines are only looked at (with acquire) when one is.
 	uchar CheckInterrupts() {
+		unsigned int lines = Lines.load(std::memory_order_relaxed);
+		if (lines == 0) {
+			return 0;
+		}
+		return TakeInterrupt(lines);
+	}
+
+	// An interrupt would be taken, or a reset is pending (the run ends before the next instruction)
+	bool Pending() const {
+		unsigned int lines = Lines.load(std::memory_order_relaxed);
+		return (lines & ~LINE_IRQ) != 0 || ((lines & LINE_IRQ) != 0 && (SR & 0b00000100) == 0);
+	}
+
+	bool Resetting() const {
+		return (Lines.load(std::memory_order_relaxed) & LINE_RES) != 0;
+	}
+
+private:
+	uchar TakeInterrupt(unsigned int lines) {
+		std::atomic_thread_fence(std::memory_order_acquire); // <- What the device wrote before asserting its line
+		if ((lines & LINE_RES) != 0) {
+			return 3;
+		}
 		// Interrupt Request from the IRQ pin
-		if (((SR & 0b00000100) == 0) && (IRQ == false)) {
+		if (((SR & 0b00000100) == 0) && (lines & LINE_IRQ) != 0) {
+			if (icache.pending()) { // <- The handler may run code a DMA transfer has just loaded
+				icache.sync();
+			}
 			push(PC >> 8);
 			push(PC & 0xFF);
-			push((SR | 0b00100000) & 0b11101111);
+			push((GetSR() | 0b00100000) & 0b11101111);
 			SR = SR | 0b00000100;
 			PC = (Memory[0xFFFF] << 8) | Memory[0xFFFE];
 			Cycles -= 7;
 			return 1;
 		}
 		// Interrupt Request from the NMI pin
-		if (NMI == false) {
+		if ((lines & LINE_NMI) != 0) {
+			if (icache.pending()) {
+				icache.sync();
+			}
 			push(PC >> 8);
 			push(PC & 0xFF);
-			push((SR | 0b00100000) & 0b11101111);
+			push((GetSR() | 0b00100000) & 0b11101111);
 			SR = SR | 0b00000100;
 			PC = (Memory[0xFFFB] << 8) | Memory[0xFFFA];
 			Cycles -= 7;
@@ -353,739 +696,194 @@ public:
 		return 0;
 	}
 
-	// Execute fetched instruction
-	void Execute() {
-		Address = page = 0;
+public:
+	// --- DISPATCH ---
+	typedef void (*Handler)(MOS65C02& cpu);
+	static const Handler HandlerTable[256]; // <- Filled from MOS65C02_OPCODES (below the class)
 
-		switch (IR) {
-			case 0x00: // BRK
-				push((PC + 1) >> 8);
-				push((PC + 1) & 0xFF);
-				push(SR | 0b00110000);
-				PC = (Memory[0xFFFF] << 8) | Memory[0xFFFE];
-				Cycles -= 7;
-				break;
-			case 0x01: // ORA X, ind
-				Address = addr_x_ind();
-				AC = AC | mem_read(Address);
-				check_negative(AC);
-				check_zero(AC);
-				PC++;
-				Cycles -= 6;
-				break;
-			case 0x02: // NOP
-				PC++;
-				Cycles -= 2;
-				break;
-			case 0x03: // NOP
-				Cycles -= 1;
-				break;
-			case 0x04: // TSB zpg
-				Address = addr_abs();
-				tmpVal = mem_read(Address);
-				check_zero(AC & tmpVal);
-				mem_store(Address, (tmpVal | AC));
-				PC++;
-				Cycles -= 5;
-				break;
-			case 0x05: // ORA zpg
-				Address = addr_zpg();
-				AC = AC | mem_read(Address);
-				check_negative(AC);
-				check_zero(AC);
-				PC++;
-				Cycles -= 3;
-				break;
-			case 0x06: // ASL zpg
-				Address = addr_zpg();
-				tmpVal = mem_read(Address);
-				asl(Address);
-				check_negative(tmpVal);
-				check_zero(tmpVal);
-				PC++;
-				Cycles -= 5;
-				break;
-			case 0x07: // NOP
-				Cycles -= 1;
-				break;
-			case 0x08: // PHP
-				push(SR | 0b00110000);
-				Cycles -= 3;
-				break;
-			case 0x09: // ORA immediate
-				AC = AC | Memory[PC]; Address = PC;
-				check_negative(AC);
-				check_zero(AC);
-				PC++;
-				Cycles -= 2;
-				break;
-			case 0x0A: // ASL A
-				if (((AC << 1) & 0xFF) >= AC) {
-					SR = SR & 0b11111110;
-				}
-				else {
-					SR = SR | 1;
+	// Fetch an instruction through the Decoded Instruction Cache (decoding it on a miss), returns its entry
+	DecodedInstruction& FetchDecoded() {
+		DecodedInstruction& entry = icache.lookup(PC);
+		if (entry.handler == NULL) {
+			icache.fill(PC, Memory[PC], (Memory[(word)(PC + 2)] << 8) | Memory[(word)(PC + 1)], HandlerTable[Memory[PC]]);
+			if (Fusion) {
+				FuseIdiom(PC);
+			}
+		}
+		IR = entry.opcode;
+		Operand = entry.operand;
+		PC++;
+		Instructions++;
+		return entry;
+	}
+
+private:
+	// Opcode Table columns, indexed by opcode (fused handlers are built from them at compile time)
+	struct OpcodeRow {
+		uchar op, mode, len, cyc;
+	};
+#define OPCODE_ROW(code, op, mode, len, cyc) { op, mode, len, cyc },
+	static constexpr OpcodeRow Rows[256] = { MOS65C02_OPCODES(OPCODE_ROW) };
+#undef OPCODE_ROW
+
+	// Give the entry of an address the fused handler of the idiom starting there, if any
+	void FuseIdiom(word address) {
+#define IDIOM_MATCH(idiom, first, second, name) \
+		if (Memory[address] == first && Memory[(word)(address + Rows[first].len + 1)] == second) { \
+			icache.fuse(address, Memory[(word)(address + Rows[first].len + 2)], &Fused<first, second, idiom>); \
+			return; \
+		}
+		MOS65C02_IDIOMS(IDIOM_MATCH)
+#undef IDIOM_MATCH
+	}
+
+public:
+
+	// Effective address of an Addressing Mode
+	template <uchar MODE>
+	word EffectiveAddress() {
+		switch (MODE) {
+			case AM_IMM: return PC;
+			case AM_ZPG: return addr_zpg();
+			case AM_ZPG_X: return addr_zpg_x();
+			case AM_ZPG_Y: return addr_zpg_y();
+			case AM_ABS: return addr_abs();
+			case AM_ABS_X: addr_abs_x(); return Address;
+			case AM_ABS_X_NP: return Operand + X;
+			case AM_ABS_Y: addr_abs_y(); return Address;
+			case AM_ABS_Y_NP: return Operand + Y;
+			case AM_IND: return addr_ind();
+			case AM_ABS_IND: addr_abs_ind(); return Address;
+			case AM_X_IND: return addr_x_ind();
+			case AM_IND_Y: addr_ind_y(); return Address;
+			case AM_IND_Y_NP: return ((Memory[(Operand & 0xFF) + 1] << 8) | Memory[Operand & 0xFF]) + Y;
+			case AM_ZPG_IND: return addr_zpg_ind();
+		}
+		return 0;
+	}
+
+	// Operand of a read instruction (immediate values come straight from the instruction stream)
+	template <uchar MODE>
+	byte ReadOperand() {
+		Address = EffectiveAddress<MODE>();
+		return (MODE == AM_IMM) ? (byte)(Operand & 0xFF) : mem_read(Address);
+	}
+
+	// Branch condition of a branch instruction
+	template <uchar OP>
+	bool BranchTaken() {
+		switch (OP) {
+			case OP_BPL: return !negative();
+			case OP_BMI: return negative();
+			case OP_BVC: return (SR & 0b01000000) == 0;
+			case OP_BVS: return (SR & 0b01000000) != 0;
+			case OP_BCC: return (SR & 0b00000001) == 0;
+			case OP_BCS: return (SR & 0b00000001) != 0;
+			case OP_BNE: return !zero();
+			case OP_BEQ: return zero();
+		}
+		return true; // <- BRA
+	}
+
+	// Execute an Operation with an Addressing Mode
+	template <uchar OP, uchar MODE>
+	void Operation() {
+		switch (OP) {
+			// Read
+			case OP_ORA: AC = AC | ReadOperand<MODE>(); set_nz(AC); break;
+			case OP_AND: AC = AC & ReadOperand<MODE>(); set_nz(AC); break;
+			case OP_EOR: AC = AC ^ ReadOperand<MODE>(); set_nz(AC); break;
+			case OP_ADC: addwcarry(ReadOperand<MODE>()); set_nz(AC); break;
+			case OP_SBC: subwcarry(ReadOperand<MODE>()); set_nz(AC); break;
+			case OP_LDA: AC = ReadOperand<MODE>(); set_nz(AC); break;
+			case OP_LDX: X = ReadOperand<MODE>(); set_nz(X); break;
+			case OP_LDY: Y = ReadOperand<MODE>(); set_nz(Y); break;
+			case OP_CMP: Address = EffectiveAddress<MODE>(); compare(AC, Address); break;
+			case OP_CPX: Address = EffectiveAddress<MODE>(); compare(X, Address); break;
+			case OP_CPY: Address = EffectiveAddress<MODE>(); compare(Y, Address); break;
+			case OP_BIT:
+				tmpVal = ReadOperand<MODE>();
+				if (MODE != AM_IMM) { // <- BIT immediate only affects Z
+					NZ = NZ | ((tmpVal & 0b10000000) << 8);
+					SR = SR | (tmpVal & 0b01000000);
 				}
+				set_z(AC & tmpVal);
+				break;
+			// Write
+			case OP_STA: Address = EffectiveAddress<MODE>(); mem_store(Address, AC); break;
+			case OP_STX: Address = EffectiveAddress<MODE>(); mem_store(Address, X); break;
+			case OP_STY: Address = EffectiveAddress<MODE>(); mem_store(Address, Y); break;
+			case OP_STZ: Address = EffectiveAddress<MODE>(); mem_store(Address, 0x00); break;
+			// Read-Modify-Write
+			case OP_ASL: Address = EffectiveAddress<MODE>(); tmpVal = mem_read(Address); asl(Address); set_nz(tmpVal); break;
+			case OP_ROL: Address = EffectiveAddress<MODE>(); tmpVal = mem_read(Address); rol(Address); set_nz(tmpVal); break;
+			case OP_ROR: Address = EffectiveAddress<MODE>(); tmpVal = mem_read(Address); ror(Address); set_nz(tmpVal); break;
+			case OP_LSR: Address = EffectiveAddress<MODE>(); tmpVal = mem_read(Address); lsr(Address); NZ = tmpVal; break; // <- N is always clear
+			case OP_INC: Address = EffectiveAddress<MODE>(); tmpVal = mem_read(Address) + 1; mem_store(Address, tmpVal); set_nz(tmpVal); break;
+			case OP_DEC: Address = EffectiveAddress<MODE>(); tmpVal = mem_read(Address) - 1; mem_store(Address, tmpVal); set_nz(tmpVal); break;
+			case OP_TSB: Address = EffectiveAddress<MODE>(); tmpVal = mem_read(Address); set_z(AC & tmpVal); mem_store(Address, (tmpVal | AC)); break;
+			case OP_TRB: Address = EffectiveAddress<MODE>(); tmpVal = mem_read(Address); set_z(AC & tmpVal); mem_store(Address, (tmpVal & (AC ^ 0xFF))); break;
+			// Accumulator
+			case OP_ASL_A:
+				SR = (SR & 0b11111110) | (AC >> 7);
 				AC = AC << 1;
-				check_negative(AC);
-				check_zero(AC);
-				Cycles -= 2;
-				break;
-			case 0x0B: // NOP
-				Cycles -= 1;
-				break;
-			case 0x0C: // TSB abs
-				Address = addr_abs();
-				tmpVal = mem_read(Address);
-				check_zero(AC & tmpVal);
-				mem_store(Address, (tmpVal | AC));
-				PC += 2;
-				Cycles -= 6;
-				break;
-			case 0x0D: // ORA abs
-				Address = addr_abs();
-				AC = AC | mem_read(Address);
-				check_negative(AC);
-				check_zero(AC);
-				PC += 2;
-				Cycles -= 4;
-				break;
-			case 0x0E: // ASL abs
-				Address = addr_abs();
-				tmpVal = mem_read(Address);
-				asl(Address);
-				check_negative(tmpVal);
-				check_zero(tmpVal);
-				PC += 2;
-				Cycles -= 6;
-				break;
-			case 0x0F: // NOP
-				Cycles -= 1;
-				break;
-			case 0x10: // BPL
-				if ((SR & 0b10000000) == 0) {
-					page = PC >> 8;
-					PC = PC + signed char(Memory[PC]);
-				}
-				PC++; Address = PC;
-				if ((PC >> 8) != page) {
-					Cycles -= 2;
-				}
-				else {
-					Cycles--;
-				}
-				Cycles -= 2;
-				break;
-			case 0x11: // ORA ind, Y
-				addr_ind_y();
-				AC = AC | mem_read(Address);
-				check_negative(AC);
-				check_zero(AC);
-				PC++;
-				Cycles -= 5;
-				break;
-			case 0x12: // ORA (zpg)
-				Address = addr_zpg_ind();
-				AC = AC | mem_read(Address);
-				check_negative(AC);
-				check_zero(AC);
-				PC++;
-				Cycles -= 5;
-				break;
-			case 0x13: // NOP
-				Cycles -= 1;
-				break;
-			case 0x14: // TRB zpg
-				Address = addr_zpg();
-				tmpVal = mem_read(Address);
-				check_zero(AC & tmpVal);
-				mem_store(Address, (tmpVal & (AC ^ 0xFF)));
-				PC++;
-				Cycles -= 5;
-				break;
-			case 0x15: // ORA zpg, X
-				Address = addr_zpg_x();
-				AC = AC | mem_read(Address);
-				check_negative(AC);
-				check_zero(AC);
-				PC++;
-				Cycles -= 4;
-				break;
-			case 0x16: // ASL zpg, X
-				Address = addr_zpg_x();
-				tmpVal = mem_read(Address);
-				asl(Address);
-				check_negative(tmpVal);
-				check_zero(tmpVal);
-				PC++;
-				Cycles -= 6;
-				break;
-			case 0x17: // NOP
-				Cycles -= 1;
-				break;
-			case 0x18: // CLC
-				SR = SR & 0b11111110;
-				Cycles -= 2;
-				break;
-			case 0x19: // ORA abs, Y
-				addr_abs_y();
-				AC = AC | mem_read(Address);
-				check_negative(AC);
-				check_zero(AC);
-				PC += 2;
-				Cycles -= 4;
-				break;
-			case 0x1A: // INA
-				AC++;
-				check_negative(AC);
-				check_zero(AC);
-				Cycles -= 2;
-				break;
-			case 0x1B: // NOP
-				Cycles -= 1;
-				break;
-			case 0x1C: // TRB abs
-				Address = addr_abs();
-				tmpVal = mem_read(Address);
-				check_zero(AC & tmpVal);
-				mem_store(Address, (tmpVal & (AC ^ 0xFF)));
-				PC += 2;
-				Cycles -= 6;
-				break;
-			case 0x1D: // ORA abs, X
-				addr_abs_x();
-				AC = AC | mem_read(Address);
-				check_negative(AC);
-				check_zero(AC);
-				PC += 2;
-				Cycles -= 4;
-				break;
-			case 0x1E: // ASL abs, X
-				Address = ((Memory[PC + 1] << 8) | Memory[PC]) + X; // <- Page boundary crossing does not affect this instruction
-				tmpVal = mem_read(Address);
-				asl(Address);
-				check_negative(tmpVal);
-				check_zero(tmpVal);
-				PC += 2;
-				Cycles -= 7;
-				break;
-			case 0x1F: // NOP
-				Cycles -= 1;
-				break;
-			case 0x20: // JSR
-				push((PC + 2) >> 8);
-				push((PC + 2) & 0xFF);
-				Address = PC = addr_abs();
-				Cycles -= 6;
-				break;
-			case 0x21: // AND X, ind
-				Address = addr_x_ind();
-				AC = AC & mem_read(Address);
-				check_negative(AC);
-				check_zero(AC);
-				PC++;
-				Cycles -= 6;
-				break;
-			case 0x22: // NOP
-				PC++;
-				Cycles -= 2;
-				break;
-			case 0x23: // NOP
-				Cycles -= 1;
-				break;
-			case 0x24: // BIT zpg
-				Address = addr_zpg();
-				tmpVal = mem_read(Address);
-				SR = SR | (tmpVal & 0b10000000);
-				SR = SR | (tmpVal & 0b01000000);
-				check_zero(AC & tmpVal);
-				PC++;
-				Cycles -= 3;
-				break;
-			case 0x25: // AND zpg
-				Address = addr_zpg();
-				AC = AC & mem_read(Address);
-				check_negative(AC);
-				check_zero(AC);
-				PC++;
-				Cycles -= 3;
-				break;
-			case 0x26: // ROL zpg
-				Address = addr_zpg();
-				tmpVal = mem_read(Address);
-				rol(Address);
-				check_negative(tmpVal);
-				check_zero(tmpVal);
-				PC++;
-				Cycles -= 5;
-				break;
-			case 0x27: // NOP
-				Cycles -= 1;
-				break;
-			case 0x28: // PLP
-				SR = pull() & 0b11001111;
-				Cycles -= 4;
-				break;
-			case 0x29: // AND immediate
-				AC = AC & Memory[PC]; Address = PC;
-				check_negative(AC);
-				check_zero(AC);
-				PC++;
-				Cycles -= 2;
-				break;
-			case 0x2A: // ROL A
-				if (((AC << 1) & 0xFF) >= AC) {
-					AC = (AC << 1) | (SR & 0b00000001);
-					SR = SR & 0b11111110;
-				}
-				else {
-					AC = (AC << 1) | (SR & 0b00000001);
-					SR = SR | 0b00000001;
-				}
-				check_negative(AC);
-				check_zero(AC);
-				Cycles -= 2;
-				break;
-			case 0x2B: // NOP
-				Cycles -= 1;
-				break;
-			case 0x2C: // BIT abs
-				Address = addr_abs();
-				tmpVal = mem_read(Address);
-				SR = SR | (tmpVal & 0b10000000);
-				SR = SR | (tmpVal & 0b01000000);
-				check_zero(AC & tmpVal);
-				PC += 2;
-				Cycles -= 4;
-				break;
-			case 0x2D: // AND abs
-				Address = addr_abs();
-				AC = AC & mem_read(Address);
-				check_negative(AC);
-				check_zero(AC);
-				PC += 2;
-				Cycles -= 4;
-				break;
-			case 0x2E: // ROL abs
-				Address = addr_abs();
-				tmpVal = mem_read(Address);
-				rol(Address);
-				check_negative(tmpVal);
-				check_zero(tmpVal);
-				PC += 2;
-				Cycles -= 6;
+				set_nz(AC);
 				break;
-			case 0x2F: // NOP
-				Cycles -= 1;
-				break;
-			case 0x30: // BMI
-				if ((SR & 0b10000000) != 0) {
-					page = PC >> 8;
-					PC = PC + signed char(Memory[PC]);
-				}
-				PC++; Address = PC;
-				if ((PC >> 8) != page) {
-					Cycles -= 2;
-				}
-				else {
-					Cycles--;
-				}
-				Cycles -= 2;
-				break;
-			case 0x31: // AND ind, Y
-				addr_ind_y();
-				AC = AC & mem_read(Address);
-				check_negative(AC);
-				check_zero(AC);
-				PC++;
-				Cycles -= 5;
-				break;
-			case 0x32: // AND (zpg)
-				Address = addr_zpg_ind();
-				AC = AC & mem_read(Address);
-				check_negative(AC);
-				check_zero(AC);
-				PC++;
-				Cycles -= 5;
-				break;
-			case 0x33: // NOP
-				Cycles -= 1;
-				break;
-			case 0x34: // BIT zpg,X
-				Address = addr_zpg_x();
-				tmpVal = mem_read(Address);
-				SR = SR | (tmpVal & 0b10000000);
-				SR = SR | (tmpVal & 0b01000000);
-				check_zero(AC & tmpVal);
-				PC++;
-				Cycles -= 4;
-				break;
-			case 0x35: // AND zpg, X
-				Address = addr_zpg_x();
-				AC = AC & mem_read(Address);
-				check_negative(AC);
-				check_zero(AC);
-				PC++;
-				Cycles -= 4;
-				break;
-			case 0x36: // ROL zpg, X
-				Address = addr_zpg_x();
-				tmpVal = mem_read(Address);
-				rol(Address);
-				check_negative(tmpVal);
-				check_zero(tmpVal);
-				PC++;
-				Cycles -= 6;
-				break;
-			case 0x37: // NOP
-				Cycles -= 1;
-				break;
-			case 0x38: // SEC
-				SR = SR | 0b00000001;
-				Cycles -= 2;
-				break;
-			case 0x39: // AND abs, Y
-				addr_abs_y();
-				AC = AC & mem_read(Address);
-				check_negative(AC);
-				check_zero(AC);
-				PC += 2;
-				Cycles -= 4;
-				break;
-			case 0x3A: // DEA
-				AC--;
-				check_negative(AC);
-				check_zero(AC);
-				Cycles -= 2;
-				break;
-			case 0x3B: // NOP
-				Cycles -= 1;
-				break;
-			case 0x3C: // BIT abs,X
-				addr_abs_x();
-				tmpVal = mem_read(Address);
-				SR = SR | (tmpVal & 0b10000000);
-				SR = SR | (tmpVal & 0b01000000);
-				check_zero(AC & tmpVal);
-				PC += 2;
-				Cycles -= 4;
-				break;
-			case 0x3D: // AND abs, X
-				addr_abs_x();
-				AC = AC & mem_read(Address);
-				check_negative(AC);
-				check_zero(AC);
-				PC += 2;
-				Cycles -= 4;
-				break;
-			case 0x3E: // ROL abs, X
-				Address = ((Memory[PC + 1] << 8) | Memory[PC]) + X; // <- Page boundary crossing does not affect this instruction
-				tmpVal = mem_read(Address);
-				rol(Address);
-				check_negative(tmpVal);
-				check_zero(tmpVal);
-				PC += 2;
-				Cycles -= 7;
-				break;
-			case 0x3F: // NOP
-				Cycles -= 1;
-				break;
-			case 0x40: // RTI
-				SR = pull() & 0b11001111;
-				Address = PC = pull() | (pull() << 8);
-				Cycles -= 6;
-				IRQ = viaOne.checkInterrupt();
-				break;
-			case 0x41: // EOR X, ind
-				Address = addr_x_ind();
-				AC = AC ^ mem_read(Address);
-				check_negative(AC);
-				check_zero(AC);
-				PC++;
-				Cycles -= 6;
-				break;
-			case 0x42: // NOP
-				PC++;
-				Cycles -= 2;
-				break;
-			case 0x43: // NOP
-				Cycles -= 1;
-				break;
-			case 0x44: // NOP
-				PC++;
-				Cycles -= 3;
-				break;
-			case 0x45: // EOR zpg
-				Address = addr_zpg();
-				AC = AC ^ mem_read(Address);
-				check_negative(AC);
-				check_zero(AC);
-				PC++;
-				Cycles -= 3;
-				break;
-			case 0x46: // LSR zpg
-				Address = addr_zpg();
-				tmpVal = mem_read(Address);
-				lsr(Address);
-				check_zero(tmpVal);
-				SR = SR & 0b01111111;
-				PC++;
-				Cycles -= 5;
-				break;
-			case 0x47: // NOP
-				Cycles -= 1;
-				break;
-			case 0x48: // PHA
-				push(AC);
-				Cycles -= 3;
-				break;
-			case 0x49: // EOR immediate
-				AC = AC ^ Memory[PC]; Address = PC;
-				check_negative(AC);
-				check_zero(AC);
-				PC++;
-				Cycles -= 2;
-				break;
-			case 0x4A: // LSR A
-				if ((AC & 0b00000001) == 0) {
-					SR = SR & 0b11111110;
-				}
-				else {
-					SR = SR | 1;
-				}
+			case OP_LSR_A:
+				SR = (SR & 0b11111110) | (AC & 0b00000001);
 				AC = AC >> 1;
-				check_zero(AC);
-				SR = SR & 0b01111111;
-				Cycles -= 2;
-				break;
-			case 0x4B: // NOP
-				Cycles -= 1;
-				break;
-			case 0x4C: // JMP abs
-				Address = PC = addr_abs();
-				Cycles -= 3;
-				break;
-			case 0x4D: // EOR abs
-				Address = addr_abs();
-				AC = AC ^ mem_read(Address);
-				check_negative(AC);
-				check_zero(AC);
-				PC += 2;
-				Cycles -= 4;
-				break;
-			case 0x4E: // LSR abs
-				Address = addr_abs();
-				tmpVal = mem_read(Address);
-				lsr(Address);
-				check_zero(tmpVal);
-				SR = SR & 0b01111111;
-				PC += 2;
-				Cycles -= 6;
-				break;
-			case 0x4F: // NOP
-				Cycles -= 1;
-				break;
-			case 0x50: // BVC
-				if ((SR & 0b01000000) == 0) {
-					page = PC >> 8;
-					PC = PC + signed char(Memory[PC]);
-				}
-				PC++; Address = PC;
-				if ((PC >> 8) != page) {
-					Cycles -= 2;
-				}
-				else {
-					Cycles--;
-				}
-				Cycles -= 2;
-				break;
-			case 0x51: // EOR ind, Y
-				addr_ind_y();
-				AC = AC ^ mem_read(Address);
-				check_negative(AC);
-				check_zero(AC);
-				PC++;
-				Cycles -= 5;
-				break;
-			case 0x52: // EOR (zpg)
-				Address = addr_zpg_ind();
-				AC = AC ^ mem_read(Address);
-				check_negative(AC);
-				check_zero(AC);
-				PC++;
-				Cycles -= 5;
-				break;
-			case 0x53: // NOP
-				Cycles -= 1;
-				break;
-			case 0x54: // NOP
-				PC++;
-				Cycles -= 4;
-				break;
-			case 0x55: // EOR zpg, X
-				Address = addr_zpg_x();
-				AC = AC ^ mem_read(Address);
-				check_negative(AC);
-				check_zero(AC);
-				PC++;
-				Cycles -= 4;
-				break;
-			case 0x56: // LSR zpg, X
-				Address = addr_zpg_x();
-				tmpVal = mem_read(Address);
-				lsr(Address);
-				check_zero(tmpVal);
-				SR = SR & 0b01111111;
-				PC++;
-				Cycles -= 6;
-				break;
-			case 0x57: // NOP
-				Cycles -= 1;
-				break;
-			case 0x58: // CLI
-				SR = SR & 0b11111011;
-				Cycles -= 2;
-				break;
-			case 0x59: // EOR abs, Y
-				addr_abs_y();
-				AC = AC ^ mem_read(Address);
-				check_negative(AC);
-				check_zero(AC);
-				PC += 2;
-				Cycles -= 4;
-				break;
-			case 0x5A: // PHY
-				push(Y);
-				Cycles -= 3;
-				break;
-			case 0x5B: // NOP
-				Cycles -= 1;
-				break;
-			case 0x5C: // NOP
-				PC += 2;
-				Cycles -= 8;
-				break;
-			case 0x5D: // EOR abs, X
-				addr_abs_x();
-				AC = AC ^ mem_read(Address);
-				check_negative(AC);
-				check_zero(AC);
-				PC += 2;
-				Cycles -= 4;
-				break;
-			case 0x5E: // LSR abs, X
-				Address = ((Memory[PC + 1] << 8) | Memory[PC]) + X; // <- Page boundary crossing does not affect this instruction
-				tmpVal = mem_read(Address);
-				lsr(Address);
-				check_zero(tmpVal);
-				SR = SR & 0b01111111;
-				PC += 2;
-				Cycles -= 7;
-				break;
-			case 0x5F: // NOP
-				Cycles -= 1;
-				break;
-			case 0x60: // RTS
-				Address = PC = pull() | (pull() << 8);
-				Cycles -= 6;
-				break;
-			case 0x61: // ADC X, ind
-				Address = addr_x_ind();
-				addwcarry(mem_read(Address));
-				check_negative(AC);
-				check_zero(AC);
-				PC++;
-				Cycles -= 6;
-				break;
-			case 0x62: // NOP
-				PC++;
-				Cycles -= 2;
-				break;
-			case 0x63: // NOP
-				Cycles -= 1;
-				break;
-			case 0x64: // STZ zpg
-				Address = addr_zpg();
-				mem_store(Address, 0x00);
-				PC++;
-				Cycles -= 3;
-				break;
-			case 0x65: // ADC zpg
-				Address = addr_zpg();
-				addwcarry(mem_read(Address));
-				check_negative(AC);
-				check_zero(AC);
-				PC++;
-				Cycles -= 3;
-				break;
-			case 0x66: // ROR zpg
-				Address = addr_zpg();
-				tmpVal = mem_read(Address);
-				ror(Address);
-				check_negative(tmpVal);
-				check_zero(tmpVal);
-				PC++;
-				Cycles -= 5;
-				break;
-			case 0x67: // NOP
-				Cycles -= 1;
-				break;
-			case 0x68: // PLA
-				AC = pull();
-				Cycles -= 4;
-				break;
-			case 0x69: // ADC immediate
-				Address = PC;
-				addwcarry(Memory[PC]);
-				check_negative(AC);
-				check_zero(AC);
-				PC++;
-				Cycles -= 2;
-				break;
-			case 0x6A: // ROR A
-				if ((AC & 0b00000001) == 0) {
-					AC = (AC >> 1) | ((SR & 0b00000001) << 7);
-					SR = SR & 0b11111110;
-				}
-				else {
-					AC = (AC >> 1) | ((SR & 0b00000001) << 7);
-					SR = SR | 0b00000001;
-				}
-				check_negative(AC);
-				check_zero(AC);
-				Cycles -= 2;
-				break;
-			case 0x6B: // NOP
-				Cycles -= 1;
-				break;
-			case 0x6C: // JMP (abs)
-				Address = PC = addr_ind();
-				Cycles -= 6;
-				break;
-			case 0x6D: // ADC abs
-				Address = addr_abs();
-				addwcarry(mem_read(Address));
-				check_negative(AC);
-				check_zero(AC);
-				PC += 2;
-				Cycles -= 4;
-				break;
-			case 0x6E: // ROR abs
-				Address = addr_abs();
-				tmpVal = mem_read(Address);
-				ror(Address);
-				check_negative(tmpVal);
-				check_zero(tmpVal);
-				PC += 2;
-				Cycles -= 6;
-				break;
-			case 0x6F: // NOP
-				Cycles -= 1;
-				break;
-			case 0x70: // BVS
-				if ((SR & 0b01000000) != 0) {
+				NZ = AC; // <- N is always clear
+				break;
+			case OP_ROL_A:
+				tmpVal = AC >> 7;
+				AC = (AC << 1) | (SR & 0b00000001);
+				SR = (SR & 0b11111110) | tmpVal;
+				set_nz(AC);
+				break;
+			case OP_ROR_A:
+				tmpVal = AC & 0b00000001;
+				AC = (AC >> 1) | ((SR & 0b00000001) << 7);
+				SR = (SR & 0b11111110) | tmpVal;
+				set_nz(AC);
+				break;
+			// Registers
+			case OP_INX: X++; set_nz(X); break;
+			case OP_INY: Y++; set_nz(Y); break;
+			case OP_INA: AC++; set_nz(AC); break;
+			case OP_DEX: X--; set_nz(X); break;
+			case OP_DEY: Y--; set_nz(Y); break;
+			case OP_DEA: AC--; set_nz(AC); break;
+			case OP_TAX: X = AC; set_nz(X); break;
+			case OP_TAY: Y = AC; set_nz(Y); break;
+			case OP_TXA: AC = X; set_nz(AC); break;
+			case OP_TYA: AC = Y; set_nz(AC); break;
+			case OP_TSX: X = SP; set_nz(X); break;
+			case OP_TXS: SP = X; break;
+			// Stack
+			case OP_PHA: push(AC); break;
+			case OP_PHP: push(GetSR() | 0b00110000); break;
+			case OP_PHX: push(X); break;
+			case OP_PHY: push(Y); break;
+			case OP_PLA: AC = pull(); break;
+			case OP_PLP: SetSR(pull() & 0b11001111); break;
+			case OP_PLX: X = pull(); break;
+			case OP_PLY: Y = pull(); break;
+			// Flags
+			case OP_CLC: SR = SR & 0b11111110; break;
+			case OP_SEC: SR = SR | 0b00000001; break;
+			case OP_CLI: SR = SR & 0b11111011; break;
+			case OP_SEI: SR = SR | 0b00000100; break;
+			case OP_CLV: SR = SR & 0b10111111; break;
+			case OP_CLD: SR = SR & 0b11110111; break;
+			case OP_SED: SR = SR | 0b00001000; break;
+			// Branches
+			case OP_BPL: case OP_BMI: case OP_BVC: case OP_BVS: case OP_BCC: case OP_BCS: case OP_BNE: case OP_BEQ: case OP_BRA:
+			{
+				word from = PC - 1;
+				bool taken = BranchTaken<OP>();
+				if (taken) {
 					page = PC >> 8;
-					PC = PC + signed char(Memory[PC]);
+					PC = PC + (signed char)(Operand & 0xFF);
 				}
 				PC++; Address = PC;
 				if ((PC >> 8) != page) {
@@ -1094,849 +892,178 @@ public:
 				else {
 					Cycles--;
 				}
-				Cycles -= 2;
-				break;
-			case 0x71: // ADC ind, Y
-				addr_ind_y();
-				addwcarry(mem_read(Address));
-				check_negative(AC);
-				check_zero(AC);
-				PC++;
-				Cycles -= 5;
-				break;
-			case 0x72: // ADC (zpg)
-				Address = addr_zpg_ind();
-				addwcarry(mem_read(Address));
-				check_negative(AC);
-				check_zero(AC);
-				PC++;
-				Cycles -= 5;
-				break;
-			case 0x73: // NOP
-				Cycles -= 1;
-				break;
-			case 0x74: // STZ zpg,X
-				Address = addr_zpg_x();
-				mem_store(Address, 0x00);
-				PC++;
-				Cycles -= 4;
-				break;
-			case 0x75: // ADC zpg, X
-				Address = addr_zpg_x();
-				addwcarry(mem_read(Address));
-				check_negative(AC);
-				check_zero(AC);
-				PC++;
-				Cycles -= 4;
-				break;
-			case 0x76: // ROR zpg, X
-				Address = addr_zpg_x();
-				tmpVal = mem_read(Address);
-				ror(Address);
-				check_negative(tmpVal);
-				check_zero(tmpVal);
-				PC++;
-				Cycles -= 6;
-				break;
-			case 0x77: // NOP
-				Cycles -= 1;
-				break;
-			case 0x78: // SEI
-				SR = SR | 0b00000100;
-				Cycles -= 2;
-				break;
-			case 0x79: // ADC abs, Y
-				addr_abs_y();
-				addwcarry(mem_read(Address));
-				check_negative(AC);
-				check_zero(AC);
-				PC += 2;
-				Cycles -= 4;
-				break;
-			case 0x7A: // PLY
-				Y = pull();
-				Cycles -= 4;
-				break;
-			case 0x7B: // NOP
-				Cycles -= 1;
-				break;
-			case 0x7C: // JMP abs (ind,x)
-				addr_abs_ind(); PC = Address;
-				Cycles -= 3;
-				break;
-			case 0x7D: // ADC abs, X
-				addr_abs_x();
-				addwcarry(mem_read(Address));
-				check_negative(AC);
-				check_zero(AC);
-				PC += 2;
-				Cycles -= 4;
-				break;
-			case 0x7E: // ROR abs, X
-				Address = ((Memory[PC + 1] << 8) | Memory[PC]) + X; // <- Page boundary crossing does not affect this instruction
-				tmpVal = mem_read(Address);
-				ror(Address);
-				check_negative(tmpVal);
-				check_zero(tmpVal);
-				PC += 2;
-				Cycles -= 7;
-				break;
-			case 0x7F: // NOP
-				Cycles -= 1;
-				break;
-			case 0x80: // BRA
-				page = PC >> 8;
-				PC = PC + signed char(Memory[PC]) + 1; Address = PC;
-				if ((PC >> 8) != page) {
-					Cycles -= 2;
-				}
-				else {
-					Cycles--;
-				}
-				Cycles -= 2;
-				break;
-			case 0x81: // STA X, ind
-				Address = addr_x_ind();
-				mem_store(Address, AC);
-				PC++;
-				Cycles -= 6;
-				break;
-			case 0x82: // NOP
-				PC++;
-				Cycles -= 2;
-				break;
-			case 0x83: // NOP
-				Cycles -= 1;
-				break;
-			case 0x84: // STY zpg
-				Address = addr_zpg();
-				mem_store(Address, Y);
-				PC++;
-				Cycles -= 3;
-				break;
-			case 0x85: // STA zpg
-				Address = addr_zpg();
-				mem_store(Address, AC);
-				PC++;
-				Cycles -= 3;
-				break;
-			case 0x86: // STX zpg
-				Address = addr_zpg();
-				mem_store(Address, X);
-				PC++;
-				Cycles -= 3;
-				break;
-			case 0x87: // NOP
-				Cycles -= 1;
-				break;
-			case 0x88: // DEY
-				Y--;
-				check_negative(Y);
-				check_zero(Y);
-				Cycles -= 2;
-				break;
-			case 0x89: // BIT immediate
-				tmpVal = Memory[PC]; Address = PC;
-				check_zero(AC & tmpVal);
-				PC++;
-				Cycles -= 2;
-				break;
-			case 0x8A: // TXA
-				AC = X;
-				check_negative(AC);
-				check_zero(AC);
-				Cycles -= 2;
-				break;
-			case 0x8B: // NOP
-				Cycles -= 1;
-				break;
-			case 0x8C: // STY abs
-				Address = addr_abs();
-				mem_store(Address, Y);
-				PC += 2;
-				Cycles -= 4;
-				break;
-			case 0x8D: // STA abs
-				Address = addr_abs();
-				mem_store(Address, AC);
-				PC += 2;
-				Cycles -= 4;
-				break;
-			case 0x8E: // STX abs
-				Address = addr_abs();
-				mem_store(Address, X);
-				PC += 2;
-				Cycles -= 4;
-				break;
-			case 0x8F: // NOP
-				Cycles -= 1;
-				break;
-			case 0x90: // BCC
-				if ((SR & 0b00000001) == 0) {
-					page = PC >> 8;
-					PC = PC + signed char(Memory[PC]);
-				}
-				PC++; Address = PC;
-				if ((PC >> 8) != page) {
-					Cycles -= 2;
-				}
-				else {
-					Cycles--;
+				if (IdleSkip && taken && (Operand & 0b10000000) != 0 && --loopCountdown == 0) { // <- Backward: may be a polling loop
+					LoopBack(from, PC);
 				}
-				Cycles -= 2;
-				break;
-			case 0x91: // STA ind, Y
-				Address = ((Memory[Memory[PC] + 1] << 8) | Memory[Memory[PC]]) + Y; // <- Page boundary crossing does not affect this instruction
-				mem_store(Address, AC);
-				PC++;
-				Cycles -= 6;
-				break;
-			case 0x92: // STA (zpg)
-				Address = addr_zpg_ind();
-				mem_store(Address, AC);
-				PC++;
-				Cycles -= 5;
-				break;
-			case 0x93: // NOP
-				Cycles -= 1;
-				break;
-			case 0x94: // STY zpg, X
-				Address = addr_zpg_x();
-				mem_store(Address, Y);
-				PC++;
-				Cycles -= 4;
-				break;
-			case 0x95: // STA zpg, X
-				Address = addr_zpg_x();
-				mem_store(Address, AC);
-				PC++;
-				Cycles -= 4;
-				break;
-			case 0x96: // STX zpg, Y
-				Address = addr_zpg_y();
-				mem_store(Address, X);
-				PC++;
-				Cycles -= 4;
-				break;
-			case 0x97: // NOP
-				Cycles -= 1;
-				break;
-			case 0x98: // TYA
-				AC = Y;
-				check_negative(AC);
-				check_zero(AC);
-				Cycles -= 2;
-				break;
-			case 0x99: // STA abs, Y
-				Address = ((Memory[PC + 1] << 8) | Memory[PC]) + Y;
-				mem_store(Address, AC);
-				PC += 2;
-				Cycles -= 5;
-				break;
-			case 0x9A: // TXS
-				SP = X;
-				Cycles -= 2;
-				break;
-			case 0x9B: // NOP
-				Cycles -= 1;
-				break;
-			case 0x9C: // STZ abs
-				Address = addr_abs();
-				mem_store(Address, 0x00);
-				PC += 2;
-				Cycles -= 4;
-				break;
-			case 0x9D: // STA abs, X
-				Address = ((Memory[PC + 1] << 8) | Memory[PC]) + X;
-				mem_store(Address, AC);
-				PC += 2;
-				Cycles -= 5;
-				break;
-			case 0x9E: // STZ abs, X
-				Address = ((Memory[PC + 1] << 8) | Memory[PC]) + X;
-				mem_store(Address, 0x00);
-				PC += 2;
-				Cycles -= 5;
-				break;
-			case 0x9F: // NOP
-				Cycles -= 1;
-				break;
-			case 0xA0: // LDY immediate
-				Y = Memory[PC]; Address = PC;
-				check_negative(Y);
-				check_zero(Y);
-				PC++;
-				Cycles -= 2;
 				break;
-			case 0xA1: // LDA X, ind
-				Address = addr_x_ind();
-				AC = mem_read(Address);
-				check_negative(AC);
-				check_zero(AC);
-				PC++;
-				Cycles -= 6;
-				break;
-			case 0xA2: // LDX immediate
-				X = Memory[PC]; Address = PC;
-				check_negative(X);
-				check_zero(X);
-				PC++;
-				Cycles -= 2;
-				break;
-			case 0xA3: // NOP
-				Cycles -= 1;
-				break;
-			case 0xA4: // LDY zpg
-				Address = addr_zpg();
-				Y = mem_read(Address);
-				check_negative(Y);
-				check_zero(Y);
-				PC++;
-				Cycles -= 3;
-				break;
-			case 0xA5: // LDA zpg
-				Address = addr_zpg();
-				AC = mem_read(Address);
-				check_negative(AC);
-				check_zero(AC);
-				PC++;
-				Cycles -= 3;
-				break;
-			case 0xA6: // LDX zpg
-				Address = addr_zpg();
-				X = mem_read(Address);
-				check_negative(X);
-				check_zero(X);
-				PC++;
-				Cycles -= 3;
-				break;
-			case 0xA7: // NOP
-				Cycles -= 1;
-				break;
-			case 0xA8: // TAY
-				Y = AC;
-				check_negative(Y);
-				check_zero(Y);
-				Cycles -= 2;
-				break;
-			case 0xA9: // LDA immediate
-				AC = Memory[PC]; Address = PC;
-				check_negative(AC);
-				check_zero(AC);
-				PC++;
-				Cycles -= 2;
-				break;
-			case 0xAA: // TAX
-				X = AC;
-				check_negative(X);
-				check_zero(X);
-				Cycles -= 2;
-				break;
-			case 0xAB: // NOP
-				Cycles -= 1;
-				break;
-			case 0xAC: // LDY abs
-				Address = addr_abs();
-				Y = mem_read(Address);
-				check_negative(Y);
-				check_zero(Y);
-				PC += 2;
-				Cycles -= 4;
-				break;
-			case 0xAD: // LDA abs
-				Address = addr_abs();
-				AC = mem_read(Address);
-				check_negative(AC);
-				check_zero(AC);
-				PC += 2;
-				Cycles -= 4;
-				break;
-			case 0xAE: // LDX abs
-				Address = addr_abs();
-				X = mem_read(Address);
-				check_negative(X);
-				check_zero(X);
-				PC += 2;
-				Cycles -= 4;
-				break;
-			case 0xAF: // NOP
-				Cycles -= 1;
-				break;
-			case 0xB0: // BCS
-				if ((SR & 0b00000001) == 1) {
-					page = PC >> 8;
-					PC = PC + signed char(Memory[PC]);
-				}
-				PC++; Address = PC;
-				if ((PC >> 8) != page) {
-					Cycles -= 2;
+			}
+			// Control
+			case OP_JMP:
+				if (MODE == AM_ABS_IND) {
+					addr_abs_ind(); PC = Address;
 				}
 				else {
-					Cycles--;
+					word from = PC - 1;
+					Address = PC = EffectiveAddress<MODE>();
+					if (MODE == AM_ABS && IdleSkip && PC <= from && --loopCountdown == 0) { // <- Backward (JMP * included): may be a polling loop
+						LoopBack(from, PC);
+					}
 				}
-				Cycles -= 2;
-				break;
-			case 0xB1: // LDA ind, Y
-				addr_ind_y();
-				AC = mem_read(Address);
-				check_negative(AC);
-				check_zero(AC);
-				PC++;
-				Cycles -= 5;
-				break;
-			case 0xB2: // LDA (zpg)
-				Address = addr_zpg_ind();
-				AC = mem_read(Address);
-				check_negative(AC);
-				check_zero(AC);
-				PC++;
-				Cycles -= 5;
-				break;
-			case 0xB3: // NOP
-				Cycles -= 1;
-				break;
-			case 0xB4: // LDY zpg, X
-				Address = addr_zpg_x();
-				Y = mem_read(Address);
-				check_negative(Y);
-				check_zero(Y);
-				PC++;
-				Cycles -= 4;
-				break;
-			case 0xB5: // LDA zpg, X
-				Address = addr_zpg_x();
-				AC = mem_read(Address);
-				check_negative(AC);
-				check_zero(AC);
-				PC++;
-				Cycles -= 4;
-				break;
-			case 0xB6: // LDX zpg, Y
-				Address = addr_zpg_y();
-				X = mem_read(Address);
-				check_negative(X);
-				check_zero(X);
-				PC++;
-				Cycles -= 4;
-				break;
-			case 0xB7: // NOP
-				Cycles -= 1;
-				break;
-			case 0xB8: // CLV
-				SR = SR & 0b10111111;
-				Cycles -= 2;
-				break;
-			case 0xB9: // LDA abs, Y
-				addr_abs_y();
-				AC = mem_read(Address);
-				check_negative(AC);
-				check_zero(AC);
-				PC += 2;
-				Cycles -= 4;
-				break;
-			case 0xBA: // TSX
-				X = SP;
-				check_negative(X);
-				check_zero(X);
-				Cycles -= 2;
-				break;
-			case 0xBB: // NOP
-				Cycles -= 1;
-				break;
-			case 0xBC: // LDY abs, X
-				addr_abs_x();
-				Y = mem_read(Address);
-				check_negative(Y);
-				check_zero(Y);
-				PC += 2;
-				Cycles -= 4;
-				break;
-			case 0xBD: // LDA abs, X
-				addr_abs_x();
-				AC = mem_read(Address);
-				check_negative(AC);
-				check_zero(AC);
-				PC += 2;
-				Cycles -= 4;
-				break;
-			case 0xBE: // LDX abs, Y
-				addr_abs_y();
-				X = mem_read(Address);
-				check_negative(X);
-				check_zero(X);
-				PC += 2;
-				Cycles -= 4;
-				break;
-			case 0xBF: // NOP
-				Cycles -= 1;
-				break;
-			case 0xC0: // CPY immediate
-				compare(Y, PC); Address = PC;
-				PC++;
-				Cycles -= 2;
-				break;
-			case 0xC1: // CMP X, ind
-				Address = addr_x_ind();
-				compare(AC, Address);
-				PC++;
-				Cycles -= 6;
-				break;
-			case 0xC2: // NOP
-				PC++;
-				Cycles -= 2;
-				break;
-			case 0xC3: // NOP
-				Cycles -= 1;
-				break;
-			case 0xC4: // CPY zpg
-				Address = addr_zpg();
-				compare(Y, Address);
-				PC++;
-				Cycles -= 3;
-				break;
-			case 0xC5: // CMP zpg
-				Address = addr_zpg();
-				compare(AC, Address);
-				PC++;
-				Cycles -= 3;
-				break;
-			case 0xC6: // DEC zpg
-				Address = addr_zpg();
-				tmpVal = mem_read(Address) - 1;
-				mem_store(Address, tmpVal);
-				check_negative(tmpVal);
-				check_zero(tmpVal);
-				PC++;
-				Cycles -= 5;
-				break;
-			case 0xC7: // NOP
-				Cycles -= 1;
 				break;
-			case 0xC8: // INY
-				Y++;
-				check_negative(Y);
-				check_zero(Y);
-				Cycles -= 2;
-				break;
-			case 0xC9: // CMP immediate
-				compare(AC, PC); Address = PC;
-				PC++;
-				Cycles -= 2;
-				break;
-			case 0xCA: // DEX
-				X--;
-				check_negative(X);
-				check_zero(X);
-				Cycles -= 2;
-				break;
-			case 0xCB: // NOP
-				Cycles -= 1;
-				break;
-			case 0xCC: // CPY abs
-				Address = addr_abs();
-				compare(Y, Address);
-				PC += 2;
-				Cycles -= 4;
-				break;
-			case 0xCD: // CMP abs
-				Address = addr_abs();
-				compare(AC, Address);
-				PC += 2;
-				Cycles -= 4;
-				break;
-			case 0xCE: // DEC abs
-				Address = addr_abs();
-				tmpVal = mem_read(Address) - 1;
-				mem_store(Address, tmpVal);
-				check_negative(tmpVal);
-				check_zero(tmpVal);
-				PC += 2;
-				Cycles -= 6;
-				break;
-			case 0xCF: // NOP
-				Cycles -= 1;
+			case OP_JSR:
+				push((PC + 2) >> 8);
+				push((PC + 2) & 0xFF);
+				Address = PC = addr_abs();
 				break;
-			case 0xD0: // BNE
-				if ((SR & 0b00000010) == 0) {
-					page = PC >> 8;
-					PC = PC + signed char(Memory[PC]);
-				}
-				PC++; Address = PC;
-				if ((PC >> 8) != page) {
-					Cycles -= 2;
+			case OP_RTS:
+				tmpVal = pull(); // <- Low byte first
+				Address = PC = tmpVal | (pull() << 8);
+				break;
+			case OP_RTI:
+				SetSR(pull() & 0b11001111);
+				tmpVal = pull(); // <- Low byte first
+				Address = PC = tmpVal | (pull() << 8);
+				Lines.fetch_and(~LINE_IRQ, std::memory_order_relaxed); // <- The IRQ pin is VIA 1's again (the SSD's completion is acknowledged)
+				if (!viaOne.checkInterrupt()) {
+					Lines.fetch_or(LINE_IRQ_VIA_ONE, std::memory_order_relaxed);
 				}
-				else {
-					Cycles--;
-				}
-				Cycles -= 2;
-				break;
-			case 0xD1: // CMP ind, Y
-				addr_ind_y();
-				compare(AC, Address);
-				PC++;
-				Cycles -= 5;
-				break;
-			case 0xD2: // CMP (zpg)
-				Address = addr_zpg_ind();
-				compare(AC, Address);
-				PC++;
-				Cycles -= 5;
-				break;
-			case 0xD3: // NOP
-				Cycles -= 1;
-				break;
-			case 0xD4: // NOP
-				PC++;
-				Cycles -= 4;
-				break;
-			case 0xD5: // CMP zpg, X
-				Address = addr_zpg_x();
-				compare(AC, Address);
-				PC++;
-				Cycles -= 4;
-				break;
-			case 0xD6: // DEC zpg, X
-				Address = addr_zpg_x();
-				tmpVal = mem_read(Address) - 1;
-				mem_store(Address, tmpVal);
-				check_negative(tmpVal);
-				check_zero(tmpVal);
-				PC++;
-				Cycles -= 6;
-				break;
-			case 0xD7: // NOP
-				Cycles -= 1;
-				break;
-			case 0xD8: // CLD
-				SR = SR & 0b11110111;
-				Cycles -= 2;
-				break;
-			case 0xD9: // CMP abs, Y
-				addr_abs_y();
-				compare(AC, Address);
-				PC += 2;
-				Cycles -= 4;
-				break;
-			case 0xDA: // PHX
-				push(X);
-				Cycles -= 3;
-				break;
-			case 0xDB: // NOP
-				Cycles -= 1;
-				break;
-			case 0xDC: // NOP
-				PC += 2;
-				Cycles -= 4;
-				break;
-			case 0xDD: // CMP abs, X
-				addr_abs_x();
-				compare(AC, Address);
-				PC += 2;
-				Cycles -= 4;
-				break;
-			case 0xDE: // DEC abs, X
-				Address = ((Memory[PC + 1] << 8) | Memory[PC]) + X; // <- Page boundary crossing does not affect this instruction
-				tmpVal = mem_read(Address) - 1;
-				mem_store(Address, tmpVal);
-				check_negative(tmpVal);
-				check_zero(tmpVal);
-				PC += 2;
-				Cycles -= 7;
-				break;
-			case 0xDF: // NOP
-				Cycles -= 1;
-				break;
-			case 0xE0: // CPX immediate
-				compare(X, PC); Address = PC;
-				PC++;
-				Cycles -= 2;
-				break;
-			case 0xE1: // SBC X, ind
-				Address = addr_x_ind();
-				subwcarry(mem_read(Address));
-				check_negative(AC);
-				check_zero(AC);
-				PC++;
-				Cycles -= 6;
-				break;
-			case 0xE2: // NOP
-				PC++;
-				Cycles -= 2;
-				break;
-			case 0xE3: // NOP
-				Cycles -= 1;
-				break;
-			case 0xE4: // CPX zpg
-				Address = addr_zpg();
-				compare(X, Address);
-				PC++;
-				Cycles -= 3;
-				break;
-			case 0xE5: // SBC zpg
-				Address = addr_zpg();
-				subwcarry(mem_read(Address));
-				check_negative(AC);
-				check_zero(AC);
-				PC++;
-				Cycles -= 3;
-				break;
-			case 0xE6: // INC zpg
-				Address = addr_zpg();
-				tmpVal = mem_read(Address) + 1;
-				mem_store(Address, tmpVal);
-				check_negative(tmpVal);
-				check_zero(tmpVal);
-				PC++;
-				Cycles -= 5;
-				break;
-			case 0xE7: // NOP
-				Cycles -= 1;
-				break;
-			case 0xE8: // INX
-				X++;
-				check_negative(X);
-				check_zero(X);
-				Cycles -= 2;
-				break;
-			case 0xE9: // SBC immediate
-				subwcarry(Memory[PC]); Address = PC;
-				check_negative(AC);
-				check_zero(AC);
-				PC++;
-				Cycles -= 2;
-				break;
-			case 0xEA: // NOP
-				Cycles -= 2;
-				break;
-			case 0xEB: // NOP
-				Cycles -= 1;
 				break;
-			case 0xEC: // CPX abs
-				Address = addr_abs();
-				compare(X, Address);
-				PC += 2;
-				Cycles -= 4;
-				break;
-			case 0xED: // SBC abs
-				Address = addr_abs();
-				subwcarry(mem_read(Address));
-				check_negative(AC);
-				check_zero(AC);
-				PC += 2;
-				Cycles -= 4;
-				break;
-			case 0xEE: // INC abs
-				Address = addr_abs();
-				tmpVal = mem_read(Address) + 1;
-				mem_store(Address, tmpVal);
-				check_negative(tmpVal);
-				check_zero(tmpVal);
-				PC += 2;
-				Cycles -= 6;
+			case OP_BRK:
+				push((PC + 1) >> 8);
+				push((PC + 1) & 0xFF);
+				push(GetSR() | 0b00110000);
+				PC = (Memory[0xFFFF] << 8) | Memory[0xFFFE];
 				break;
-			case 0xEF: // NOP
-				Cycles -= 1;
+			case OP_NOP:
 				break;
-			case 0xF0: // BEQ
-				if ((SR & 0b00000010) != 0) {
-					page = PC >> 8;
-					PC = PC + signed char(Memory[PC]);
-				}
-				PC++; Address = PC;
-				if ((PC >> 8) != page) {
-					Cycles -= 2;
-				}
-				else {
-					Cycles--;
+			// Low Power -- the instruction runs again every slice until the pin it waits for is asserted, the rest of
+			// the slice is slept through (the machine parks the host thread meanwhile)
+			case OP_WAI:
+				Waiting = Lines.load(std::memory_order_relaxed) == 0; // <- IRQ wakes it up even with I set (the handler is skipped then)
+				if (Waiting) {
+					PC--;
+					SleepCycles += Cycles;
+					Cycles = 0;
 				}
-				Cycles -= 2;
-				break;
-			case 0xF1: // SBC ind, Y
-				addr_ind_y();
-				subwcarry(mem_read(Address));
-				check_negative(AC);
-				check_zero(AC);
-				PC++;
-				Cycles -= 5;
-				break;
-			case 0xF2: // SBC (zpg)
-				Address = addr_zpg_ind();
-				subwcarry(mem_read(Address));
-				check_negative(AC);
-				check_zero(AC);
-				PC++;
-				Cycles -= 5;
-				break;
-			case 0xF3: // NOP
-				Cycles -= 1;
 				break;
-			case 0xF4: // NOP
-				PC++;
-				Cycles -= 4;
-				break;
-			case 0xF5: // SBC zpg, X
-				Address = addr_zpg_x();
-				subwcarry(mem_read(Address));
-				check_negative(AC);
-				check_zero(AC);
-				PC++;
-				Cycles -= 4;
-				break;
-			case 0xF6: // INC zpg, X
-				Address = addr_zpg_x();
-				tmpVal = mem_read(Address) + 1;
-				mem_store(Address, tmpVal);
-				check_negative(tmpVal);
-				check_zero(tmpVal);
-				PC++;
-				Cycles -= 6;
-				break;
-			case 0xF7: // NOP
-				Cycles -= 1;
-				break;
-			case 0xF8: // SED
-				SR = SR | 0b00001000;
-				Cycles -= 2;
-				break;
-			case 0xF9: // SBC abs, Y
-				addr_abs_y();
-				subwcarry(mem_read(Address));
-				check_negative(AC);
-				check_zero(AC);
-				PC += 2;
-				Cycles -= 4;
-				break;
-			case 0xFA: // PLX
-				X = pull();
-				Cycles -= 4;
-				break;
-			case 0xFB: // NOP
-				Cycles -= 1;
-				break;
-			case 0xFC: // NOP
-				PC += 2;
-				Cycles -= 4;
-				break;
-			case 0xFD: // SBC abs, X
-				addr_abs_x();
-				subwcarry(mem_read(Address));
-				check_negative(AC);
-				check_zero(AC);
-				PC += 2;
-				Cycles -= 4;
-				break;
-			case 0xFE: // INC abs, X
-				addr_abs_x();
-				tmpVal = mem_read(Address) + 1;
-				mem_store(Address, tmpVal);
-				check_negative(tmpVal);
-				check_zero(tmpVal);
-				PC += 2;
-				Cycles -= 7;
-				break;
-			case 0xFF: // NOP
-				Cycles -= 1;
+			case OP_STP:
+				Stopped = true;
+				PC--;
+				SleepCycles += Cycles;
+				Cycles = 0;
 				break;
 		}
 	}
-};
\ No newline at end of file
+
+	// Instruction Handler -- Operation, then skip the operand and spend the base cycles
+	template <uchar OP, uchar MODE, uchar LEN, uchar CYC>
+	static void Instruction(MOS65C02& cpu) {
+		cpu.Operation<OP, MODE>();
+		cpu.PC += LEN;
+		cpu.Cycles -= CYC;
+	}
+
+	// Fused Idiom Handler -- the instruction at PC and the one after it in a single dispatch
+	// Stops after the first one whenever the loop would have done something in between (slice spent, reset, break point,
+	// interrupt to take) or a store has dropped the idiom's entry, so cycles, flags and interrupts match two dispatches.
+	template <byte FIRST, byte SECOND, uchar IDIOM>
+	static void Fused(MOS65C02& cpu) {
+		DecodedInstruction& entry = cpu.icache.lookup(cpu.PC - 1);
+		Instruction<Rows[FIRST].op, Rows[FIRST].mode, Rows[FIRST].len, Rows[FIRST].cyc>(cpu);
+		if (cpu.Cycles < 0 || cpu.PC == cpu.BreakPC || cpu.Pending()) {
+			return;
+		}
+		if (Rows[FIRST].op >= OP_STA && Rows[FIRST].op <= OP_TRB && entry.handler == NULL) { // <- Only stores can rewrite the idiom
+			return;
+		}
+		cpu.IR = SECOND;
+		cpu.Operand = entry.next;
+		cpu.PC++;
+		cpu.Instructions++;
+		cpu.Address = cpu.page = 0;
+		Instruction<Rows[SECOND].op, Rows[SECOND].mode, Rows[SECOND].len, Rows[SECOND].cyc>(cpu);
+		cpu.FusedHits[IDIOM]++;
+	}
+
+public:
+	// Execute fetched instruction
+	void Execute() {
+		Address = page = 0;
+#if EVM_DISPATCH == DISPATCH_SWITCH
+		switch (IR) {
+#define OPCODE_CASE(code, op, mode, len, cyc) case code: Instruction<op, mode, len, cyc>(*this); break;
+			MOS65C02_OPCODES(OPCODE_CASE)
+#undef OPCODE_CASE
+		}
+#else
+		HandlerTable[IR](*this);
+#endif
+	}
+
+	// Run instructions until the cycle budget is spent, a reset is requested or PC reaches BreakPC
+	void Run() {
+		if (icache.pending()) {
+			icache.sync();
+		}
+		ForgetLoop();
+		if (Resetting()) {
+			return;
+		}
+		if (icache.enabled) {
+			RunLoop<true>();
+		}
+		else {
+			RunLoop<false>();
+		}
+	}
+
+private:
+	template <bool CACHED>
+	void RunLoop() {
+#if EVM_DISPATCH == DISPATCH_THREADED
+#define OPCODE_LABEL(code, op, mode, len, cyc) &&L_##code,
+		static void* const labels[256] = { MOS65C02_OPCODES(OPCODE_LABEL) };
+#undef OPCODE_LABEL
+#define DISPATCH() if (Cycles < 0 || PC == BreakPC) return; Address = page = 0; if (CACHED) { if (FetchDecoded().fused) goto L_FUSED; } else FetchInstruction(); goto *labels[IR]
+		DISPATCH();
+L_FUSED: icache.lookup(PC - 1).handler(*this); if (CheckInterrupts() == 3) return; DISPATCH(); // <- Fused idioms go through their handler
+#define OPCODE_THREADED(code, op, mode, len, cyc) L_##code: Instruction<op, mode, len, cyc>(*this); if (CheckInterrupts() == 3) return; DISPATCH();
+		MOS65C02_OPCODES(OPCODE_THREADED)
+#undef OPCODE_THREADED
+#undef DISPATCH
+#elif EVM_DISPATCH == DISPATCH_TABLE
+		while (Cycles >= 0 && PC != BreakPC) {
+			if (CACHED) {
+				Handler handler = FetchDecoded().handler;
+				Address = page = 0;
+				handler(*this);
+			}
+			else {
+				FetchInstruction();
+				Execute();
+			}
+			if (CheckInterrupts() == 3) {
+				return;
+			}
+		}
+#else
+		while (Cycles >= 0 && PC != BreakPC) {
+			FetchInstruction();
+			Execute();
+			if (CheckInterrupts() == 3) {
+				return;
+			}
+		}
+#endif
+	}
+};
+
+#define OPCODE_HANDLER(code, op, mode, len, cyc) &MOS65C02::Instruction<op, mode, len, cyc>,
+const MOS65C02::Handler MOS65C02::HandlerTable[256] = { MOS65C02_OPCODES(OPCODE_HANDLER) };
+#undef OPCODE_HANDLER
+
+constexpr MOS65C02::OpcodeRow MOS65C02::Rows[256];
+
+#define IDIOM_NAME(idiom, first, second, name) name,
+const char* const MOS65C02::IdiomNames[IDIOM_COUNT] = { MOS65C02_IDIOMS(IDIOM_NAME) };
+#undef IDIOM_NAME
@@ -0,0 +1,119 @@
+// Host Pacing -- keeps the emulated time in step with a monotonic host clock
+// Every pacing point (an emulated cycle) has a deadline on the host clock. The pacer sleeps most of the way to it, then
+// spins the last few microseconds, so the guest runs in small even steps instead of bursts. When the host stalls, the
+// emulated time catches up running flat out, up to CATCH_UP_NS behind; past that the deadlines are moved on (resync).
+class Pacer {
+public:
+	typedef std::chrono::steady_clock Clock; // <- Monotonic (CLOCK_MONOTONIC on Linux hosts)
+
+	static const long long CATCH_UP_NS = 20000000; // Lag caught up after a host stall (20ms), the rest is dropped
+	static const long long MAX_SPIN_NS = 200000; // Longest spin (a fifth of a 1ms step), hosts that oversleep more are left late
+
+	// Pacing error -- how far from its deadline every pacing point was reached (ns, late is positive)
+	struct Stats {
+		unsigned long long points = 0; // Pacing points
+		unsigned long long late = 0; // Points reached past their deadline (no wait)
+		double errorSum = 0; // Sum of the absolute errors
+		double errorSigned = 0; // Sum of the errors
+		double errorSquares = 0; // Sum of the squared errors
+		long long errorMax = 0; // Largest absolute error
+
+		void record(long long error) {
+			long long magnitude = error < 0 ? -error : error;
+			points++;
+			errorSum += double(magnitude);
+			errorSigned += double(error);
+			errorSquares += double(error) * double(error);
+			if (magnitude > errorMax) {
+				errorMax = magnitude;
+			}
+		}
+		double average() const {
+			return points > 0 ? errorSum / points : 0;
+		}
+		// Standard deviation of the error
+		double jitter() const {
+			if (points == 0) {
+				return 0;
+			}
+			double mean = errorSigned / points;
+			double variance = errorSquares / points - mean * mean;
+			return variance > 0 ? sqrt(variance) : 0;
+		}
+	};
+
+	Stats total; // Since the start
+	Stats interval; // Since the last clock test report
+	unsigned long long resyncs = 0; // Times the deadlines were moved on after a stall
+	long long dropped = 0; // Host time the emulated time didn't catch up with (ns)
+
+private:
+	Clock::time_point origin; // Host time of originCycle
+	unsigned long long originCycle = 0;
+	int clockSpeed = 1;
+	long long spinMargin = 50000; // Time left to spin after the sleep (ns) -- follows how late the host's sleeps wake up
+
+	// Sleep until a host time (coarse) -- an absolute CLOCK_MONOTONIC sleep on Linux (the clock of steady_clock there)
+	static void sleepUntil(Clock::time_point until) {
+#ifdef __linux__
+		long long ns = std::chrono::duration_cast<std::chrono::nanoseconds>(until.time_since_epoch()).count();
+		struct timespec deadline = { (time_t)(ns / 1000000000), (long)(ns % 1000000000) };
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR) {
+		}
+#else
+		std::this_thread::sleep_until(until);
+#endif
+	}
+
+public:
+	// Start pacing -- cycle is reached now
+	void start(unsigned long long cycle, int speed) {
+		clockSpeed = speed;
+		originCycle = cycle;
+		origin = Clock::now();
+	}
+
+	// Host time an emulated cycle is due at
+	Clock::time_point deadline(unsigned long long cycle) const {
+		return origin + std::chrono::nanoseconds((long long)((cycle - originCycle) * 1000000000.0 / clockSpeed));
+	}
+
+	// Wait until the deadline of a pacing point
+	void pace(unsigned long long cycle) {
+		Clock::time_point due = deadline(cycle);
+		Clock::time_point now = Clock::now();
+		long long lag = std::chrono::duration_cast<std::chrono::nanoseconds>(now - due).count();
+		if (lag >= 0) { // <- Behind: run on, no wait
+			total.late++;
+			interval.late++;
+			if (lag > CATCH_UP_NS) {
+				resyncs++;
+				dropped += lag - CATCH_UP_NS;
+				origin += std::chrono::nanoseconds(lag - CATCH_UP_NS);
+			}
+			total.record(lag);
+			interval.record(lag);
+			return;
+		}
+		if (-lag > spinMargin) {
+			Clock::time_point wake = due - std::chrono::nanoseconds(spinMargin);
+			sleepUntil(wake);
+			long long overshoot = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - wake).count();
+			if (overshoot > MAX_SPIN_NS) {
+				overshoot = MAX_SPIN_NS; // <- A preempted sleep says nothing about the timer
+			}
+			spinMargin += (overshoot + 2000 - spinMargin) / 8; // <- Average oversleep, plus a little
+			if (spinMargin < 2000) {
+				spinMargin = 2000;
+			}
+			else if (spinMargin > MAX_SPIN_NS) {
+				spinMargin = MAX_SPIN_NS;
+			}
+		}
+		while ((now = Clock::now()) < due) {
+		}
+		long long error = std::chrono::duration_cast<std::chrono::nanoseconds>(now - due).count();
+		total.record(error);
+		interval.record(error);
+	}
+};
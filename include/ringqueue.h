@@ -0,0 +1,41 @@
+// Bounded Ring Queue -- lock-free, one producer thread and one consumer thread
+// N must be a power of 2. head/tail only ever grow, their difference is the number of queued items.
+template <typename T, unsigned int N>
+class RingQueue {
+private:
+	T items[N];
+	alignas(64) std::atomic<unsigned int> head{ 0 }; // Next item to pop (consumer)
+	alignas(64) std::atomic<unsigned int> tail{ 0 }; // Next free slot (producer)
+
+public:
+	// Producer: add an item (false if the queue is full)
+	bool push(const T& item) {
+		unsigned int t = tail.load(std::memory_order_relaxed);
+		if (t - head.load(std::memory_order_acquire) == N) {
+			return false;
+		}
+		items[t & (N - 1)] = item;
+		tail.store(t + 1); // <- Sequentially consistent: pairs with the consumer's check before it goes to sleep
+		return true;
+	}
+
+	// Consumer: take the oldest item (false if the queue is empty)
+	bool pop(T& item) {
+		unsigned int h = head.load(std::memory_order_relaxed);
+		if (h == tail.load()) {
+			return false;
+		}
+		item = items[h & (N - 1)];
+		head.store(h + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Items waiting in the queue
+	unsigned int size() const {
+		return tail.load() - head.load();
+	}
+
+	bool empty() const {
+		return size() == 0;
+	}
+};
@@ -0,0 +1,239 @@
+// SAS VCU Pixel Kernels -- unpack VRS bytes into host pixels (ARGB8888) and upscale them to the window
+//
+// Every decode kernel takes a 64-byte span of the Video Reserved Space:
+//  * 4-Colors: 64 bytes -> 256 pixels (2 bits per pixel, lowest bits first)
+//  * 256-Colors: 64 bytes -> 64 pixels (8 bits per pixel)
+// The best version for the host is picked at runtime by SelectVideoKernels() (CPUID).
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define SAS_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define SAS_TARGET_SSE2
+#define SAS_TARGET_AVX2
+#else
+#include <cpuid.h>
+#define SAS_TARGET_SSE2 __attribute__((target("sse2")))
+#define SAS_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+enum VideoKernel { KERNEL_SCALAR = 0, KERNEL_SSE2 = 1, KERNEL_AVX2 = 2 };
+const char* VideoKernelName[3] = { "Scalar", "SSE2", "AVX2" };
+
+typedef void (*DecodeKernel)(const byte* src, dword* dst, const dword* palette);
+typedef void (*UpscaleKernel)(const dword* src, int width, int factor, dword* dst);
+
+// --- SCALAR ---
+void Decode4Colors_Scalar(const byte* src, dword* dst, const dword* palette) {
+	for (int i = 0; i < 64; i++) {
+		dst[0] = palette[src[i] & 0b00000011];
+		dst[1] = palette[(src[i] & 0b00001100) >> 2];
+		dst[2] = palette[(src[i] & 0b00110000) >> 4];
+		dst[3] = palette[(src[i] & 0b11000000) >> 6];
+		dst += 4;
+	}
+}
+
+void Decode256Colors_Scalar(const byte* src, dword* dst, const dword* palette) {
+	for (int i = 0; i < 64; i++) {
+		dst[i] = palette[src[i]];
+	}
+}
+
+// Nearest-neighbour horizontal upscale of one row (width pixels -> width * factor pixels)
+void UpscaleRow_Scalar(const dword* src, int width, int factor, dword* dst) {
+	for (int i = 0; i < width; i++) {
+		for (int j = 0; j < factor; j++) {
+			*dst++ = src[i];
+		}
+	}
+}
+
+#ifdef SAS_X86
+// --- SSE2 ---
+// 4 pixels per VRS byte: every possible byte is expanded once per palette into a 16-byte row, then copied a vector at a time
+// The table is per thread (machines of a batch decode at the same time) and follows the palette's colors, not its address.
+SAS_TARGET_SSE2 void Decode4Colors_SSE2(const byte* src, dword* dst, const dword* palette) {
+	alignas(16) static thread_local dword expanded[256][4];
+	static thread_local dword expandedColors[4];
+	static thread_local bool expandedSet = false;
+	if (!expandedSet || memcmp(palette, expandedColors, sizeof(expandedColors)) != 0) {
+		for (int i = 0; i < 256; i++) {
+			for (int j = 0; j < 4; j++) {
+				expanded[i][j] = palette[(i >> (j * 2)) & 0b00000011];
+			}
+		}
+		memcpy(expandedColors, palette, sizeof(expandedColors));
+		expandedSet = true;
+	}
+
+	for (int i = 0; i < 64; i++) {
+		_mm_storeu_si128((__m128i*)(dst + i * 4), _mm_load_si128((const __m128i*)expanded[src[i]]));
+	}
+}
+
+// SSE2 has no gather, so 256-Colors stays a table lookup
+void Decode256Colors_SSE2(const byte* src, dword* dst, const dword* palette) {
+	Decode256Colors_Scalar(src, dst, palette);
+}
+
+// Factors 3 (4-Colors) and 6 (256-Colors) are the ones the 768x768 window needs
+SAS_TARGET_SSE2 void UpscaleRow_SSE2(const dword* src, int width, int factor, dword* dst) {
+	switch (factor) {
+		case 3:
+			for (int i = 0; i < width; i += 4) {
+				__m128i px = _mm_loadu_si128((const __m128i*)(src + i));
+				_mm_storeu_si128((__m128i*)(dst + 0), _mm_shuffle_epi32(px, _MM_SHUFFLE(1, 0, 0, 0)));
+				_mm_storeu_si128((__m128i*)(dst + 4), _mm_shuffle_epi32(px, _MM_SHUFFLE(2, 2, 1, 1)));
+				_mm_storeu_si128((__m128i*)(dst + 8), _mm_shuffle_epi32(px, _MM_SHUFFLE(3, 3, 3, 2)));
+				dst += 12;
+			}
+			break;
+		case 6:
+			for (int i = 0; i < width; i += 4) {
+				__m128i px = _mm_loadu_si128((const __m128i*)(src + i));
+				_mm_storeu_si128((__m128i*)(dst + 0), _mm_shuffle_epi32(px, _MM_SHUFFLE(0, 0, 0, 0)));
+				_mm_storeu_si128((__m128i*)(dst + 4), _mm_shuffle_epi32(px, _MM_SHUFFLE(1, 1, 0, 0)));
+				_mm_storeu_si128((__m128i*)(dst + 8), _mm_shuffle_epi32(px, _MM_SHUFFLE(1, 1, 1, 1)));
+				_mm_storeu_si128((__m128i*)(dst + 12), _mm_shuffle_epi32(px, _MM_SHUFFLE(2, 2, 2, 2)));
+				_mm_storeu_si128((__m128i*)(dst + 16), _mm_shuffle_epi32(px, _MM_SHUFFLE(3, 3, 2, 2)));
+				_mm_storeu_si128((__m128i*)(dst + 20), _mm_shuffle_epi32(px, _MM_SHUFFLE(3, 3, 3, 3)));
+				dst += 24;
+			}
+			break;
+		default:
+			UpscaleRow_Scalar(src, width, factor, dst);
+			break;
+	}
+}
+
+// --- AVX2 ---
+// 16 pixels per 4 VRS bytes: variable shifts pull out the 2-bit indices, and the 4 colors live in a register
+SAS_TARGET_AVX2 void Decode4Colors_AVX2(const byte* src, dword* dst, const dword* palette) {
+	const __m256i shiftsLo = _mm256_setr_epi32(0, 2, 4, 6, 8, 10, 12, 14);
+	const __m256i shiftsHi = _mm256_setr_epi32(16, 18, 20, 22, 24, 26, 28, 30);
+	const __m256i mask = _mm256_set1_epi32(0b00000011);
+	const __m256i colors = _mm256_setr_epi32(palette[0], palette[1], palette[2], palette[3], palette[0], palette[1], palette[2], palette[3]);
+
+	for (int i = 0; i < 64; i += 4) {
+		int bits;
+		memcpy(&bits, src + i, 4);
+		__m256i data = _mm256_set1_epi32(bits);
+		__m256i lo = _mm256_and_si256(_mm256_srlv_epi32(data, shiftsLo), mask);
+		__m256i hi = _mm256_and_si256(_mm256_srlv_epi32(data, shiftsHi), mask);
+		_mm256_storeu_si256((__m256i*)(dst + i * 4), _mm256_permutevar8x32_epi32(colors, lo));
+		_mm256_storeu_si256((__m256i*)(dst + i * 4 + 8), _mm256_permutevar8x32_epi32(colors, hi));
+	}
+}
+
+// 8 pixels per gather
+SAS_TARGET_AVX2 void Decode256Colors_AVX2(const byte* src, dword* dst, const dword* palette) {
+	for (int i = 0; i < 64; i += 8) {
+		__m256i index = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(src + i)));
+		_mm256_storeu_si256((__m256i*)(dst + i), _mm256_i32gather_epi32((const int*)palette, index, 4));
+	}
+}
+
+// Any factor up to 8: output vector k takes source lane (8k + j) / factor of every 8 source pixels
+SAS_TARGET_AVX2 void UpscaleRow_AVX2(const dword* src, int width, int factor, dword* dst) {
+	if (factor > 8 || (width & 7) != 0) {
+		UpscaleRow_Scalar(src, width, factor, dst);
+		return;
+	}
+	__m256i index[8];
+	for (int k = 0; k < factor; k++) {
+		int lanes[8];
+		for (int j = 0; j < 8; j++) {
+			lanes[j] = (8 * k + j) / factor;
+		}
+		index[k] = _mm256_loadu_si256((const __m256i*)lanes);
+	}
+	for (int i = 0; i < width; i += 8) {
+		__m256i px = _mm256_loadu_si256((const __m256i*)(src + i));
+		for (int k = 0; k < factor; k++) {
+			_mm256_storeu_si256((__m256i*)dst, _mm256_permutevar8x32_epi32(px, index[k]));
+			dst += 8;
+		}
+	}
+}
+#endif
+
+// Best kernel supported by the host CPU
+VideoKernel DetectVideoKernel() {
+#ifdef SAS_X86
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 0);
+	int maxLeaf = info[0];
+	__cpuid(info, 1);
+	bool sse2 = (info[3] & (1 << 26)) != 0;
+	bool osAVX = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0 && (_xgetbv(0) & 0b110) == 0b110; // <- OSXSAVE, AVX and YMM state enabled
+	bool avx2 = false;
+	if (osAVX && maxLeaf >= 7) {
+		__cpuidex(info, 7, 0);
+		avx2 = (info[1] & (1 << 5)) != 0;
+	}
+#else
+	__builtin_cpu_init();
+	bool sse2 = __builtin_cpu_supports("sse2");
+	bool avx2 = __builtin_cpu_supports("avx2");
+#endif
+	if (avx2) {
+		return KERNEL_AVX2;
+	}
+	if (sse2) {
+		return KERNEL_SSE2;
+	}
+#endif
+	return KERNEL_SCALAR;
+}
+
+// Kernels in use
+VideoKernel videoKernel = KERNEL_SCALAR;
+DecodeKernel Decode4Colors = Decode4Colors_Scalar;
+DecodeKernel Decode256Colors = Decode256Colors_Scalar;
+UpscaleKernel UpscaleRow = UpscaleRow_Scalar;
+
+// Pick the kernels for the given level (defaults to the best one the host supports)
+void SelectVideoKernels(VideoKernel kernel) {
+	if (kernel > DetectVideoKernel()) {
+		kernel = DetectVideoKernel();
+	}
+	videoKernel = kernel;
+	switch (kernel) {
+		case KERNEL_SCALAR:
+			Decode4Colors = Decode4Colors_Scalar;
+			Decode256Colors = Decode256Colors_Scalar;
+			UpscaleRow = UpscaleRow_Scalar;
+			break;
+#ifdef SAS_X86
+		case KERNEL_SSE2:
+			Decode4Colors = Decode4Colors_SSE2;
+			Decode256Colors = Decode256Colors_SSE2;
+			UpscaleRow = UpscaleRow_SSE2;
+			break;
+		case KERNEL_AVX2:
+			Decode4Colors = Decode4Colors_AVX2;
+			Decode256Colors = Decode256Colors_AVX2;
+			UpscaleRow = UpscaleRow_AVX2;
+			break;
+#endif
+	}
+}
+
+void SelectVideoKernels() {
+	SelectVideoKernels(DetectVideoKernel());
+}
+
+// Nearest-neighbour upscale of a block of rows -- each source row is expanded once and then copied factor - 1 times
+void UpscaleRows(const dword* src, int srcPitch, int width, int rows, int factor, dword* dst, int dstPitch) {
+	for (int row = 0; row < rows; row++) {
+		dword* line = dst + row * factor * dstPitch;
+		UpscaleRow(src + row * srcPitch, width, factor, line);
+		for (int j = 1; j < factor; j++) {
+			memcpy(line + j * dstPitch, line, width * factor * sizeof(dword));
+		}
+	}
+}
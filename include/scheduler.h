@@ -0,0 +1,101 @@
+// Event Scheduler -- device events keyed by the emulated cycle they are due at
+// The machine runs the CPU exactly to the next event, then services the due events in cycle order (a min-heap, events due
+// at the same cycle run in the order they were scheduled). Host threads (window, keyboard) can't know the emulated time,
+// so they post their events instead: they are serviced at the next event boundary, stamped with its cycle.
+class Scheduler {
+public:
+	typedef void (*Callback)(void* context, unsigned long long data);
+
+private:
+	struct Event {
+		unsigned long long when; // Emulated cycle
+		unsigned long long period; // Cycles to the next occurrence (0: once)
+		unsigned long long order; // Scheduling order
+		Callback callback;
+		void* context;
+		unsigned long long data;
+	};
+
+	// Heap order -- the earliest event on top
+	struct Later {
+		bool operator()(const Event& a, const Event& b) const {
+			return a.when != b.when ? a.when > b.when : a.order > b.order;
+		}
+	};
+
+	std::vector<Event> events; // Min-heap on when
+	unsigned long long order = 0; // Events scheduled so far
+	unsigned int once = 0; // Events in the heap that won't come back
+
+	// Events posted by host threads
+	std::mutex postLock;
+	std::vector<Event> posted;
+	std::vector<Event> taken; // <- Posted events being serviced (kept to reuse its storage)
+	std::atomic<bool> hasPosted{ false };
+
+public:
+	unsigned long long serviced = 0; // Events serviced
+
+	// Schedule an event at an emulated cycle (period: cycles between occurrences, 0: once) -- CPU thread only
+	void schedule(unsigned long long when, Callback callback, void* context, unsigned long long data = 0, unsigned long long period = 0) {
+		events.push_back({ when, period, order++, callback, context, data });
+		std::push_heap(events.begin(), events.end(), Later());
+		if (period == 0) {
+			once++;
+		}
+	}
+
+	// Post an event from another thread, serviced at the next event boundary
+	void post(Callback callback, void* context, unsigned long long data = 0) {
+		std::lock_guard<std::mutex> lock(postLock);
+		posted.push_back({ 0, 0, 0, callback, context, data });
+		hasPosted = true;
+	}
+
+	// Cycle of the next event (~0: none)
+	unsigned long long next() const {
+		return events.empty() ? ~0ULL : events.front().when;
+	}
+
+	// Events waiting to be serviced that won't come back (device completions), posted ones included
+	bool pending() const {
+		return once > 0 || hasPosted;
+	}
+
+	bool postPending() const {
+		return hasPosted;
+	}
+
+	// Service the events due at the current cycle, then the posted ones -- events may schedule more events
+	void service(unsigned long long now) {
+		while (!events.empty() && events.front().when <= now) {
+			std::pop_heap(events.begin(), events.end(), Later());
+			Event event = events.back();
+			events.pop_back();
+			if (event.period != 0) {
+				Event again = event;
+				again.when += event.period;
+				again.order = order++;
+				events.push_back(again);
+				std::push_heap(events.begin(), events.end(), Later());
+			}
+			else {
+				once--;
+			}
+			event.callback(event.context, event.data);
+			serviced++;
+		}
+		if (hasPosted) {
+			{
+				std::lock_guard<std::mutex> lock(postLock);
+				taken.swap(posted);
+				hasPosted = false;
+			}
+			for (unsigned int i = 0; i < taken.size(); i++) {
+				taken[i].callback(taken[i].context, taken[i].data);
+				serviced++;
+			}
+			taken.clear();
+		}
+	}
+};
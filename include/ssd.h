@@ -1,90 +1,806 @@
-extern byte Memory[0x10000];
-extern bool IRQ;
-extern VIA6522 viaTwo;
+// SSD Flush Policies -- when guest writes reach the disk image
+// The image is mapped shared, so every write is in the host page cache as soon as the DMA ends (it survives an emulator crash).
+enum FlushPolicy {
+	FLUSH_IMMEDIATE = 0, // Sync the touched pages after every write
+	FLUSH_PERIODIC = 1, // Sync the dirty pages from a background thread every flushInterval ms
+	FLUSH_SHUTDOWN = 2 // Sync the dirty pages when the storage is closed
+};
+const char* FlushPolicyName[3] = { "immediate", "periodic", "shutdown" };
+
+// SSD DMA Command -- the latched registers of one transfer
+struct SSDCommand {
+	bool RW; // 1: SSD -> RAM, 0: RAM -> SSD
+	word DSR; // Destination/Source (RAM)
+	unsigned int AR; // Address (SSD)
+	word OR; // Length
+};
 
 // Solid State Disk
 class SSD {
+public:
+	static const unsigned int STORAGE_SIZE = 0x400000; // Storage Capacity (4MB, the 22 bits the latch addresses)
+	static const unsigned int MAX_STORAGE_SIZE = 0x10000000; // Largest image (256MB, 64 banks of STORAGE_SIZE)
+	static const unsigned int PAGE_SIZE = 0x1000; // Dirty tracking granularity
+
+	// Controller Commands -- written to VIA 3's port B (bits 6-7: 01 selects a bank, 1x rings a doorbell)
+	static const byte CMD_CHAIN = 0x01; // Run the descriptor chain whose RAM address is on the address bus (bytes 0 and 1)
+	static const byte CMD_QUEUES = 0x02; // Set up the queues from the block whose RAM address is on the address bus
+	static const byte CMD_BANK = 0x40; // CMD_BANK | n: SSD address bits 22-27 of the transfers submitted after it
+
+	// Descriptor Chains -- a list of transfers in RAM, run as one command with a single completion
+	// Entry: RAM address (2 bytes), SSD address (3 bytes, byte 2 as in the latch: bits 0-5, 6: RW, 7: last entry), length (2 bytes), reserved
+	static const unsigned int DESCRIPTOR_SIZE = 8;
+	static const unsigned int MAX_DESCRIPTORS = 0x10000 / DESCRIPTOR_SIZE; // <- A chain can't run past the end of RAM
+	static const unsigned int DESCRIPTOR_CYCLES = 8; // Fetching an entry (a byte per cycle)
+
+	// Queued Interface -- a submission and a completion ring in RAM, commands run on CHANNELS at once
+	// Queue block: SQ address (2 bytes), CQ address (2 bytes), entries (a power of two, 2 to 64), interrupt every n
+	// completions (0: 1), or this many cycles after the first one not signaled (2 bytes, 0: never)
+	// Submission entry: a chain descriptor (bit 7 of its SSD address byte 2 is ignored), the reserved byte is the command id
+	// Completion entry: command id, status (STATUS_*), SQ head, phase (bit 0, flips on every pass over the ring), the
+	// emulated cycle the command ended at (4 bytes, low bits)
+	// The guest rings the doorbells with one write to VIA 3's port B: DOORBELL_SQ | the new SQ tail after queuing
+	// entries, DOORBELL_CQ | the new CQ head after taking completions (the controller holds completions while the ring is full).
+	static const byte DOORBELL_SQ = 0x80;
+	static const byte DOORBELL_CQ = 0xC0;
+	static const unsigned int MAX_QUEUE_ENTRIES = 64;
+	static const unsigned int SUBMISSION_SIZE = DESCRIPTOR_SIZE;
+	static const unsigned int COMPLETION_SIZE = 8;
+	static const unsigned int CHANNELS = 4;
+	enum {
+		STATUS_OK = 0,
+		STATUS_OUT_OF_RANGE = 1 // <- The transfer runs past the end of the storage (not executed)
+	};
+
 private:
+	// Board
+	byte* const Memory;
+	std::atomic<unsigned int>& Lines; // CPU lines (IRQ through VIA 2)
+	VIA6522& viaTwo; // Signals the completion of commands (CA1)
+	VRSDirtyMap& vrsDirty;
+	DecodeCache& icache;
+
 	unsigned int addressBus = 0; // Address Bus
 	bool RW = 0; // Read/Write
 	unsigned int AR = 0; // Address Register
 	word OR = 0; // Offset Register
 	word DSR = 0; // Destination/Source Register
-	byte storage[0x400000]; // Storage
+	byte bank = 0; // Bank Register (CMD_BANK)
+	byte* storage = NULL; // Storage -- the disk image, mapped into memory (a sparse image: its clusters, read on demand)
+	unsigned int capacity = STORAGE_SIZE; // Image size (a power of two), SSD addresses wrap around it
+	SparseImage sparse; // The image file, when it's sparse (an overlay: the overlay file, the clusters written go there)
+	SparseImage base; // An overlay's image, when it's sparse (only read)
+	bool sparseImage = false; // <- The storage is anonymous memory the image's clusters are read into
+	bool overlay = false; // The image is only read, the writes go to an overlay (-storage-overlay)
+	std::mutex storageLock; // <- Writes into a sparse image's clusters vs. the flush copying them out
+	std::mutex imageLock; // <- The sparse image file: clusters read on demand vs. the flush writing them
+	std::vector<byte> clusterCopy; // A cluster being flushed
+	std::vector<std::atomic<unsigned long long>> loadedClusters; // 1 bit per cluster of a sparse image read into storage
 	bool offsetSet = false; // OR is Set
 	bool addressSet = false; // AR is Set
 	bool dsrSet = false; // DSR is Set
+	unsigned int lastCycles = 0; // Emulated time the last command submitted takes
+
+	// Queued Interface (CPU thread)
+	bool queuesSet = false; // The guest has set up the queues
+	word sqBase = 0; // Submission ring
+	word cqBase = 0; // Completion ring
+	byte queueEntries = 0;
+	byte sqHead = 0, sqTail = 0; // <- Controller takes at head, guest queues at tail
+	byte cqHead = 0, cqTail = 0; // <- Controller posts at tail, guest takes at head
+	byte phase = 1;
+	byte coalesceCount = 1;
+	word coalesceCycles = 0;
+	byte unsignaled = 0; // Completions posted since the last interrupt
+	unsigned long long interruptGeneration = 0; // Bumped by every interrupt (coalescing timers started before it are stale)
+	unsigned long long channelFree[CHANNELS] = {}; // Cycle every channel is done at
+	std::vector<unsigned long long> backlog; // Completions waiting for room in the ring (packed, see takeSubmission())
 	char SSDPath[100]; // Path to SSD Image File
+#ifdef _WIN32
+	HANDLE imageFile = INVALID_HANDLE_VALUE; // Image File
+	HANDLE imageMapping = NULL; // File Mapping of the Image
+#else
+	int imageFile = -1; // Image File
+#endif
 
-	// Receive data from RAM and store it into SSD
-	void receiveData() {
-		std::ofstream img;
+	// Dirty Pages -- 1 bit per 4kb page of the image written since the last flush
+	std::vector<std::atomic<unsigned long long>> dirtyPages;
+	// Touched Pages -- 1 bit per 4kb page of the image a transfer went through (the pages mapped in so far)
+	std::vector<std::atomic<unsigned long long>> touchedPages;
+	// Periodic Flush
+	std::thread flushThread;
+	std::mutex flushLock;
+	std::condition_variable flushSignal;
+	bool flushStop = false;
+
+	// Mark the pages of a range of the image in a page map (dirtyPages, touchedPages)
+	void markPages(std::vector<std::atomic<unsigned long long>>& pageMap, unsigned int address, unsigned int length) {
+		for (unsigned int i = address / PAGE_SIZE; i <= (address + length - 1) / PAGE_SIZE; i++) {
+			unsigned int page = i % (capacity / PAGE_SIZE); // <- Transfers past the end wrap around
+			pageMap[page >> 6].fetch_or(1ULL << (page & 63), std::memory_order_relaxed);
+		}
+	}
+
+	// Size the page maps for the image (before the threads using them start)
+	void allocatePageMaps() {
+		unsigned int words = (capacity / PAGE_SIZE + 63) / 64;
+		std::vector<std::atomic<unsigned long long>>(words).swap(dirtyPages); // <- Value-initialized: all clear
+		std::vector<std::atomic<unsigned long long>>(words).swap(touchedPages);
+	}
+
+	// Map a raw image (its capacity comes from the file size)
+	// Copy-on-write for an overlay: the file is opened read only, the pages never written stay the page cache's (shared
+	// by every machine on the image) and a page written becomes a private copy.
+	bool mapImage(bool copyOnWrite) {
+#ifdef _WIN32
+		LARGE_INTEGER size;
+		imageFile = CreateFileA(SSDPath, copyOnWrite ? GENERIC_READ : GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (imageFile == INVALID_HANDLE_VALUE || !GetFileSizeEx(imageFile, &size) || rawCapacity(size.QuadPart) == 0) {
+			std::cerr << "Fatal Error: Couldn't load the SSD disk image!\n";
+			closeStorage();
+			return false;
+		}
+		capacity = rawCapacity(size.QuadPart);
+		allocatePageMaps();
+		imageMapping = CreateFileMappingA(imageFile, NULL, copyOnWrite ? PAGE_WRITECOPY : PAGE_READWRITE, 0, capacity, NULL);
+		if (imageMapping != NULL) {
+			storage = (byte*)MapViewOfFile(imageMapping, copyOnWrite ? FILE_MAP_COPY : FILE_MAP_ALL_ACCESS, 0, 0, capacity);
+		}
+#else
+		struct stat info;
+		imageFile = open(SSDPath, copyOnWrite ? O_RDONLY : O_RDWR);
+		if (imageFile < 0 || fstat(imageFile, &info) != 0 || rawCapacity(info.st_size) == 0) {
+			std::cerr << "Fatal Error: Couldn't load the SSD disk image!\n";
+			closeStorage();
+			return false;
+		}
+		capacity = rawCapacity(info.st_size);
+		allocatePageMaps();
+		storage = (byte*)mmap(NULL, capacity, PROT_READ | PROT_WRITE, copyOnWrite ? MAP_PRIVATE : MAP_SHARED, imageFile, 0);
+		if (storage == MAP_FAILED) {
+			storage = NULL;
+		}
+		else {
+			madvise(storage, capacity, MADV_RANDOM); // <- No read-ahead, a transfer faults in its own pages
+		}
+#endif
+		if (storage == NULL) {
+			std::cerr << "Fatal Error: Couldn't map the SSD disk image!\n";
+			closeStorage();
+			return false;
+		}
+		return true;
+	}
+
+	// Memory for a sparse image -- zero pages mapped on demand, so the clusters never written cost nothing
+	bool allocateStorage() {
+#ifdef _WIN32
+		storage = (byte*)VirtualAlloc(NULL, capacity, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+		storage = (byte*)mmap(NULL, capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		if (storage == MAP_FAILED) {
+			storage = NULL;
+		}
+#endif
+		return storage != NULL;
+	}
+
+	// Read the clusters of a sparse image a transfer goes through, the first time (until then they are zero pages)
+	// With an overlay, its clusters come first, then the sparse image's (a raw image is already mapped under them).
+	void loadClusters(unsigned int address, unsigned int length) {
+		if (!(sparseImage || overlay) || length == 0) {
+			return;
+		}
+		for (unsigned int i = address / sparse.clusterSize; i <= (address + length - 1) / sparse.clusterSize; i++) {
+			unsigned int cluster = i % sparse.clusters(); // <- Transfers past the end wrap around
+			unsigned long long bit = 1ULL << (cluster & 63);
+			if ((loadedClusters[cluster >> 6].load(std::memory_order_acquire) & bit) != 0) {
+				continue;
+			}
+			std::lock_guard<std::mutex> lock(imageLock);
+			if ((loadedClusters[cluster >> 6].load(std::memory_order_relaxed) & bit) != 0) {
+				continue; // <- Read by another thread meanwhile
+			}
+			byte* data = storage + (size_t)cluster * sparse.clusterSize;
+			bool ok = true;
+			if (sparse.present(cluster)) {
+				ok = sparse.readCluster(cluster, data);
+			}
+			else if (overlay && sparseImage && base.present(cluster)) {
+				ok = base.readCluster(cluster, data);
+			}
+			if (!ok) {
+				printf("Error: Couldn't read from SSD disk image.\n");
+			}
+			loadedClusters[cluster >> 6].fetch_or(bit, std::memory_order_release);
+		}
+	}
 
-		for (ushort i = 0; i < OR; i++) {
-			storage[AR + i] = Memory[DSR + i];
+	// Open the overlay of the image (an empty one the first time), its clusters are read like a sparse image's
+	// Its clusters are the size of a sparse image's, so committing it replaces whole clusters of the image.
+	bool openOverlay(const char* path, unsigned int clusterSize) {
+		FILE* existing = fopen(path, "rb");
+		if (existing != NULL) {
+			fclose(existing);
+		}
+		else if (!SparseImage::create(path, capacity, SparseImage::FLAG_OVERLAY | SparseImage::FLAG_COMPRESS, clusterSize)) {
+			std::cerr << "Fatal Error: Couldn't create the overlay " << path << "!\n";
+			return false;
 		}
+		if (!sparse.open(path) || (sparse.flags & SparseImage::FLAG_OVERLAY) == 0 || sparse.capacity != capacity || sparse.clusterSize != clusterSize) {
+			std::cerr << "Fatal Error: " << path << " isn't an overlay of the SSD disk image!\n";
+			return false;
+		}
+		clusterCopy.resize(sparse.clusterSize);
+		return true;
+	}
 
-		img.open(SSDPath, std::ios::binary);
-		if (img.is_open()) {
-			for (unsigned int i = 0; i < 0x400000; i++) {
-				img << storage[i];
+	// Write the clusters with dirty pages back to a sparse image (or to the overlay)
+	bool flushClusters() {
+		unsigned int pagesPerCluster = sparse.clusterSize / PAGE_SIZE;
+		unsigned int last = ~0u;
+		bool written = false;
+		bool ok = true;
+		for (unsigned int i = 0; i < dirtyPages.size(); i++) {
+			unsigned long long pages = dirtyPages[i].exchange(0, std::memory_order_acquire);
+			for (unsigned int bit = 0; bit < 64 && pages != 0; bit++) {
+				if ((pages & (1ULL << bit)) == 0) {
+					continue;
+				}
+				pages &= ~(1ULL << bit);
+				unsigned int cluster = (i * 64 + bit) / pagesPerCluster;
+				if (cluster == last) {
+					continue; // <- Pages come in order, a cluster's other pages follow it
+				}
+				last = cluster;
+				{
+					std::lock_guard<std::mutex> lock(storageLock);
+					memcpy(clusterCopy.data(), storage + (size_t)cluster * sparse.clusterSize, sparse.clusterSize);
+				}
+				std::lock_guard<std::mutex> lock(imageLock);
+				ok = sparse.writeCluster(cluster, clusterCopy.data()) && ok;
+				written = true;
+				syncs++;
 			}
 		}
+		std::lock_guard<std::mutex> lock(imageLock);
+		return written ? sparse.sync() && ok : ok;
+	}
+
+	// Write a range of pages back to the image file
+	bool syncPages(unsigned int firstPage, unsigned int pages) {
+		syncs++;
+#ifdef _WIN32
+		return FlushViewOfFile(storage + firstPage * PAGE_SIZE, pages * PAGE_SIZE) && FlushFileBuffers(imageFile);
+#else
+		return msync(storage + firstPage * PAGE_SIZE, pages * PAGE_SIZE, MS_SYNC) == 0;
+#endif
+	}
+
+	// Sync the dirty pages of a raw image
+	bool flushPages() {
+		bool ok = true;
+		for (unsigned int i = 0; i < dirtyPages.size(); i++) {
+			unsigned long long pages = dirtyPages[i].exchange(0, std::memory_order_acquire);
+			unsigned int first = 0;
+			while (first < 64) { // <- One sync per run of contiguous dirty pages
+				if ((pages & (1ULL << first)) == 0) {
+					first++;
+					continue;
+				}
+				unsigned int last = first;
+				while (last < 63 && (pages & (1ULL << (last + 1))) != 0) {
+					last++;
+				}
+				ok = syncPages(i * 64 + first, last - first + 1) && ok;
+				first = last + 1;
+			}
+		}
+		return ok;
+	}
+
+	// Background flush every flushInterval ms
+	void flushLoop() {
+		std::unique_lock<std::mutex> lock(flushLock);
+		while (!flushStop) {
+			flushSignal.wait_for(lock, std::chrono::milliseconds(flushInterval));
+			flush();
+		}
+	}
+
+	// I/O Worker -- executes the queued commands in order
+	RingQueue<SSDCommand, 64> commands;
+	std::thread worker;
+	std::mutex workerLock;
+	std::condition_variable workerSignal;
+	std::atomic<bool> workerIdle{ false };
+	bool workerStop = false;
+
+	void workerLoop() {
+		SSDCommand command;
+		while (true) {
+			if (commands.pop(command)) {
+				auto start = std::chrono::steady_clock::now();
+				execute(command);
+				unsigned long long time = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+				serviceTime += time;
+				if (time > maxServiceTime) {
+					maxServiceTime = time;
+				}
+				served++;
+				continue;
+			}
+			std::unique_lock<std::mutex> lock(workerLock);
+			workerIdle = true;
+			workerSignal.wait(lock, [this] { return workerStop || !commands.empty(); });
+			workerIdle = false;
+			if (workerStop && commands.empty()) {
+				return;
+			}
+		}
+	}
+
+	// Take the latched registers as a command and clear the latch for the next one (DSR stays set)
+	SSDCommand takeCommand() {
+		SSDCommand command = { RW, DSR, AR | ((unsigned int)bank << 22), OR };
+		RW = addressBus = 0;
+		addressSet = offsetSet = false;
+		return command;
+	}
+
+	// Execute a command (its completion is signaled apart, see complete())
+	void execute(const SSDCommand& command) {
+		if (command.RW == 1) {
+			sendData(command);
+		}
 		else {
-			printf("Error: Couldn't write to SSD disk image.\n");
+			receiveData(command);
 		}
-		img.close();
+	}
 
-		viaTwo.CA1 = true;
-		viaTwo.setInterrupt();
-		IRQ = viaTwo.checkInterrupt();
+	// Receive data from RAM and store it into SSD
+	void receiveData(const SSDCommand& command) {
+		loadClusters(command.AR, command.OR);
+		{
+			std::lock_guard<std::mutex> lock(storageLock);
+			for (ushort i = 0; i < command.OR; i++) {
+				storage[(command.AR + i) & (capacity - 1)] = Memory[(command.DSR + i) & 0xFFFF];
+			}
+		}
+		if (command.OR != 0) {
+			markPages(touchedPages, command.AR, command.OR);
+			markPages(dirtyPages, command.AR, command.OR);
+			if (flushPolicy == FLUSH_IMMEDIATE) {
+				flush();
+			}
+		}
 	}
 
 	// Send data from SSD and store it into RAM
-	void sendData() {
-		for (ushort i = 0; i < OR; i++) {
-			Memory[DSR + i] = storage[AR + i];
+	void sendData(const SSDCommand& command) {
+		loadClusters(command.AR, command.OR);
+		for (ushort i = 0; i < command.OR; i++) {
+			Memory[(command.DSR + i) & 0xFFFF] = storage[(command.AR + i) & (capacity - 1)];
 		}
-		viaTwo.CA1 = true;
-		viaTwo.setInterrupt();
-		IRQ = viaTwo.checkInterrupt();
+		if (command.OR != 0) {
+			markPages(touchedPages, command.AR, command.OR);
+		}
+		vrsDirty.markRange(command.DSR, command.OR);
+		icache.invalidateRange(command.DSR, command.OR);
 	}
 
 public:
-	// Initialize Storage
-	bool initializeStorage(char * path) {
-		strcpy_s(SSDPath, _countof(SSDPath), path);
+	FlushPolicy flushPolicy = FLUSH_PERIODIC; // When writes are synced to the image file
+	unsigned int flushInterval = 1000; // Periodic flush interval (ms)
+	std::atomic<unsigned long long> syncs{ 0 }; // Page ranges synced to the image file
+	// I/O Worker Counters
+	std::atomic<unsigned long long> submitted{ 0 }; // Commands queued
+	std::atomic<unsigned long long> served{ 0 }; // Commands executed
+	std::atomic<unsigned long long> serviceTime{ 0 }; // Total time spent executing commands (ns)
+	std::atomic<unsigned long long> maxServiceTime{ 0 }; // Slowest command (ns)
+	std::atomic<unsigned int> maxDepth{ 0 }; // Deepest the queue has been
+	unsigned long long chains = 0; // Descriptor chains submitted
+	unsigned long long queuedCommands = 0; // Commands taken from the submission ring
+	unsigned long long queueInterrupts = 0; // Interrupts raised for queue completions
 
-		std::vector<char> IMG(0x400000); // Contents of the Image file
-		std::ifstream img(SSDPath, std::ios::binary); // Image file
+	SSD(Board& board) : Memory(board.Memory), Lines(board.Lines), viaTwo(board.viaTwo), vrsDirty(board.vrsDirty), icache(board.icache) {
+		allocatePageMaps();
+	}
 
-		if (!img.read(IMG.data(), 0x400000)) {
-			std::cerr << "Fatal Error: Couldn't load the SSD disk image!\n";
-			return false;
+	~SSD() {
+		closeStorage();
+	}
+
+	// Capacity of a raw image: the largest power of two that fits in the file, up to MAX_STORAGE_SIZE (0: too small)
+	static unsigned int rawCapacity(unsigned long long size) {
+		if (size < STORAGE_SIZE) {
+			return 0;
 		}
-		img.close();
+		unsigned int capacity = STORAGE_SIZE;
+		while (capacity < MAX_STORAGE_SIZE && capacity * 2ULL <= size) {
+			capacity *= 2;
+		}
+		return capacity;
+	}
+
+	// Initialize Storage -- map the image file into memory
+	// Nothing is read here: a page of the image is faulted in the first time a transfer goes through it, so a machine
+	// costs what its guest loads (and the pages come from the host page cache, shared by the machines using the image).
+	// A sparse image goes into anonymous memory instead, a cluster is read the first time a transfer goes through it.
+	// With an overlay (overlayPath) the image is never written: the clusters written go to the overlay file and are
+	// read back over the image the next time, until the overlay is committed into the image or discarded.
+	bool initializeStorage(char * path, const char* overlayPath = NULL) {
+		strcpy_s(SSDPath, _countof(SSDPath), path);
+		overlay = overlayPath != NULL;
+		unsigned int clusterSize = SparseImage::CLUSTER_SIZE;
 
-		for (unsigned int i = 0; i < 0x400000; i++) {
-			storage[i] = IMG[i];
+		sparseImage = SparseImage::detect(SSDPath);
+		if (sparseImage) {
+			SparseImage& image = overlay ? base : sparse; // <- An overlay's image is only read
+			if (!image.open(SSDPath, !overlay) || rawCapacity(image.capacity) != image.capacity || image.clusterSize > image.capacity) {
+				std::cerr << "Fatal Error: Couldn't load the SSD disk image!\n";
+				closeStorage();
+				return false;
+			}
+			if ((image.flags & SparseImage::FLAG_OVERLAY) != 0) {
+				std::cerr << "Fatal Error: " << SSDPath << " is an overlay, use it with -storage-overlay!\n";
+				closeStorage();
+				return false;
+			}
+			capacity = (unsigned int)image.capacity;
+			clusterSize = image.clusterSize;
+			allocatePageMaps();
+			clusterCopy.resize(image.clusterSize);
+			if (!allocateStorage()) {
+				std::cerr << "Fatal Error: Couldn't allocate the SSD storage!\n";
+				closeStorage();
+				return false;
+			}
+		}
+		else if (!mapImage(overlay)) {
+			return false;
 		}
+		if (overlay && !openOverlay(overlayPath, clusterSize)) {
+			closeStorage();
+			return false;
+		}
+		std::vector<std::atomic<unsigned long long>>((capacity / clusterSize + 63) / 64).swap(loadedClusters);
 
-		IMG.clear();
-		IMG.shrink_to_fit();
+		if (flushPolicy == FLUSH_PERIODIC) {
+			flushStop = false;
+			flushThread = std::thread(&SSD::flushLoop, this);
+		}
+		workerStop = false;
+		worker = std::thread(&SSD::workerLoop, this);
 		return true;
 	}
 
-	// Execute the Read or Write Instruction
+	// Sync every dirty page to the image file (a sparse image or an overlay: write their clusters)
+	bool flush() {
+		bool ok = sparseImage || overlay ? flushClusters() : flushPages();
+		if (!ok) {
+			printf("Error: Couldn't write to SSD disk image.\n");
+		}
+		return ok;
+	}
+
+	// Close Storage -- stop the periodic flush, sync what is left and unmap the image
+	void closeStorage() {
+		if (worker.joinable()) { // <- Commands already queued are executed first
+			{
+				std::lock_guard<std::mutex> lock(workerLock);
+				workerStop = true;
+			}
+			workerSignal.notify_one();
+			worker.join();
+		}
+		if (flushThread.joinable()) {
+			{
+				std::lock_guard<std::mutex> lock(flushLock);
+				flushStop = true;
+			}
+			flushSignal.notify_one();
+			flushThread.join();
+		}
+		if (storage != NULL) {
+			flush();
+		}
+#ifdef _WIN32
+		if (storage != NULL && sparseImage) {
+			VirtualFree(storage, 0, MEM_RELEASE);
+		}
+		else if (storage != NULL) {
+			UnmapViewOfFile(storage);
+		}
+		if (imageMapping != NULL) {
+			CloseHandle(imageMapping);
+		}
+		if (imageFile != INVALID_HANDLE_VALUE) {
+			CloseHandle(imageFile);
+		}
+		imageMapping = NULL;
+		imageFile = INVALID_HANDLE_VALUE;
+#else
+		if (storage != NULL) {
+			munmap(storage, capacity);
+		}
+		if (imageFile >= 0) {
+			close(imageFile);
+		}
+		imageFile = -1;
+#endif
+		sparse.close();
+		base.close();
+		storage = NULL;
+	}
+
+	// Execute the Read or Write Instruction right away (on the calling thread)
 	void executeInstruction() {
 		if (dsrSet && addressSet && offsetSet) {
-			if (RW == 1) {
-				sendData();
+			execute(takeCommand());
+			complete();
+		}
+	}
+
+	// Emulated time the last command submitted takes: the set-up, then a byte per cycle (the machine signals its completion then)
+	// A chain is set up once, then every entry is fetched and transferred.
+	static const unsigned int SETUP_CYCLES = 400; // <- 100us at 4MHz
+	unsigned int commandCycles() const {
+		return lastCycles;
+	}
+
+	// Queue the Read or Write Instruction for the I/O worker (waits for a free slot if the queue is full)
+	// Returns the number of the command (0: the instruction wasn't complete), complete it with complete(number)
+	unsigned long long submitInstruction() {
+		if (!(dsrSet && addressSet && offsetSet)) {
+			return 0;
+		}
+		SSDCommand command = takeCommand();
+		lastCycles = SETUP_CYCLES + command.OR;
+		return submit(command);
+	}
+
+	// Queue the transfers of a descriptor chain (its RAM address is on the address bus), up to the entry marked last
+	// Returns the number of the last transfer, the completion of the chain
+	unsigned long long submitChain() {
+		word entry = addressBus & 0xFFFF;
+		addressBus = 0;
+		unsigned long long number = 0;
+		lastCycles = SETUP_CYCLES;
+		for (unsigned int i = 0; i < MAX_DESCRIPTORS; i++) {
+			byte control = Memory[(word)(entry + 4)];
+			SSDCommand command = readDescriptor(entry);
+			number = submit(command);
+			lastCycles += DESCRIPTOR_CYCLES + command.OR;
+			if ((control & 0b10000000) != 0) {
+				break;
 			}
-			else {
-				receiveData();
+			entry += DESCRIPTOR_SIZE;
+		}
+		chains++;
+		return number;
+	}
+
+	// Set up the queued interface from the block whose RAM address is on the address bus (false: invalid block)
+	bool setUpQueues() {
+		word block = addressBus & 0xFFFF;
+		addressBus = 0;
+		byte entries = Memory[(word)(block + 4)];
+		queuesSet = entries >= 2 && entries <= MAX_QUEUE_ENTRIES && (entries & (entries - 1)) == 0;
+		if (!queuesSet) {
+			return false;
+		}
+		sqBase = Memory[block] | (Memory[(word)(block + 1)] << 8);
+		cqBase = Memory[(word)(block + 2)] | (Memory[(word)(block + 3)] << 8);
+		queueEntries = entries;
+		coalesceCount = Memory[(word)(block + 5)] != 0 ? Memory[(word)(block + 5)] : 1;
+		coalesceCycles = Memory[(word)(block + 6)] | (Memory[(word)(block + 7)] << 8);
+		sqHead = sqTail = cqHead = cqTail = 0;
+		phase = 1;
+		unsignaled = 0;
+		backlog.clear();
+		return true;
+	}
+
+	// SQ doorbell -- the guest queued entries up to tail
+	void ringSubmission(byte tail) {
+		if (queuesSet) {
+			sqTail = tail & (queueEntries - 1);
+		}
+	}
+
+	// Take the next queued submission and start it on the first free channel (false: the ring is empty)
+	// when: the cycle it ends at, completion: what postCompletion() needs (command number, id << 48, status << 56)
+	bool takeSubmission(unsigned long long now, unsigned long long& when, unsigned long long& completion) {
+		if (!queuesSet || sqHead == sqTail) {
+			return false;
+		}
+		word entry = sqBase + sqHead * SUBMISSION_SIZE;
+		SSDCommand command = readDescriptor(entry);
+		byte id = Memory[(word)(entry + 7)];
+		sqHead = (sqHead + 1) & (queueEntries - 1);
+		byte status = command.AR + command.OR > capacity ? STATUS_OUT_OF_RANGE : STATUS_OK;
+		unsigned int channel = 0;
+		for (unsigned int i = 1; i < CHANNELS; i++) {
+			if (channelFree[i] < channelFree[channel]) {
+				channel = i;
 			}
-			RW = addressBus = 0;
-			addressSet = offsetSet = false;
 		}
+		when = std::max(now, channelFree[channel]) + SETUP_CYCLES + (status == STATUS_OK ? command.OR : 0);
+		channelFree[channel] = when;
+		unsigned long long number = status == STATUS_OK ? submit(command) : 0;
+		completion = number | ((unsigned long long)id << 48) | ((unsigned long long)status << 56);
+		queuedCommands++;
+		return true;
+	}
+
+	// A queued command has taken its time, post its completion (true: start the coalescing timer, see coalesceTimeout())
+	bool postCompletion(unsigned long long completion, unsigned long long now) {
+		while (served < (completion & 0xFFFFFFFFFFFFULL)) {
+			std::this_thread::yield();
+		}
+		if (!backlog.empty() || cqFull()) {
+			backlog.push_back(completion); // <- Posted when the guest makes room (CQ doorbell)
+			return false;
+		}
+		return post(completion, now);
+	}
+
+	// CQ doorbell -- the guest took the completions up to head (true: start the coalescing timer)
+	bool ringCompletion(byte head, unsigned long long now) {
+		if (!queuesSet) {
+			return false;
+		}
+		cqHead = head & (queueEntries - 1);
+		bool timer = false;
+		unsigned int posted = 0;
+		while (posted < backlog.size() && !cqFull()) {
+			timer = post(backlog[posted++], now) || timer;
+		}
+		backlog.erase(backlog.begin(), backlog.begin() + posted);
+		return timer;
+	}
+
+	// The coalescing timer started for generation ran out -- signal what was posted since
+	void coalesceTimeout(unsigned long long generation) {
+		if (generation == interruptGeneration && unsignaled > 0) {
+			signalQueue();
+		}
+	}
+
+	unsigned int coalesceDelay() const {
+		return coalesceCycles;
+	}
+
+	unsigned long long generation() const {
+		return interruptGeneration;
+	}
+
+private:
+	// Read a chain descriptor (or submission entry) from RAM
+	SSDCommand readDescriptor(word entry) {
+		byte control = Memory[(word)(entry + 4)];
+		SSDCommand command;
+		command.RW = (control & 0b01000000) != 0;
+		command.DSR = Memory[entry] | (Memory[(word)(entry + 1)] << 8);
+		command.AR = Memory[(word)(entry + 2)] | (Memory[(word)(entry + 3)] << 8) | ((control & 0b00111111) << 16) | ((unsigned int)bank << 22);
+		command.OR = Memory[(word)(entry + 5)] | (Memory[(word)(entry + 6)] << 8);
+		return command;
+	}
+
+	bool cqFull() const {
+		return ((cqTail + 1) & (queueEntries - 1)) == cqHead;
+	}
+
+	// Write a completion entry at the CQ tail, then interrupt once coalesceCount are waiting (true: start the timer)
+	bool post(unsigned long long completion, unsigned long long now) {
+		word entry = cqBase + cqTail * COMPLETION_SIZE;
+		Memory[entry] = (completion >> 48) & 0xFF;
+		Memory[(word)(entry + 1)] = (byte)(completion >> 56);
+		Memory[(word)(entry + 2)] = sqHead;
+		Memory[(word)(entry + 3)] = phase;
+		for (unsigned int i = 0; i < 4; i++) {
+			Memory[(word)(entry + 4 + i)] = (now >> (i * 8)) & 0xFF;
+		}
+		vrsDirty.markRange(entry, COMPLETION_SIZE);
+		icache.invalidateRange(entry, COMPLETION_SIZE);
+		cqTail = (cqTail + 1) & (queueEntries - 1);
+		if (cqTail == 0) {
+			phase ^= 1;
+		}
+		unsignaled++;
+		if (unsignaled >= coalesceCount) {
+			signalQueue();
+			return false;
+		}
+		return unsignaled == 1 && coalesceCycles != 0;
+	}
+
+	void signalQueue() {
+		unsignaled = 0;
+		interruptGeneration++;
+		queueInterrupts++;
+		interrupt();
+	}
+
+	// Raise VIA 2's CA1
+	void interrupt() {
+		viaTwo.CA1 = true;
+		viaTwo.setInterrupt();
+		if (viaTwo.checkInterrupt()) {
+			Lines.fetch_and(~LINE_IRQ_VIA_TWO, std::memory_order_release);
+		}
+		else {
+			Lines.fetch_or(LINE_IRQ_VIA_TWO, std::memory_order_release);
+		}
+	}
+
+	// Queue a command for the I/O worker
+	unsigned long long submit(const SSDCommand& command) {
+		while (!commands.push(command)) {
+			std::this_thread::yield();
+		}
+		submitted++;
+		unsigned int depth = commands.size();
+		if (depth > maxDepth) {
+			maxDepth = depth;
+		}
+		if (workerIdle) { // <- Sequentially consistent with the worker's last look at the queue
+			std::lock_guard<std::mutex> lock(workerLock);
+			workerSignal.notify_one();
+		}
+		return submitted;
+	}
+
+public:
+
+	// Signal the completion of a command through VIA 2's CA1 -- on the CPU thread, at the cycle the command ends
+	// The worker is almost always done by then, otherwise the emulated time waits for it.
+	void complete(unsigned long long number = 0) {
+		while (served < number) {
+			std::this_thread::yield();
+		}
+		interrupt();
+	}
+
+	// Pages of the image transfers went through so far
+	unsigned int pagesTouched() const {
+		unsigned int pages = 0;
+		for (unsigned int i = 0; i < touchedPages.size(); i++) {
+			unsigned long long bits = touchedPages[i].load(std::memory_order_relaxed);
+			while (bits != 0) {
+				bits &= bits - 1;
+				pages++;
+			}
+		}
+		return pages;
+	}
+
+	// Bank of the transfers submitted from now on (CMD_BANK)
+	void selectBank(byte number) {
+		bank = number & 0x3F;
+	}
+
+	unsigned int storageSize() const {
+		return capacity;
+	}
+
+	bool isSparse() const {
+		return sparseImage;
+	}
+
+	bool isOverlay() const {
+		return overlay;
+	}
+
+	// Clusters the overlay holds
+	unsigned int overlayClusters() const {
+		return overlay ? sparse.presentClusters() : 0;
+	}
+
+	// Commands waiting in the queue
+	unsigned int queueDepth() {
+		return commands.size();
 	}
 
 	// Latch Instructions and Set Up DMA
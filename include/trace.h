@@ -0,0 +1,89 @@
+// Execution Trace -- a fixed-size ring of binary records, one per instruction (-v)
+// Recording only copies the CPU state, the formatting is left to evm-trace.py, so a traced run keeps most of its speed and
+// only the last records are kept however long it runs. The ring is saved at the end of the run, when PC reaches the
+// trigger (-trace-at), on request (F12, SIGUSR1) and when the emulator crashes.
+
+// Trace record -- the state after an instruction (24 bytes, little-endian in the file)
+struct TraceRecord {
+	unsigned long long cycle; // Emulated cycle the instruction started at
+	word pc; // Address of the opcode
+	word address; // Effective address (Ref. Addr.)
+	byte opcode;
+	byte operand[2]; // Bytes after the opcode (the disassembler needs them)
+	byte ac;
+	byte x;
+	byte y;
+	byte sr;
+	byte sp;
+	byte spValue; // Value on top of the stack
+	byte value; // Value at the effective address
+	byte kind; // TRACE_*
+	byte reserved;
+};
+
+enum {
+	TRACE_INSTRUCTION = 0,
+	TRACE_IRQ = 1, // IRQ taken after the instruction
+	TRACE_NMI = 2, // NMI taken after the instruction
+	TRACE_RESET = 3 // Reset sequence
+};
+
+class TraceRing {
+	std::vector<TraceRecord> records;
+	unsigned long long mask = 0;
+
+public:
+	static const unsigned int DEFAULT_SIZE = 65536; // Records kept (1.5MB)
+	static const unsigned int VERSION = 1;
+
+	unsigned long long head = 0; // Records written since the start (the oldest kept is head - size)
+
+	// Allocate the ring -- size is rounded up to a power of two
+	void allocate(unsigned int size) {
+		unsigned int capacity = 1;
+		while (capacity < size) {
+			capacity <<= 1;
+		}
+		records.assign(capacity, TraceRecord());
+		mask = capacity - 1;
+		head = 0;
+	}
+
+	bool enabled() const {
+		return !records.empty();
+	}
+
+	// Next record to fill (overwrites the oldest one)
+	TraceRecord& next() {
+		return records[head++ & mask];
+	}
+
+	unsigned long long size() const {
+		return head < records.size() ? head : records.size();
+	}
+
+	// Write the records to a file, the oldest first -- header: "EVMTRACE", version, record size, records, records lost
+	bool save(const char* path) const {
+		FILE* file = fopen(path, "wb");
+		if (file == NULL) {
+			return false;
+		}
+		unsigned long long count = size();
+		unsigned long long lost = head - count;
+		unsigned int version = VERSION;
+		unsigned int recordSize = sizeof(TraceRecord);
+		bool ok = fwrite("EVMTRACE", 1, 8, file) == 8;
+		ok = ok && fwrite(&version, sizeof(version), 1, file) == 1;
+		ok = ok && fwrite(&recordSize, sizeof(recordSize), 1, file) == 1;
+		ok = ok && fwrite(&count, sizeof(count), 1, file) == 1;
+		ok = ok && fwrite(&lost, sizeof(lost), 1, file) == 1;
+		unsigned long long first = head - count;
+		while (ok && first < head) { // <- At most two spans (the ring wraps once)
+			unsigned long long start = first & mask;
+			unsigned long long span = std::min<unsigned long long>(head - first, records.size() - start);
+			ok = fwrite(&records[start], sizeof(TraceRecord), span, file) == span;
+			first += span;
+		}
+		return fclose(file) == 0 && ok;
+	}
+};
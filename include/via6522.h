@@ -19,6 +19,11 @@ public:
 	bool CB1 = false, CB2 = false; // Port B Control Line
 	ushort activationRange = 0; // Range of 15 addresses that activates the chip (Value is the first of these addresses)
 
+	// Memory Bus Read Handler -- the register is selected by the lowest 4 bits of the address (writes: the machine's handlers)
+	static byte busRead(void* via, word address) {
+		return ((VIA6522*)via)->sendInstruction((address & 0x0F), 1, 0);
+	}
+
 	// Set IFR
 	void setInterrupt() {
 		if ((IER & 0b10000000) != 0) { // Set bits will enable interrupts for that line
@@ -0,0 +1,51 @@
+// Video Reserved Space ($4000-$7FFF) -- Dirty Span Tracking
+// The VRS is split into 256 spans of 64 bytes: one row in 4-Colors mode, half a row in 256-Colors mode.
+// Stores into the VRS set their span's bit (CPU/SSD threads), and the VCU takes and clears the bits once per frame.
+class VRSDirtyMap {
+private:
+	std::atomic<unsigned long long> bits[4]; // Dirty Spans -- 1 bit per span
+
+public:
+	VRSDirtyMap() {
+		markAll();
+	}
+
+	// Mark the span of a VRS address as changed
+	void mark(word address) {
+		uchar span = (address >> 6) & 0xFF;
+		bits[span >> 6].fetch_or(1ULL << (span & 63), std::memory_order_release);
+	}
+
+	// Mark every span touched by a block of memory (addresses outside the VRS are ignored)
+	void markRange(unsigned int address, unsigned int length) {
+		unsigned int first = address < 0x4000 ? 0x4000 : address;
+		unsigned int last = (address + length) > 0x8000 ? 0x8000 : (address + length);
+		for (unsigned int i = first & 0xFFC0; i < last; i += 64) {
+			mark(i);
+		}
+	}
+
+	// Mark the whole VRS as changed (reset, color mode change)
+	void markAll() {
+		for (uchar i = 0; i < 4; i++) {
+			bits[i].store(~0ULL, std::memory_order_release);
+		}
+	}
+
+	// Take the dirty spans, clearing them for the next frame
+	void take(unsigned long long spans[4]) {
+		for (uchar i = 0; i < 4; i++) {
+			spans[i] = bits[i].exchange(0, std::memory_order_acquire);
+		}
+	}
+
+	// Check whether any of the spans of a row is set in a taken bitmap
+	static bool rowChanged(const unsigned long long spans[4], int row, int spansPerRow) {
+		for (int span = row * spansPerRow; span < (row + 1) * spansPerRow; span++) {
+			if ((spans[span >> 6] & (1ULL << (span & 63))) != 0) {
+				return true;
+			}
+		}
+		return false;
+	}
+};
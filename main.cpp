@@ -11,84 +11,150 @@
 #include <thread>
 #include <fstream>
 #include <vector>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <unordered_map>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <cerrno>
+#include <csignal>
+#include <string>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#include <io.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#endif
 #include <definitions.h>
 #include <SDL.h>
+#include <vrs.h>
 #include <via6522.h>
+#include <bus.h>
+#include <icache.h>
+#include <board.h>
 #include <keyboard.h>
+#include <ringqueue.h>
+#include <scheduler.h>
+#include <pacer.h>
+#include <trace.h>
+#include <diskimage.h>
 #include <ssd.h>
 #include <mos65c02.h>
+#include <jit.h>
+#include <saskernels.h>
 #include <sas.h>
+#include <machine.h>
 
 // Keyboard Layout to be used
 const uchar KBD_LAYOUT = US;
 
-extern byte Memory[0x10000];
-/* Layout:
-	* $0000-$3FCF (RAM 1)
-	* $3FE0-$3FEF (VIA 3)
-	* $3FE0-$3FEF (VIA 2)
-	* $3FF0-$3FFF (VIA 1)
-	* $4000-$7FFF (RAM 2 -- VIDEO RESERVED SPACE)
-	* $8000-$BFFF (RAM 3)
-	* $C000-$FFFF (ROM)
-*/
+// Process start -- before the machine below is constructed (startup report)
+const std::chrono::high_resolution_clock::time_point LaunchTime = std::chrono::high_resolution_clock::now();
+
+// Machine shown in the window
+Machine machine;
 
 // Simple and Square Video Control Unit
-SASVCU vcu;
 const int SCREEN_WIDTH = 768;
 const int SCREEN_HEIGHT = 768;
+const int FRAME_RATE = 60; // Frames presented per second
 int FPS;
-
-// VIAs
-VIA6522 viaOne; // VIA 6522 | 1 ($3FF0-$3FFF)
-VIA6522 viaTwo; // VIA 6522 | 2 ($3FE0-$3FEF)
-VIA6522 viaThree; // VIA 6522 | 2 ($3FD0-$3FDF)
-
-// SSD
-SSD ssd;
-void SSD_RW() {
-	ssd.executeInstruction();
-}
-
-// CPU
-MOS65C02 cpu;
-// CPU pins
-bool RES = false; // Reset Pin (Active-low)
-bool RDY = true; // Ready Pin (Active-high)
-bool NMI = true; // Non-Maskable Interrupt (Active-low)
-bool IRQ = true; // Interrupt Request Queue (Active-low)
+dword FrameBuffer[256 * 256]; // Host copy of the decoded Video Reserved Space (ARGB8888)
+dword ScreenBuffer[SCREEN_WIDTH * SCREEN_HEIGHT]; // FrameBuffer upscaled to the window (only used with the software renderer)
+int RowsUpdated; // Rows decoded and uploaded (Clock Test)
 
 // --- Emulator-specific variables ---
-bool PowerON = true;
+bool headless = false; // No window, keyboard or VCU
+// Run options (copied into every machine by Configure)
 bool verbose = false; // Verbosity
 bool clkTest = false; // Clock Test
-const int ROM_SIZE = 0x4000; // ROM size
-bool SDLStatus = true; // SDL Running
+bool turbo = false; // Run the CPU as fast as the host allows (no sleeping between slices)
+unsigned long long cycleLimit = 0; // Stop after this many emulated cycles (0: no limit)
+int untilPC = -1; // Stop when PC reaches this address (-1: never)
+unsigned int traceSize = TraceRing::DEFAULT_SIZE; // Records kept by the execution trace (-v)
+const char* tracePath = "evm.trace"; // Where the trace is saved
+int traceAt = -1; // Save the trace the first time PC reaches this address (-1: never)
+bool icache = true; // Decoded Instruction Cache
+bool fusion = true; // Fused handlers for hot idioms
+bool idleSkip = true; // Fast-forward idle loops
+bool jit = false; // Dynamic Recompiler
+FlushPolicy flushPolicy = FLUSH_PERIODIC; // When SSD writes are synced to the image file
+const char* storageOverlay = NULL; // Where SSD writes go instead of the image, only read then (NULL: the image itself)
 const char* EmulatorSDLWindowName = "EVM (Erick's Virtual Machine)";
 const char* Version = "alpha";
 
-// Draws the Pixels on the Window, and adjusts the pixel size according to window size
-void Draw(SDL_Renderer* renderer, int scale) {
+// Upload a run of decoded rows to the frame texture
+void UploadRows(SDL_Texture* texture, bool upscale, int first, int rows) {
+	int size = machine.vcu.FrameSize();
 	SDL_Rect rect;
-	rect.x = vcu.HR * scale;
-	rect.y = vcu.VR * scale;
-	rect.h = scale;
-	rect.w = scale;
-	SDL_SetRenderDrawColor(renderer, vcu.RGB[0], vcu.RGB[1], vcu.RGB[2], SDL_ALPHA_OPAQUE);
-	SDL_RenderFillRect(renderer, &rect);
+	if (upscale) {
+		int factor = SCREEN_WIDTH / size;
+		UpscaleRows(&FrameBuffer[first << 8], 256, size, rows, factor, &ScreenBuffer[first * factor * SCREEN_WIDTH], SCREEN_WIDTH);
+		rect.x = 0;
+		rect.y = first * factor;
+		rect.w = SCREEN_WIDTH;
+		rect.h = rows * factor;
+		SDL_UpdateTexture(texture, &rect, &ScreenBuffer[rect.y * SCREEN_WIDTH], SCREEN_WIDTH * sizeof(dword));
+	}
+	else {
+		rect.x = 0;
+		rect.y = first;
+		rect.w = size;
+		rect.h = rows;
+		SDL_UpdateTexture(texture, &rect, &FrameBuffer[first << 8], 256 * sizeof(dword));
+	}
+	RowsUpdated += rows;
+}
+
+// Draws a frame on the Window -- only the rows changed since the last frame are decoded and uploaded,
+// and the texture is scaled to the window size by a single copy
+// (the software renderer gets a window-sized texture, upscaled by the VCU kernels instead of SDL's stretcher)
+void Draw(SDL_Renderer* renderer, SDL_Texture* texture, bool upscale, bool redraw) {
+	unsigned long long dirty[4];
+	machine.vrsDirty.take(dirty);
+
+	int size = machine.vcu.FrameSize();
+	int spansPerRow = 256 / size;
+	int row = 0;
+	while (row < size) {
+		if (!VRSDirtyMap::rowChanged(dirty, row, spansPerRow)) {
+			row++;
+			continue;
+		}
+		int first = row;
+		while (row < size && VRSDirtyMap::rowChanged(dirty, row, spansPerRow)) {
+			machine.vcu.DecodeRow(row, &FrameBuffer[row << 8]);
+			row++;
+		}
+		UploadRows(texture, upscale, first, row - first);
+		redraw = true;
+	}
+
+	if (redraw) { // <- Idle screens skip the copy and present altogether
+		SDL_Rect frame;
+		frame.x = frame.y = 0;
+		frame.w = frame.h = upscale ? SCREEN_WIDTH : size;
+		SDL_RenderCopy(renderer, texture, &frame, NULL);
+		SDL_RenderPresent(renderer);
+	}
 }
 
 // Video Control Unit
 void VCU() {
 	// Initializing Stuff
-	vcu.reset();
-	int scale = 0; // <-- Pixel scale
-	if (vcu.CMR == 1) {
-		scale = SCREEN_WIDTH / 256;
-	}
-	else {
-		scale = SCREEN_WIDTH / 128;
-	}
+	machine.vcu.reset();
 
 	// Initializing SDL
 	if (SDL_Init(SDL_INIT_VIDEO) < 0)
@@ -106,8 +172,11 @@ void VCU() {
 		exit(-1);
 	}
 
-	// Renderer
-	SDL_Renderer* renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_SOFTWARE);
+	// Renderer (falls back to the software renderer when there's no accelerated one)
+	SDL_Renderer* renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
+	if (renderer == nullptr) {
+		renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_SOFTWARE);
+	}
 	if (renderer == nullptr)
 	{
 		std::cerr << "ERROR: Renderer could not be created! SDL_Error: " << SDL_GetError() << std::endl;
@@ -116,15 +185,31 @@ void VCU() {
 		exit(-1);
 	}
 
+	// Frame Texture -- the whole VRS is uploaded to it once per frame (256-colors mode only uses the top-left 128x128)
+	SDL_RendererInfo rendererInfo;
+	SDL_GetRendererInfo(renderer, &rendererInfo);
+	bool upscale = (rendererInfo.flags & SDL_RENDERER_SOFTWARE) != 0;
+	int textureSize = upscale ? SCREEN_WIDTH : 256;
+	SDL_Texture* texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, textureSize, textureSize);
+	if (texture == nullptr)
+	{
+		std::cerr << "ERROR: Texture could not be created! SDL_Error: " << SDL_GetError() << std::endl;
+		SDL_DestroyRenderer(renderer);
+		SDL_DestroyWindow(window);
+		SDL_Quit();
+		exit(-1);
+	}
+
 	// Main loop flag
 	bool quit = false;
+	bool redraw = true; // <- Window needs to be presented even if the VRS didn't change
 	SDL_Event e;
 
 	// Initializing Screen
 	SDL_SetRenderDrawColor(renderer, 0, 0, 0, SDL_ALPHA_OPAQUE);
 	SDL_RenderClear(renderer);
 
-	printf(" --- VCU Running\n");
+	printf(" --- VCU Running (%s kernels%s)\n", VideoKernelName[videoKernel], upscale ? ", software upscale" : "");
 
 	const int REPORT_BUFFER_SIZE = 8; // Size of the Keyboard Repport Buffer
 	byte KeyboardReport[REPORT_BUFFER_SIZE][8]; // Keyboard Reports list
@@ -142,6 +227,8 @@ void VCU() {
 	}
 
 	auto start = std::chrono::high_resolution_clock::now(); // <- Used to get number of frames
+	auto lastFrame = start; // <- Used to present frames at FRAME_RATE
+	const auto frameTime = std::chrono::microseconds(1000000 / FRAME_RATE);
 	// SDL Main loop
 	while (!quit)
 	{
@@ -154,9 +241,15 @@ void VCU() {
 			{
 				quit = true;
 			}
+			else if (e.type == SDL_WINDOWEVENT) {
+				redraw = true;
+			}
+			else if (e.type == SDL_KEYDOWN && machine.verbose && e.key.keysym.sym == SDLK_F12) {
+				machine.traceRequested = true; // <- Host key, the machine doesn't see it
+			}
 			else if (e.type == SDL_KEYDOWN) {
 				Key = TranslateKey(e.key.keysym.sym, KBD_LAYOUT);
-				if (verbose) {
+				if (machine.verbose) {
 					printf("Pressed. ASCII Key Code: %02x\n", e.key.keysym.sym);
 				}
 				if (ReportPacketStatus[ReportsStorageIndex] == true) {
@@ -232,7 +325,7 @@ void VCU() {
 			}
 			else if (e.type == SDL_KEYUP) {
 				Key = TranslateKey(e.key.keysym.sym, KBD_LAYOUT);
-				if (verbose) {
+				if (machine.verbose) {
 					printf("Released. ASCII Key Code: %02x\n", e.key.keysym.sym);
 				}
 				if (ReportPacketStatus[ReportsStorageIndex] == true) {
@@ -299,14 +392,15 @@ void VCU() {
 			}
 		}
 
+		// CPU stopped on its own (-cycles, -until-pc)
+		if (!machine.PowerON) {
+			quit = true;
+		}
+
 		// Send Keyboard Report to the CPU (8-bits at a time)
-		if (IRQ == true && ReportPacketStatus[ReportPacket] == false) {
-			viaOne.PA = KeyboardReport[ReportPacket][ByteCounter] & (~(viaOne.DDRA));
-			viaOne.CA1 = true; // Trigger CA1
-			viaOne.setInterrupt(); // Set up the Interrupt for the CPU
-			IRQ = viaOne.checkInterrupt(); // Trigger the Interrupt
+		if (ReportPacketStatus[ReportPacket] == false && machine.sendKeyboardByte(KeyboardReport[ReportPacket][ByteCounter])) {
 			if (ByteCounter == 7) {
-				if (verbose) {
+				if (machine.verbose) {
 					printf("Keyboard Report Packet Sent: %02x%02x%02x%02x%02x%02x%02x%02x\n", KeyboardReport[ReportPacket][7], KeyboardReport[ReportPacket][6],
 						KeyboardReport[ReportPacket][5], KeyboardReport[ReportPacket][4], KeyboardReport[ReportPacket][3], KeyboardReport[ReportPacket][2],
 						KeyboardReport[ReportPacket][1], KeyboardReport[ReportPacket][0]);
@@ -325,120 +419,619 @@ void VCU() {
 			}
 		}
 
-		// VCU Subroutines
-		vcu.FetchPixelData();
-		vcu.TranslatePixel();
-		Draw(renderer, scale);
-		vcu.IncVideoRegs();
-
 		// Reset VCU
-		if (!RES || (viaOne.PB & 0b00000001)) {
-			vcu.reset();
-			if (vcu.CMR == 1) {
-				scale = SCREEN_WIDTH / 256;
-			}
-			else {
-				scale = SCREEN_WIDTH / 128;
-			}
-			viaOne.PB = 0;
+		if (machine.lineAsserted(LINE_RES) || machine.vcuReset.exchange(false)) {
+			machine.vcu.reset();
+			machine.vrsDirty.markAll();
 			SDL_SetRenderDrawColor(renderer, 0, 0, 0, SDL_ALPHA_OPAQUE);
 			SDL_RenderClear(renderer);
 		}
 
-		if (vcu.HR == 0) {
-			if (vcu.VR == 0) {
-				SDL_RenderPresent(renderer);
+		// VCU Subroutines -- a whole frame is decoded and presented at once
+		auto now = std::chrono::high_resolution_clock::now();
+		if (now - lastFrame >= frameTime) {
+			lastFrame = now;
+			Draw(renderer, texture, upscale, redraw);
+			redraw = false;
 
-				if (clkTest) {
-					auto end = std::chrono::high_resolution_clock::now();
-					FPS++;
-					if (std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() >= 1000) {
-						std::cout << "VCU FPS: " << FPS << std::endl;
-						FPS = 0;
-						start = std::chrono::high_resolution_clock::now();
-					}
+			if (machine.clkTest) {
+				auto end = std::chrono::high_resolution_clock::now();
+				FPS++;
+				if (std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() >= 1000) {
+					std::cout << "VCU FPS: " << FPS << " -- Frame time: " << std::chrono::duration_cast<std::chrono::microseconds>(end - now).count() << "us" << " -- Rows updated: " << RowsUpdated << std::endl;
+					FPS = RowsUpdated = 0;
+					start = std::chrono::high_resolution_clock::now();
 				}
 			}
 		}
+		else {
+			std::this_thread::sleep_for(std::chrono::microseconds(500)); // <- Nothing to do until the next frame (keyboard reports are still sent in between)
+		}
 	}
 
 	// Kill SDL instance
+	SDL_DestroyTexture(texture);
 	SDL_DestroyRenderer(renderer);
 	SDL_DestroyWindow(window);
 	SDL_Quit();
-	SDLStatus = false;
+	machine.PowerON = false;
+	machine.wakeCPU();
 }
 
-// Reset RAM
-void RAMReset() {
-	for (unsigned int i = 0; i < 0x10000; i++) {
-		if (i < (0xFFFF - ROM_SIZE)) {
-			Memory[i] = 0x00;
+// VCU Microbenchmark -- per-pixel register path vs. each frame kernel the host supports
+void BenchVCU() {
+	const int FRAMES = 200;
+	for (unsigned int i = 0x4000; i < 0x8000; i++) {
+		machine.Memory[i] = rand() & 0xFF;
+	}
+
+	printf("VCU Microbenchmark (%d frames per test)\n\n", FRAMES);
+	printf("%-12s %-14s %12s %12s %12s\n", "Color Mode", "Path", "Decode", "Upscale", "Speedup");
+	for (int mode = 1; mode >= 0; mode--) {
+		machine.vcu.CMR = !mode;
+		machine.vcu.reset(); // <- Toggles CMR into the mode being tested
+		int size = machine.vcu.FrameSize();
+		const char* modeName = (mode == 1) ? "4-Colors" : "256-Colors";
+
+		// The pre-frame path: one register walk per pixel
+		auto start = std::chrono::high_resolution_clock::now();
+		for (int f = 0; f < FRAMES; f++) {
+			for (int i = 0; i < size * size; i++) {
+				machine.vcu.FetchPixelData();
+				machine.vcu.TranslatePixel();
+				FrameBuffer[(machine.vcu.VR << 8) | machine.vcu.HR] = 0xFF000000 | (machine.vcu.RGB[0] << 16) | (machine.vcu.RGB[1] << 8) | machine.vcu.RGB[2];
+				machine.vcu.IncVideoRegs();
+			}
+		}
+		double perPixel = std::chrono::duration<double, std::micro>(std::chrono::high_resolution_clock::now() - start).count() / FRAMES;
+		printf("%-12s %-14s %10.1fus %12s %11.2fx\n", modeName, "Per-pixel", perPixel, "-", 1.0);
+
+		for (int kernel = KERNEL_SCALAR; kernel <= DetectVideoKernel(); kernel++) {
+			SelectVideoKernels((VideoKernel)kernel);
+			start = std::chrono::high_resolution_clock::now();
+			for (int f = 0; f < FRAMES; f++) {
+				machine.vcu.DecodeFrame(FrameBuffer);
+			}
+			double decode = std::chrono::duration<double, std::micro>(std::chrono::high_resolution_clock::now() - start).count() / FRAMES;
+			start = std::chrono::high_resolution_clock::now();
+			for (int f = 0; f < FRAMES; f++) {
+				UpscaleRows(FrameBuffer, 256, size, size, SCREEN_WIDTH / size, ScreenBuffer, SCREEN_WIDTH);
+			}
+			double upscale = std::chrono::duration<double, std::micro>(std::chrono::high_resolution_clock::now() - start).count() / FRAMES;
+			printf("%-12s %-14s %10.1fus %10.1fus %11.2fx\n", modeName, VideoKernelName[kernel], decode, upscale, perPixel / decode);
 		}
 	}
+	SelectVideoKernels();
 }
 
-// Central Processing Unit
-void CPU() {
-	int totalCycles = 0;
-	unsigned insAddr = 0;
+// CPU Microbenchmark -- speed of single opcodes, each repeated through 8kb of RAM and looped with a JMP
+void BenchCPU() {
+	const int CYCLES = 40000000;
+	struct BenchOpcode {
+		byte code[4];
+		uchar length;
+		const char* name;
+	};
+	const BenchOpcode OPCODES[] = {
+		{ { 0xA9, 0x80 }, 2, "LDA #imm" }, { { 0xA5, 0x10 }, 2, "LDA zpg" }, { { 0xBD, 0x00, 0x20 }, 3, "LDA abs,X" },
+		{ { 0xB1, 0x10 }, 2, "LDA (zpg),Y" }, { { 0x85, 0x20 }, 2, "STA zpg" }, { { 0x69, 0x35 }, 2, "ADC #imm" },
+		{ { 0xE9, 0x35 }, 2, "SBC #imm" }, { { 0x29, 0x7F }, 2, "AND #imm" }, { { 0x05, 0x10 }, 2, "ORA zpg" },
+		{ { 0xC9, 0x40 }, 2, "CMP #imm" }, { { 0xE0, 0x40 }, 2, "CPX #imm" }, { { 0x24, 0x10 }, 2, "BIT zpg" },
+		{ { 0xE8 }, 1, "INX" }, { { 0x88 }, 1, "DEY" }, { { 0xAA }, 1, "TAX" }, { { 0x0A }, 1, "ASL A" },
+		{ { 0x2A }, 1, "ROL A" }, { { 0x4A }, 1, "LSR A" }, { { 0xE6, 0x20 }, 2, "INC zpg" }, { { 0x26, 0x20 }, 2, "ROL zpg" },
+		{ { 0xD0, 0x00 }, 2, "BNE" }, { { 0x10, 0x00 }, 2, "BPL" }, { { 0x18 }, 1, "CLC" }, { { 0xEA }, 1, "NOP" },
+		// Fused idioms (branches to the next instruction, so both outcomes fall through)
+		{ { 0xCA, 0xD0, 0x00 }, 3, "DEX/BNE" }, { { 0x88, 0xD0, 0x00 }, 3, "DEY/BNE" }, { { 0xB1, 0x10, 0x91, 0x12 }, 4, "LDA/STA (zpg),Y" },
+		{ { 0xC9, 0x40, 0xF0, 0x00 }, 4, "CMP #imm/BEQ" }, { { 0xE6, 0x20, 0xD0, 0x00 }, 4, "INC zpg/BNE" }
+	};
+
+	printf("CPU Microbenchmark (%d cycles per opcode)\n\n", CYCLES);
+	printf("%-16s %10s %10s\n", "Instruction", "ns/ins", "MIPS");
+	machine.releaseLine(LINE_RES);
+	machine.Memory[0x13] = 0x30; // <- STA (zpg),Y stores to $3000+Y, away from the code
+	machine.cpu.IdleSkip = false; // <- Most of these loops store nothing and would be fast-forwarded
+	for (unsigned int i = 0; i < _countof(OPCODES); i++) {
+		const BenchOpcode& op = OPCODES[i];
+		word address = 0x1000;
+		while (address + op.length <= 0x2FFD) {
+			for (uchar b = 0; b < op.length; b++) {
+				machine.Memory[address++] = op.code[b];
+			}
+		}
+		machine.Memory[address] = 0x4C; // <- JMP $1000
+		machine.Memory[address + 1] = 0x00;
+		machine.Memory[address + 2] = 0x10;
+		machine.icache.clear();
 
-	ushort secs = 0;
+		machine.cpu.reset();
+		machine.cpu.PC = 0x1000;
+		machine.cpu.Cycles = CYCLES;
+		machine.cpu.Instructions = 0;
+		auto start = std::chrono::high_resolution_clock::now();
+		machine.cpu.Run();
+		double elapsed = std::chrono::duration<double, std::nano>(std::chrono::high_resolution_clock::now() - start).count();
+		printf("%-16s %10.2f %10.1f\n", op.name, elapsed / machine.cpu.Instructions, machine.cpu.Instructions * 1000.0 / elapsed);
+	}
+}
+
+// Latch a 22-bit value into the SSD through the VIA 2/3 ports (the last byte commits it)
+bool SSDLatch(SSD& disk, unsigned int value, bool RW) {
+	disk.latchAndSetUp(value & 0xFF, 0);
+	disk.latchAndSetUp((value >> 8) & 0xFF, 1);
+	return disk.latchAndSetUp(((value >> 16) & 0b00111111) | (RW << 6) | 0b10000000, 2);
+}
+
+// Size of a file in bytes (0: it can't be opened)
+unsigned long long FileSize(const char* path) {
+	FILE* file = fopen(path, "rb");
+	if (file == NULL) {
+		return 0;
+	}
+#ifdef _WIN32
+	_fseeki64(file, 0, SEEK_END);
+	unsigned long long size = _ftelli64(file);
+#else
+	fseeko(file, 0, SEEK_END);
+	unsigned long long size = ftello(file);
+#endif
+	fclose(file);
+	return size;
+}
+
+// Convert a disk image to raw, sparse or lz4 (sparse, the clusters compressed) -- the input format is detected
+bool ConvertImage(const char* from, const char* to, const char* format, bool report) {
+	bool toSparse = strcmp(format, "sparse") == 0 || strcmp(format, "lz4") == 0;
+	if (!toSparse && strcmp(format, "raw") != 0) {
+		printf("Error: Unknown image format '%s' (raw, sparse or lz4).\n", format);
+		return false;
+	}
+	if (strcmp(from, to) == 0) {
+		printf("Error: The converted image needs another path.\n");
+		return false;
+	}
 	auto start = std::chrono::high_resolution_clock::now();
+	SparseImage sparseIn, sparseOut;
+	FILE* rawIn = NULL;
+	FILE* rawOut = NULL;
+	unsigned long long capacity = 0;
+	unsigned int clusterSize = SparseImage::CLUSTER_SIZE;
+	bool fromSparse = SparseImage::detect(from);
+	if (fromSparse && sparseIn.open(from, false)) {
+		if ((sparseIn.flags & SparseImage::FLAG_OVERLAY) != 0) {
+			printf("Error: %s is an overlay, commit it into its image with -commit-overlay.\n", from);
+			return false;
+		}
+		capacity = sparseIn.capacity;
+		clusterSize = sparseIn.clusterSize;
+	}
+	else if (!fromSparse) {
+		capacity = SSD::rawCapacity(FileSize(from));
+		rawIn = capacity != 0 ? fopen(from, "rb") : NULL;
+	}
+	if (capacity == 0 || (!fromSparse && rawIn == NULL)) {
+		printf("Error: Couldn't load the disk image %s.\n", from);
+		return false;
+	}
+	bool ok = toSparse ? SparseImage::create(to, capacity, strcmp(format, "lz4") == 0 ? SparseImage::FLAG_COMPRESS : 0, clusterSize) && sparseOut.open(to)
+		: (rawOut = fopen(to, "wb")) != NULL;
+	std::vector<byte> cluster(clusterSize);
+	for (unsigned int i = 0; ok && i < capacity / clusterSize; i++) {
+		ok = fromSparse ? sparseIn.readCluster(i, cluster.data()) : fread(cluster.data(), 1, clusterSize, rawIn) == clusterSize;
+		ok = ok && (toSparse ? sparseOut.writeCluster(i, cluster.data()) : fwrite(cluster.data(), 1, clusterSize, rawOut) == clusterSize);
+	}
+	unsigned int stored = toSparse ? sparseOut.presentClusters() : (unsigned int)(capacity / clusterSize);
+	if (toSparse) {
+		ok = ok && sparseOut.sync();
+		sparseOut.close();
+	}
+	if (rawIn != NULL) {
+		fclose(rawIn);
+	}
+	if (rawOut != NULL) {
+		ok = fclose(rawOut) == 0 && ok;
+	}
+	if (!ok) {
+		printf("Error: Couldn't convert %s to %s.\n", from, to);
+		return false;
+	}
+	if (report) {
+		double elapsed = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+		printf("%s (%s, %llu KB) -> %s (%s, %llu KB): %u of %llu clusters stored, %.1fms\n", from, fromSparse ? "sparse" : "raw", FileSize(from) / 1024,
+			to, format, FileSize(to) / 1024, stored, capacity / clusterSize, elapsed);
+	}
+	return true;
+}
 
-	printf(" --- CPU Running\n");
-	RDY = true;
-	while (PowerON) {
-		while (RDY) {
-			// Clock test -- should closely match one second. Set clk_test to true and verbose to false in order to use it.
-			if (clkTest) {
-				if (totalCycles >= cpu.CLOCK_SPEED) {
-					secs++;
-					totalCycles = 0;
-					auto end = std::chrono::high_resolution_clock::now();
-					std::cout << "CPU Speed: " << float(cpu.CLOCK_SPEED / 1000000.0) << "MHz" << " -- Executed in: " << "  " << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() << "ms" << std::endl;
-					start = std::chrono::high_resolution_clock::now();
-				}
+// Commit an overlay into the image it was written over and remove it (stop the machines using the image first: their
+// pages not written come from it)
+bool CommitOverlay(const char* image, const char* overlayPath) {
+	auto start = std::chrono::high_resolution_clock::now();
+	SparseImage overlay, sparseImage;
+	FILE* rawImage = NULL;
+	unsigned long long capacity = 0;
+	bool imageSparse = SparseImage::detect(image);
+	if (imageSparse && sparseImage.open(image) && (sparseImage.flags & SparseImage::FLAG_OVERLAY) == 0) {
+		capacity = sparseImage.capacity;
+	}
+	else if (!imageSparse) {
+		capacity = SSD::rawCapacity(FileSize(image));
+		rawImage = capacity != 0 ? fopen(image, "r+b") : NULL;
+	}
+	if (capacity == 0 || (!imageSparse && rawImage == NULL)) {
+		printf("Error: Couldn't load the disk image %s.\n", image);
+		return false;
+	}
+	if (!overlay.open(overlayPath, false) || (overlay.flags & SparseImage::FLAG_OVERLAY) == 0 || overlay.capacity != capacity
+		|| (imageSparse && overlay.clusterSize != sparseImage.clusterSize)) {
+		printf("Error: %s isn't an overlay of %s.\n", overlayPath, image);
+		if (rawImage != NULL) {
+			fclose(rawImage);
+		}
+		return false;
+	}
+	std::vector<byte> cluster(overlay.clusterSize);
+	unsigned int committed = 0;
+	bool ok = true;
+	for (unsigned int i = 0; ok && i < overlay.clusters(); i++) {
+		if (!overlay.present(i)) {
+			continue;
+		}
+		ok = overlay.readCluster(i, cluster.data());
+		if (imageSparse) {
+			ok = ok && sparseImage.writeCluster(i, cluster.data());
+		}
+		else {
+			ok = ok && SparseImage::seek(rawImage, (unsigned long long)i * overlay.clusterSize) && fwrite(cluster.data(), 1, overlay.clusterSize, rawImage) == overlay.clusterSize;
+		}
+		committed++;
+	}
+	ok = ok && (imageSparse ? sparseImage.sync() : SparseImage::syncFile(rawImage));
+	if (rawImage != NULL) {
+		ok = fclose(rawImage) == 0 && ok;
+	}
+	sparseImage.close();
+	overlay.close();
+	if (!ok) {
+		printf("Error: Couldn't commit %s into %s, the overlay is kept.\n", overlayPath, image);
+		return false;
+	}
+	remove(overlayPath); // <- Only once the image is synced, a failed commit can be run again
+	double elapsed = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	printf("%s -> %s: %u clusters committed, %.1fms\n", overlayPath, image, committed, elapsed);
+	return true;
+}
+
+// Discard an overlay -- the image is back to what it was before the overlay was written
+bool DiscardOverlay(const char* overlayPath) {
+	SparseImage overlay;
+	if (!SparseImage::detect(overlayPath) || !overlay.open(overlayPath, false) || (overlay.flags & SparseImage::FLAG_OVERLAY) == 0) {
+		printf("Error: %s isn't an overlay.\n", overlayPath);
+		return false;
+	}
+	unsigned int clusters = overlay.presentClusters();
+	overlay.close();
+	if (remove(overlayPath) != 0) {
+		printf("Error: Couldn't remove %s.\n", overlayPath);
+		return false;
+	}
+	printf("%s: %u clusters discarded\n", overlayPath, clusters);
+	return true;
+}
+
+// SSD I/O Benchmark -- guest writes with the previous full-image rewrite and with every flush policy, then the load,
+// write (a sparse image reads its clusters then) and flush time of every image format
+void BenchSSD() {
+	char path[] = "ssd_bench.img";
+	const int WRITES = 200;
+	const word SIZES[2] = { 1, 0x7FF };
+
+	std::ofstream out(path, std::ios::binary);
+	std::vector<char> image(SSD::STORAGE_SIZE);
+	out.write(image.data(), image.size());
+	out.close();
+	for (unsigned int i = 0; i < 0x800; i++) {
+		machine.Memory[0x0200 + i] = rand() & 0xFF;
+	}
+
+	printf("SSD I/O Benchmark (%d writes per test, image: %s)\n\n", WRITES, path);
+	printf("%-8s %-12s %14s %14s %8s\n", "Size", "Mode", "Per write", "Close", "Syncs");
+	for (int s = 0; s < 2; s++) {
+		// The previous path: the whole image streamed back to the file one byte at a time
+		const int REWRITES = WRITES / 20;
+		auto start = std::chrono::high_resolution_clock::now();
+		for (int w = 0; w < REWRITES; w++) {
+			unsigned int address = (rand() << 8 | rand()) % (SSD::STORAGE_SIZE - SIZES[s]);
+			memcpy(image.data() + address, machine.Memory + 0x0200, SIZES[s]);
+			std::ofstream img(path, std::ios::binary);
+			for (unsigned int i = 0; i < SSD::STORAGE_SIZE; i++) {
+				img << image[i];
 			}
+		}
+		double perWrite = std::chrono::duration<double, std::micro>(std::chrono::high_resolution_clock::now() - start).count() / REWRITES;
+		printf("%-8d %-12s %12.1fus %14s %8s\n", SIZES[s], "rewrite", perWrite, "-", "-");
 
-			cpu.Cycles += cpu.CLOCK_SPEED / 20;
-			totalCycles += cpu.CLOCK_SPEED / 20;
+		for (int policy = FLUSH_IMMEDIATE; policy <= FLUSH_SHUTDOWN; policy++) {
+			SSD* disk = new SSD(machine);
+			disk->flushPolicy = (FlushPolicy)policy;
+			if (!disk->initializeStorage(path)) {
+				delete disk;
+				return;
+			}
+			SSDLatch(*disk, 0x0200, 0); // <- DSR stays set between transfers
+			start = std::chrono::high_resolution_clock::now();
+			for (int w = 0; w < WRITES; w++) {
+				SSDLatch(*disk, (rand() << 8 | rand()) % (SSD::STORAGE_SIZE - SIZES[s]), 0);
+				SSDLatch(*disk, SIZES[s], 0);
+				disk->executeInstruction();
+			}
+			perWrite = std::chrono::duration<double, std::micro>(std::chrono::high_resolution_clock::now() - start).count() / WRITES;
+			start = std::chrono::high_resolution_clock::now();
+			disk->closeStorage();
+			double close = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+			printf("%-8d %-12s %12.1fus %12.1fms %8llu\n", SIZES[s], FlushPolicyName[policy], perWrite, close, (unsigned long long)disk->syncs);
+			delete disk;
+		}
+	}
 
-			while (cpu.Cycles >= 0) {
-				if (!RES) { // Reset Sequence
-					cpu.reset();
-					RAMReset();
-					if (verbose) {
-						printf(" ---- RESET ----\n");
-					}
-				}
-				insAddr = cpu.PC; // <-- Used for displaying the address of the current instruction's OPCODE
-				cpu.FetchInstruction();
-				cpu.Execute();
-				if (verbose) {
-					printf("PC: %04x    Ins: %02x    X: %02x    Y: %02x    AC: %02x    SR: %02x    SP: %02x    SP Val.: %02x    Ref. Addr.: %04x    Val. in Addr.: %02x\n", insAddr, cpu.IR, cpu.X, cpu.Y, cpu.AC, cpu.SR, cpu.SP, Memory[0x100 | cpu.SP], cpu.Address, Memory[cpu.Address]);
-				}
-				switch (cpu.CheckInterrupts()) {
-					case 1:
-						if (verbose) {
-							printf("### IRQ Interrupt\n");
-						}
-						break;
-					case 2:
-						if (verbose) {
-							printf("### NMI Interrupt\n");
-						}
-						break;
+	// Image formats -- the same contents (a quarter of the image written) as a raw, a sparse and a compressed image
+	const char* FORMATS[3] = { "raw", "sparse", "lz4" };
+	char formatPath[] = "ssd_bench.evd";
+	const char* TEXT = "LDA #$00 STA $0200,X INX BNE loop -- ";
+	std::fill(image.begin(), image.end(), 0);
+	for (unsigned int i = 0; i < SSD::STORAGE_SIZE / 4; i++) {
+		image[i] = rand() % 4 == 0 ? rand() & 0xFF : TEXT[i % strlen(TEXT)];
+	}
+	out.open(path, std::ios::binary);
+	out.write(image.data(), image.size());
+	out.close();
+	printf("\n%-8s %12s %12s %12s %12s %12s\n", "Format", "Load", "Writes", "Flush", "Close", "File");
+	for (int f = 0; f < 3; f++) {
+		char* imagePath = f == 0 ? path : formatPath;
+		if (f != 0 && !ConvertImage(path, formatPath, FORMATS[f], false)) {
+			break;
+		}
+		SSD* disk = new SSD(machine);
+		disk->flushPolicy = FLUSH_SHUTDOWN;
+		auto start = std::chrono::high_resolution_clock::now();
+		if (!disk->initializeStorage(imagePath)) {
+			delete disk;
+			break;
+		}
+		double load = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+		start = std::chrono::high_resolution_clock::now();
+		SSDLatch(*disk, 0x0200, 0);
+		for (int w = 0; w < WRITES; w++) { // <- Into the quarter already written, the rest of the image stays empty
+			SSDLatch(*disk, (rand() << 8 | rand()) % (SSD::STORAGE_SIZE / 4 - SIZES[1]), 0);
+			SSDLatch(*disk, SIZES[1], 0);
+			disk->executeInstruction(); // <- A sparse image reads the clusters written into the first time
+		}
+		double writes = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+		start = std::chrono::high_resolution_clock::now();
+		disk->flush();
+		double flush = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+		start = std::chrono::high_resolution_clock::now();
+		disk->closeStorage();
+		double close = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+		printf("%-8s %10.2fms %10.2fms %10.2fms %10.2fms %10lluKB\n", FORMATS[f], load, writes, flush, close, FileSize(imagePath) / 1024);
+		delete disk;
+	}
+	remove(path);
+	remove(formatPath);
+}
+
+// Copy the run options into a machine
+void Configure(Machine& m) {
+	m.verbose = verbose;
+	m.clkTest = clkTest;
+	m.turbo = turbo;
+	m.cycleLimit = cycleLimit;
+	m.untilPC = untilPC;
+	m.tracePath = tracePath;
+	m.traceAt = traceAt;
+	if (verbose) {
+		m.trace.allocate(traceSize);
+	}
+	m.maxRun = headless ? 0 : m.cpu.CLOCK_SPEED / 2000; // <- The window thread posts keyboard input, picked up within 0.5ms
+	m.icache.enabled = icache;
+	m.cpu.Fusion = fusion;
+	m.cpu.IdleSkip = idleSkip && !verbose; // <- The trace shows every pass
+	m.ssd.flushPolicy = flushPolicy;
+#if EVM_JIT
+	if (jit && m.jit == NULL) {
+		m.jit = new JIT(m.cpu, m);
+		if (!m.jit->ready()) {
+			std::cerr << "Couldn't allocate executable memory for the JIT, interpreting instead.\n";
+			delete m.jit;
+			m.jit = NULL;
+		}
+	}
+#else
+	if (jit) {
+		std::cerr << "The JIT is only available on x86-64 hosts, interpreting instead.\n";
+	}
+#endif
+}
+
+// Parse a run option (flags that take a value advance i)
+bool ParseFlag(int argc, char* argv[], int& i) {
+	if (strcmp(argv[i], "-v") == 0) {
+		verbose = true;
+	}
+	else if (strcmp(argv[i], "-clk") == 0) {
+		clkTest = true;
+	}
+	else if (strcmp(argv[i], "-turbo") == 0) {
+		turbo = true;
+	}
+	else if (strcmp(argv[i], "-headless") == 0) {
+		headless = true;
+	}
+	else if (strcmp(argv[i], "-no-icache") == 0) {
+		icache = false;
+	}
+	else if (strcmp(argv[i], "-no-fusion") == 0) {
+		fusion = false;
+	}
+	else if (strcmp(argv[i], "-no-idle-skip") == 0) {
+		idleSkip = false;
+	}
+	else if (strcmp(argv[i], "-jit") == 0) {
+		jit = true;
+	}
+	else if (strcmp(argv[i], "-cycles") == 0 && i + 1 < argc) {
+		i++;
+		cycleLimit = strtoull(argv[i], NULL, 10);
+	}
+	else if (strcmp(argv[i], "-until-pc") == 0 && i + 1 < argc) {
+		i++;
+		untilPC = int(strtoul(argv[i], NULL, 16) & 0xFFFF);
+	}
+	else if (strcmp(argv[i], "-trace-size") == 0 && i + 1 < argc) {
+		i++;
+		traceSize = unsigned(strtoul(argv[i], NULL, 10));
+		if (traceSize == 0) {
+			std::cerr << "Error: Invalid trace size! " << argv[i] << std::endl;
+			return false;
+		}
+	}
+	else if (strcmp(argv[i], "-trace-file") == 0 && i + 1 < argc) {
+		i++;
+		tracePath = argv[i];
+	}
+	else if (strcmp(argv[i], "-trace-at") == 0 && i + 1 < argc) {
+		i++;
+		traceAt = int(strtoul(argv[i], NULL, 16) & 0xFFFF);
+	}
+	else if (strcmp(argv[i], "-storage-overlay") == 0 && i + 1 < argc) {
+		i++;
+		storageOverlay = argv[i];
+	}
+	else if (strcmp(argv[i], "-storage-flush") == 0 && i + 1 < argc) {
+		i++;
+		if (strcmp(argv[i], "immediate") == 0) {
+			flushPolicy = FLUSH_IMMEDIATE;
+		}
+		else if (strcmp(argv[i], "periodic") == 0) {
+			flushPolicy = FLUSH_PERIODIC;
+		}
+		else if (strcmp(argv[i], "shutdown") == 0) {
+			flushPolicy = FLUSH_SHUTDOWN;
+		}
+		else {
+			std::cerr << "Error: Invalid flush policy! " << argv[i] << std::endl;
+			return false;
+		}
+	}
+	else {
+		std::cerr << "Error: Invalid flag!" << argv[i] << std::endl;
+		return false;
+	}
+	return true;
+}
+
+// Batch Runner -- runs every ROM/image pair of a list file on its own headless, turbo machine, jobs machines at a time
+// List file: one "<rom path> <image path>" pair per line (each job needs its own image, or -storage-overlay: the jobs can
+// share an image then, job n writes to <overlay>.<n>)
+int RunBatch(const char* listPath, int jobs) {
+	std::vector<std::string> roms, images;
+	std::ifstream list(listPath);
+	std::string rom, image;
+	while (list >> rom >> image) {
+		roms.push_back(rom);
+		images.push_back(image);
+	}
+	if (roms.empty()) {
+		std::cerr << "Error: Couldn't read any ROM/image pair from " << listPath << std::endl;
+		return 1;
+	}
+	if (cycleLimit == 0 && untilPC == -1) {
+		std::cerr << "Error: Batch jobs need an exit condition (-cycles or -until-pc)!\n";
+		return 1;
+	}
+
+	std::atomic<unsigned int> next{ 0 }; // <- Next job to be taken by a worker
+	std::atomic<unsigned int> failed{ 0 };
+	std::atomic<unsigned long long> totalInstructions{ 0 };
+	std::mutex outputLock;
+	printf("Running %u jobs on %d workers\n", (unsigned int)roms.size(), jobs);
+	auto start = std::chrono::high_resolution_clock::now();
+
+	auto worker = [&]() {
+		unsigned int job;
+		while ((job = next++) < roms.size()) {
+			auto jobStart = std::chrono::high_resolution_clock::now();
+			Machine* m = new Machine;
+			Configure(*m);
+			m->launchTime = jobStart;
+			m->turbo = true;
+			m->maxRun = 0; // <- No window thread
+			m->tracePath = images[job] + ".trace"; // <- One trace per job
+			std::string overlay = storageOverlay != NULL ? std::string(storageOverlay) + "." + std::to_string(job) : "";
+			bool loaded = m->loadROM(roms[job].c_str()) && m->ssd.initializeStorage(&images[job][0], storageOverlay != NULL ? overlay.c_str() : NULL);
+			if (loaded) {
+				m->Run();
+				m->ssd.closeStorage();
+			}
+			double wall = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - jobStart).count();
+			{
+				std::lock_guard<std::mutex> lock(outputLock);
+				if (loaded) {
+					printf("[%u] %s %s -- %llu cycles, %llu instructions, %.3fs, %.2f MIPS, PC: %04x\n", job, roms[job].c_str(), images[job].c_str(),
+						m->emulatedCycles, m->cpu.Instructions, wall, m->cpu.Instructions / wall / 1000000.0, m->cpu.PC);
 				}
-				if (SDLStatus == false) {
-					PowerON = false;
-					RDY = false;
-					break;
+				else {
+					printf("[%u] %s %s -- FAILED\n", job, roms[job].c_str(), images[job].c_str());
 				}
 			}
-			std::this_thread::sleep_for(std::chrono::microseconds(50000));
+			totalInstructions += m->cpu.Instructions;
+			if (!loaded) {
+				failed++;
+			}
+			delete m;
 		}
+	};
+	std::vector<std::thread> pool;
+	for (int i = 0; i < jobs; i++) {
+		pool.push_back(std::thread(worker));
 	}
+	for (unsigned int i = 0; i < pool.size(); i++) {
+		pool[i].join();
+	}
+
+	double wall = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+	printf(" --- Jobs: %u (%u failed)\n", (unsigned int)roms.size(), (unsigned int)failed);
+	printf(" --- Wall time: %.3fs\n", wall);
+	printf(" --- Aggregate speed: %.2f MIPS\n", totalInstructions / wall / 1000000.0);
+	return failed != 0 ? 1 : 0;
+}
+
+// Trace dumps -- a crash saves the last records before the process goes down, SIGUSR1 asks for them while running
+void CrashHandler(int sig) {
+	machine.trace.save(machine.tracePath.c_str()); // <- Not async-signal-safe, but the process is lost anyway
+	std::signal(sig, SIG_DFL);
+	std::raise(sig);
+}
+
+#ifndef _WIN32
+void TraceRequestHandler(int) {
+	machine.traceRequested = true;
+}
+#endif
+
+void InstallTraceHandlers() {
+	std::signal(SIGSEGV, CrashHandler);
+	std::signal(SIGILL, CrashHandler);
+	std::signal(SIGFPE, CrashHandler);
+	std::signal(SIGABRT, CrashHandler);
+#ifndef _WIN32
+	std::signal(SIGBUS, CrashHandler);
+	std::signal(SIGUSR1, TraceRequestHandler);
+#endif
+}
+
+// Central Processing Unit
+void CPU() {
+	machine.Run();
 }
 
 int main(int argc, char* argv[]) {
@@ -446,21 +1039,101 @@ int main(int argc, char* argv[]) {
 		std::cerr << "Error: Not enough arguments.\n";
 		return 0;
 	}
+	else if (strcmp(argv[1], "-batch") == 0) {
+		if (argc < 3) {
+			printf("Error: Missing arguments! Use -help for more information.\n");
+			return 1;
+		}
+		int jobs = std::thread::hardware_concurrency();
+		for (int i = 3; i < argc; i++) {
+			if (strcmp(argv[i], "-jobs") == 0 && i + 1 < argc) {
+				i++;
+				jobs = atoi(argv[i]);
+			}
+			else if (!ParseFlag(argc, argv, i)) {
+				return 1;
+			}
+		}
+		return RunBatch(argv[2], jobs > 0 ? jobs : 1);
+	}
+	else if (strcmp(argv[1], "-convert-image") == 0) {
+		if (argc < 4) {
+			printf("Error: Missing arguments! Use -help for more information.\n");
+			return 1;
+		}
+		return ConvertImage(argv[2], argv[3], argc > 4 ? argv[4] : "sparse", true) ? 0 : 1;
+	}
+	else if (strcmp(argv[1], "-commit-overlay") == 0) {
+		if (argc < 4) {
+			printf("Error: Missing arguments! Use -help for more information.\n");
+			return 1;
+		}
+		return CommitOverlay(argv[2], argv[3]) ? 0 : 1;
+	}
+	else if (strcmp(argv[1], "-discard-overlay") == 0) {
+		if (argc < 3) {
+			printf("Error: Missing arguments! Use -help for more information.\n");
+			return 1;
+		}
+		return DiscardOverlay(argv[2]) ? 0 : 1;
+	}
 	else if (argc == 2) {
 		if (strcmp(argv[1], "-help") == 0) {
 			printf("Proper syntax: EVM -rom <path> -storage <path> <flag>\n\n");
 			printf("Flags:          Description:\n");
 			printf("  -rom          Path to ROM\n");
-			printf("  -storage      Path to Virtual Storage Device (.img file)\n");
-			printf("  -v            Enable Verbose\n");
-			printf("  -clk          Enable Clock Test");
-			printf("\n\nNotice: Verbose and Clock Test cannot be enabled at the same time.\n");
+			printf("  -storage      Path to Virtual Storage Device (a raw .img file, or a sparse image)\n");
+			printf("  -v            Enable Verbose (records an execution trace, saved at exit, on F12 or SIGUSR1 and on a crash)\n");
+			printf("  -clk          Enable Clock Test\n");
+			printf("  -turbo        Run the CPU as fast as the host allows\n");
+			printf("  -headless     Run without a window (no display or keyboard)\n");
+			printf("  -no-icache    Disable the Decoded Instruction Cache\n");
+			printf("  -no-fusion    Run hot idioms (DEX/BNE, copy loops...) one instruction at a time\n");
+			printf("  -no-idle-skip Run idle loops (JMP *, polling a VIA) one instruction at a time instead of skipping them\n");
+			printf("  -jit          Translate hot code to native code (x86-64 hosts only)\n");
+			printf("  -cycles <n>   Stop after n emulated cycles\n");
+			printf("  -until-pc <addr>\n");
+			printf("                Stop when PC reaches addr (hexadecimal)\n");
+			printf("  -trace-size <n>\n");
+			printf("                Instructions kept by the trace (Default: 65536)\n");
+			printf("  -trace-file <path>\n");
+			printf("                Where the trace is saved (Default: evm.trace), decode it with evm-trace.py\n");
+			printf("  -trace-at <addr>\n");
+			printf("                Save the trace the first time PC reaches addr (hexadecimal)\n");
+			printf("  -storage-flush <immediate|periodic|shutdown>\n");
+			printf("                When writes to the storage are synced to the image file (Default: periodic)\n");
+			printf("  -storage-overlay <path>\n");
+			printf("                Only read the storage image, its writes go to an overlay file (created the first time)\n");
+			printf("  -batch <list> [-jobs <n>] <flags>\n");
+			printf("                Run the ROM/image pairs of a list file headless, n machines at a time (Default: one per core)\n");
+			printf("  -convert-image <from> <to> [raw|sparse|lz4]\n");
+			printf("                Convert a disk image (Default: sparse, lz4 is sparse with compressed clusters)\n");
+			printf("  -commit-overlay <image> <overlay>\n");
+			printf("                Write an overlay into its image and remove it (stop the machines using the image first)\n");
+			printf("  -discard-overlay <overlay>\n");
+			printf("                Remove an overlay, its writes are lost\n");
+			printf("  -bench-vcu    Run the VCU decode/upscale microbenchmark (no ROM needed)\n");
+			printf("  -bench-ssd    Run the SSD I/O benchmark (no ROM needed, uses ssd_bench.img/.evd in the current folder)\n");
+			printf("  -bench-cpu    Run the per-opcode CPU microbenchmark (no ROM needed)");
+			printf("\n\nNotice: Verbose runs idle loops one instruction at a time (the trace shows every pass), as -no-idle-skip.\n");
 			return 0;
 		}
 		else if (strcmp(argv[1], "-about") == 0) {
 			printf("EVM (Erick's Virtual Machine)\n * Version: %s\n", Version);
 			return 0;
 		}
+		else if (strcmp(argv[1], "-bench-vcu") == 0) {
+			BenchVCU();
+			return 0;
+		}
+		else if (strcmp(argv[1], "-bench-ssd") == 0) {
+			BenchSSD();
+			return 0;
+		}
+		else if (strcmp(argv[1], "-bench-cpu") == 0) {
+			BenchCPU();
+			return 0;
+		}
 		else if (strcmp(argv[1], "-rom") == 0) {
 			printf("Error: Missing arguments! Use -help for more information.\n");
 		}
@@ -488,61 +1161,42 @@ int main(int argc, char* argv[]) {
 			return 1;
 		}
 	}
-	else if (argc == 6) {
-		if (strcmp(argv[5], "-v") == 0) {
-			verbose = true;
-		}
-		else if (strcmp(argv[5], "-clk") == 0) {
-			clkTest = true;
-		}
-		else {
-			std::cerr << "Error: Invalid flag!" << argv[5] << std::endl;
-			return 1;
+	else if (argc >= 6) {
+		for (int i = 5; i < argc; i++) {
+			if (!ParseFlag(argc, argv, i)) {
+				return 1;
+			}
 		}
 	}
-	else if (argc > 6) {
-		printf("Error: Too many arguments!\n");
-	}
 
 	// Loading ROM from file
-	std::vector<char> ROM(ROM_SIZE); // Contents of the ROM file
-	std::ifstream rom(argv[2], std::ios::binary); // ROM file
-
-	if (!rom.read(ROM.data(), ROM_SIZE)) {
-		std::cerr << "Couldn't read the ROM file.\nPath is invalid, ROM file is smaller than " << ROM_SIZE / 1024 << "kb or permission to file is denied.\n";
+	if (!machine.loadROM(argv[2])) {
 		return 1;
 	}
-	rom.close();
 
-	// Initializing Memory and Copying ROM
-	ushort x = 0;
-	for (unsigned int i = 0; i < 0x10000; i++) {
-		if (i > (0xFFFF - ROM_SIZE)) {
-			Memory[i] = ROM[x];
-			x++;
-		}
-		else {
-			Memory[i] = 0x00;
-		}
-	}
-
-	ROM.clear();
-	ROM.shrink_to_fit();
+	SelectVideoKernels();
 
-	viaOne.activationRange = 0x3FF0; // <- $3FF0-$3FFF
-	viaTwo.activationRange = 0x3FE0; // <- $3FE0-$3FEF
-	viaThree.activationRange = 0x3FD0; // <- $3FD0-$3FDF
-	if (!ssd.initializeStorage(argv[4])) {
+	Configure(machine);
+	machine.launchTime = LaunchTime;
+	if (!machine.ssd.initializeStorage(argv[4], storageOverlay)) {
 		return 1;
 	}
+	if (machine.trace.enabled()) {
+		InstallTraceHandlers();
+	}
 
+	auto start = std::chrono::high_resolution_clock::now();
 	std::thread CPU_thread(CPU);
-	std::thread VCU_thread(VCU);
 	printf("Erick's Virtual Machine\n\n");
 	printf("Version: %s\n", Version);
 
-	VCU_thread.join();
-	printf(" --- Stopping Emulation...\n");
+	if (!headless) {
+		std::thread VCU_thread(VCU);
+		VCU_thread.join();
+		printf(" --- Stopping Emulation...\n");
+	}
 	CPU_thread.join();
+	machine.ssd.closeStorage();
+	machine.PrintRunStats(start);
 	return 0;
 }